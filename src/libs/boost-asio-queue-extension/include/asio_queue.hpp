@@ -13,4 +13,9 @@
 #include "sockserv_queue.hpp"
 #include "sockclient_queue.hpp"
 #include "sockdeq_serv_queue.hpp"
+#include "sockmserv_queue.hpp"
+#include "sockclient_pool_queue.hpp"
+#include "fd_relay.hpp"
+#include "rpc_client.hpp"
+#include "udp_queue.hpp"
 #endif
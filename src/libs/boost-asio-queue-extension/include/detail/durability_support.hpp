@@ -0,0 +1,110 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0.
+
+#ifndef __DURABILITY_SUPPORT_H__
+#define __DURABILITY_SUPPORT_H__
+#include "queue_support.hpp"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <boost/filesystem.hpp>
+#include <boost/asio/error.hpp>
+
+namespace boost{
+namespace asio{
+
+// durability policy for queues storing messages in the file system
+// (none:         messages are written but never explicitly flushed - may be lost on power failure)
+// (fsync:        each message file and the queue directory are fsync()ed before enq returns)
+// (group_commit: concurrent enqueues are collected during a commit window and fsync()ed in one batch)
+enum class queue_durability:int{none=0,fsync=1,group_commit=2};
+
+namespace detail{
+namespace queue_support{
+
+namespace fs=boost::filesystem;
+
+// sync a set of files and the directory they live in
+// (empty paths are skipped - an empty directory only syncs the files and no files only syncs the directory)
+// (returns errno of first failure, else 0)
+inline int syncFiles(std::vector<fs::path>const&files,fs::path const&dir){
+  int ret{0};
+  for(auto const&f:files){
+    if(f.empty())continue;
+    int err{esync(f)};
+    if(ret==0)ret=err;
+  }
+  if(dir.empty())return ret;
+  int err{esync(dir)};
+  if(ret==0)ret=err;
+  return ret;
+}
+// batch files written by concurrent threads into a single round of fsync() calls
+// (the first thread arriving becomes leader, collects files arriving during the commit window,
+//  syncs the batch and releases all threads waiting on the batch)
+// (threads arriving while a batch is being synced are collected in the next batch)
+// (if dir is empty only the files are synced, if a thread commits an empty path only the directory is synced)
+class group_commit{
+public:
+  // ctors,assign,dtor
+  group_commit(fs::path const&dir,std::size_t window_us):
+      dir_(dir),window_us_(window_us),curr_(std::make_shared<batch>()){
+  }
+  group_commit(group_commit const&)=delete;
+  group_commit(group_commit&&)=delete;
+  group_commit&operator=(group_commit const&)=delete;
+  group_commit&operator=(group_commit&&)=delete;
+  ~group_commit()=default;
+
+  // add file to current batch and return when the batch is durable
+  // (returns false if batch could not be synced - error code is then set)
+  bool commit(fs::path const&file,boost::system::error_code&ec){
+    std::unique_lock<std::mutex>lock(mtx_);
+    std::shared_ptr<batch>b{curr_};
+    b->files.push_back(file);
+    while(!b->done){
+      // if another batch is being synced, wait for it
+      if(syncing_){
+        cond_.wait(lock);
+        continue;
+      }
+      // we are leader - keep batch open during the commit window, then start a new batch
+      // (only the leader closes a batch so the batch we are waiting for is still the current batch)
+      syncing_=true;
+      auto tmo=std::chrono::steady_clock::now()+std::chrono::microseconds(window_us_);
+      while(std::chrono::steady_clock::now()<tmo)cond_.wait_until(lock,tmo);
+      curr_=std::make_shared<batch>();
+
+      // sync batch without holding lock so that other threads can queue up in next batch
+      lock.unlock();
+      int err{syncFiles(b->files,dir_)};
+      lock.lock();
+      if(err!=0)b->ec=boost::system::error_code(err,boost::system::get_posix_category());
+      b->done=true;
+      syncing_=false;
+      cond_.notify_all();
+    }
+    ec=b->ec;
+    return ec==boost::system::error_code();
+  }
+private:
+  // batch of files synced together
+  struct batch{
+    std::vector<fs::path>files;          // files to sync
+    bool done=false;                     // set when batch has been synced
+    boost::system::error_code ec;        // error from syncing batch
+  };
+  fs::path const dir_;                   // directory containing files
+  std::size_t const window_us_;          // time in us a batch is kept open
+  std::mutex mtx_;                       // protects batch state
+  std::condition_variable cond_;         // signalled when a batch completes
+  std::shared_ptr<batch>curr_;           // batch currently collecting files
+  bool syncing_=false;                   // true while a leader owns a batch
+};
+}
+}
+}
+}
+#endif
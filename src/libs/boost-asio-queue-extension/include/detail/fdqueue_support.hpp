@@ -3,83 +3,310 @@
 
 #ifndef __FDQUEUE_SUPPPORT_H__
 #define __FDQUEUE_SUPPPORT_H__
+#include "queue_support.hpp"
+#include "reactor_support.hpp"
 #include <utility>
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <streambuf>
+#include <vector>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <algorithm>
 #include <unistd.h>
-#include <sys/select.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
 #include <boost/asio/error.hpp>
 
 namespace boost{
 namespace asio{
+
+// options for coalescing (corking) messages written to an fd
+// (corking is off if both max_bytes and max_delay_us are 0 - each message is then written when it is enqueued)
+// (buffered messages are written with writev() when max_bytes bytes are buffered or max_delay_us us after the first
+//  message was buffered, whichever comes first - a 0 value disables that trigger)
+struct cork_options{
+  std::size_t max_bytes=0;               // flush when at least this many bytes are buffered
+  std::size_t max_delay_us=0;            // flush at the latest this many us after first message was buffered
+};
 namespace detail{
 namespace queue_support{
 namespace fs=boost::filesystem;
 namespace io=boost::iostreams;
-namespace{
+// buffer collecting bytes read from an fd and splitting them into messages
+// (bytes are read in large chunks and bytes read past the end of a message are kept for the next message)
+// (separators are located with memchr() and the buffer remembers how far it has scanned for a separator)
+// (if reading from a record based socket (SOCK_SEQPACKET) each read returns one record - a record which does not fit in
+//  the free space of the buffer (at least one chunk) is reported as an EMSGSIZE error instead of being truncated)
+class fdreadbuf{
+public:
+  // default #of bytes to read in one read() call
+  constexpr static std::size_t CHUNK=64*1024;
+
+  // ctors,assign,dtor
+  explicit fdreadbuf(std::size_t chunk=CHUNK):chunk_(chunk){}
+  fdreadbuf(fdreadbuf const&)=default;
+  fdreadbuf(fdreadbuf&&)=default;
+  fdreadbuf&operator=(fdreadbuf const&)=default;
+  fdreadbuf&operator=(fdreadbuf&&)=default;
+  ~fdreadbuf()=default;
+
+  // read once from fd into buffer
+  // (returns #of bytes read, 0 if end of file, -1 if error - errno is then set)
+  ssize_t fill(int fd){
+    reserve(chunk_);
+    if(records_)return fillRecord(fd);
+    ssize_t stat;
+    while((stat=::read(fd,buf_.data()+end_,buf_.size()-end_))<0&&errno==EINTR){}
+    if(stat>0)end_+=stat;
+    return stat;
+  }
+  // append bytes already read from an fd
+  void append(char const*p,std::size_t n){
+    reserve(n);
+    std::memcpy(buf_.data()+end_,p,n);
+    end_+=n;
+  }
+  // read from a record based socket
+  void records(bool r){records_=r;}
+  // get next message terminated by 'sep' (including 'sep')
+  // (returns false if there is no complete message in buffer)
+  bool next(char sep,char const*&msg,std::size_t&len){
+    void const*p{std::memchr(buf_.data()+scan_,sep,end_-scan_)};
+    if(p==nullptr){
+      scan_=end_;
+      return false;
+    }
+    char const*pend{static_cast<char const*>(p)+1};
+    msg=buf_.data()+begin_;
+    len=pend-msg;
+    begin_+=len;
+    scan_=begin_;
+    return true;
+  }
+  // get #of buffered bytes not yet returned as a message
+  std::size_t size()const{return end_-begin_;}
+
+  // get buffered bytes not yet returned as a message
+  char const*data()const{return buf_.data()+begin_;}
+
+  // drop 'n' bytes from front of buffered bytes
+  // (used when a message is located without scanning for a separator)
+  void consume(std::size_t n){
+    begin_+=n;
+    scan_=std::max(scan_,begin_);
+  }
 
+  // drop all buffered bytes
+  void clear(){begin_=end_=scan_=0;}
+private:
+  // make room for 'n' bytes - move unconsumed bytes to front of buffer, grow buffer if still not enough room
+  void reserve(std::size_t n){
+    if(buf_.size()-end_<n){
+      if(begin_>0){
+        std::memmove(buf_.data(),buf_.data()+begin_,end_-begin_);
+        end_-=begin_;
+        scan_-=begin_;
+        begin_=0;
+      }
+      if(buf_.size()-end_<n)buf_.resize(end_+n);
+    }
+  }
+  // read one record from a socket
+  ssize_t fillRecord(int fd){
+    struct iovec iov{buf_.data()+end_,buf_.size()-end_};
+    struct msghdr msg{};
+    msg.msg_iov=&iov;
+    msg.msg_iovlen=1;
+    ssize_t stat;
+    while((stat=::recvmsg(fd,&msg,0))<0&&errno==EINTR){}
+    if(stat>0&&(msg.msg_flags&MSG_TRUNC)){
+      errno=EMSGSIZE;
+      return -1;
+    }
+    if(stat>0)end_+=stat;
+    return stat;
+  }
+  std::size_t chunk_;                    // #of bytes to read in one read() call
+  std::vector<char>buf_;                 // buffer
+  std::size_t begin_=0;                  // start of unconsumed bytes
+  std::size_t end_=0;                    // end of bytes read
+  std::size_t scan_=0;                   // bytes before 'scan_' do not contain a separator
+  bool records_=false;                   // reading from a record based socket
+};
+}
+}
+
+// message framing policies for fd and socket queues
+// (next():   locate next message in a read buffer - returns false if no complete message is buffered,
+//            sets error code if the buffered bytes cannot be a valid frame)
+// (length(): length prefixed framings only - decode header from the first bytes of a frame)
+// (fits():   check if a serialised message of a given length can be framed - checked before a message is sent)
+// (header(): header written before a serialised message)
+// (trailer(): appended after a serialised message)
+
+// messages are terminated by a separator character
+// (the message handed to the de-serialiser includes the separator)
+// (binary messages must be encoded so they do not contain the separator)
+class sep_framing{
+public:
+  explicit sep_framing(char sep='\n'):sep_(sep){}
+  bool next(detail::queue_support::fdreadbuf&buf,char const*&msg,std::size_t&len,boost::system::error_code&ec)const{
+    ec=boost::system::error_code();
+    return buf.next(sep_,msg,len);
+  }
+  bool fits(std::size_t)const{return true;}
+  std::string header(std::size_t)const{return std::string();}
+  void trailer(std::string&out)const{out.push_back(sep_);}
+  char sep()const{return sep_;}
+private:
+  char sep_;
+};
+// messages are preceded by their length encoded as a varint (7 bits per byte, least significant group first)
+// (the message handed to the de-serialiser is exactly the payload - no bytes are scanned or copied)
+class varint_framing{
+public:
+  constexpr static std::size_t MAXHDR=10;
+  explicit varint_framing(std::size_t maxlen=MAXLEN):maxlen_(maxlen){}
+  bool next(detail::queue_support::fdreadbuf&buf,char const*&msg,std::size_t&len,boost::system::error_code&ec)const{
+    std::size_t hdrlen;
+    if(!length(buf.data(),buf.size(),hdrlen,len,ec))return false;
+    if(buf.size()-hdrlen<len)return false;
+    msg=buf.data()+hdrlen;
+    buf.consume(hdrlen+len);
+    return true;
+  }
+  bool length(char const*hdr,std::size_t n,std::size_t&hdrlen,std::size_t&len,boost::system::error_code&ec)const{
+    ec=boost::system::error_code();
+    unsigned char const*p{reinterpret_cast<unsigned char const*>(hdr)};
+    std::uint64_t val{0};
+    for(std::size_t i=0;i<n&&i<MAXHDR;++i){
+      // (last byte can only carry bit 63 - anything else does not fit in 64 bits)
+      if(i==MAXHDR-1&&p[i]>1){
+        ec=boost::asio::error::message_size;
+        return false;
+      }
+      val|=static_cast<std::uint64_t>(p[i]&0x7f)<<(7*i);
+      if(p[i]&0x80)continue;
+      if(val>maxlen_){
+        ec=boost::asio::error::message_size;
+        return false;
+      }
+      hdrlen=i+1;
+      len=val;
+      return true;
+    }
+    if(n>=MAXHDR)ec=boost::asio::error::message_size;
+    return false;
+  }
+  bool fits(std::size_t len)const{return len<=maxlen_;}
+  std::string header(std::size_t len)const{
+    std::string ret;
+    do{
+      unsigned char c=len&0x7f;
+      len>>=7;
+      if(len)c|=0x80;
+      ret.push_back(static_cast<char>(c));
+    }while(len);
+    return ret;
+  }
+  void trailer(std::string&)const{}
+private:
+  constexpr static std::size_t MAXLEN=std::size_t(1)<<30;
+  std::size_t maxlen_;                   // max message size accepted
+};
+// messages are preceded by their length as a 4 byte unsigned integer in network byte order
+class fixed_framing{
+public:
+  constexpr static std::size_t MAXHDR=4;
+  explicit fixed_framing(std::size_t maxlen=MAXLEN):maxlen_(maxlen){}
+  bool next(detail::queue_support::fdreadbuf&buf,char const*&msg,std::size_t&len,boost::system::error_code&ec)const{
+    std::size_t hdrlen;
+    if(!length(buf.data(),buf.size(),hdrlen,len,ec))return false;
+    if(buf.size()-hdrlen<len)return false;
+    msg=buf.data()+hdrlen;
+    buf.consume(hdrlen+len);
+    return true;
+  }
+  bool length(char const*hdr,std::size_t n,std::size_t&hdrlen,std::size_t&len,boost::system::error_code&ec)const{
+    ec=boost::system::error_code();
+    if(n<MAXHDR)return false;
+    unsigned char const*p{reinterpret_cast<unsigned char const*>(hdr)};
+    std::size_t val{(std::size_t(p[0])<<24)|(std::size_t(p[1])<<16)|(std::size_t(p[2])<<8)|std::size_t(p[3])};
+    if(val>maxlen_){
+      ec=boost::asio::error::message_size;
+      return false;
+    }
+    hdrlen=MAXHDR;
+    len=val;
+    return true;
+  }
+  // (a length which does not fit in the header is never sent - it would be truncated and corrupt the stream)
+  bool fits(std::size_t len)const{return len<=maxlen_&&len<=MAXLEN;}
+  std::string header(std::size_t len)const{
+    char hdr[MAXHDR]{static_cast<char>((len>>24)&0xff),static_cast<char>((len>>16)&0xff),static_cast<char>((len>>8)&0xff),static_cast<char>(len&0xff)};
+    return std::string(hdr,MAXHDR);
+  }
+  void trailer(std::string&)const{}
+private:
+  constexpr static std::size_t MAXLEN=0xffffffff;
+  std::size_t maxlen_;                   // max message size accepted
+};
+namespace detail{
+namespace queue_support{
+
+// create a framing object from a separator character
+// (only sep_framing uses the separator - other framings are default constructed)
+template<typename Framing>
+Framing makeFraming(char){return Framing{};}
+template<>
+inline sep_framing makeFraming<sep_framing>(char sep){return sep_framing(sep);}
+
+// deserialise an object from a buffered message
+template<typename T,typename DESER>
+T deserialise(char const*msg,std::size_t len,DESER deser){
+  return deserialiseBuffer<T>(msg,len,deser);
+}
 // deserialise an object from an fd stream
 // or wait until there is a message to read - in this case, a default cibstructed object is returned
-template<typename T,typename DESER>
-T recvwait(int fdread,std::size_t ms,boost::system::error_code&ec,bool getMsg,char sep,DESER deser){
-  T ret;                            // return value from this function (default ctor if no error)
-  std::stringstream strstrm;        // collect read chars in a stringstream
-
+// (bytes read past the end of a message are kept in 'rbuf' and are used in the next call)
+template<typename T,typename DESER,typename Framing>
+T recvwait(int fdread,fdreadbuf&rbuf,std::size_t ms,boost::system::error_code&ec,bool getMsg,Framing const&framing,DESER deser){
   // loop until we have a message (or until we timeout)
   while(true){
-    // setup to listen on fd descriptor
-    fd_set input;
-    FD_ZERO(&input);
-    FD_SET(fdread,&input);
-    int maxfd=fdread;
-
-    // setup for timeout (ones we get a message we don't timeout)
-    struct timeval tmo;
-    tmo.tv_sec=ms/1000;
-    tmo.tv_usec=(ms%1000)*1000;
-    
-    // block on select - timeout if configured
-    assert(maxfd!=-1);
-    int n=::select(++maxfd,&input,NULL,NULL,ms>0?&tmo:NULL);
-
-    // check for error
-    if(n<0){
-      ec=boost::system::error_code(errno,boost::system::get_posix_category());
+    // check if we already have a message (or part of a message if we are only waiting for a message)
+    char const*msg;
+    std::size_t len;
+    if(!getMsg&&rbuf.size()>0){
+      ec=boost::system::error_code{};
       return T{};
     }
-    // check for tmo
-    if(n==0){
-      ec=boost::asio::error::timed_out;
+    if(getMsg){
+      bool gotMsg{framing.next(rbuf,msg,len,ec)};
+      if(ec!=boost::system::error_code{})return T{};
+      if(gotMsg)return deserialise<T,DESER>(msg,len,deser);
+    }
+    // wait for data (ones we get a message we don't timeout)
+    if(!waitReady(fdread,POLLIN,ms,ec))return T{};
+
+    // if we are only checking if we have a message we are done here
+    if(!getMsg)return T{};
+
+    // read a chunk (fd is readable so we won't block even if fd is in blocking mode)
+    ssize_t stat{rbuf.fill(fdread)};
+    if(stat==0){
+      ec=boost::asio::error::eof;
       return T{};
     }
-    // check if we got some data
-    if(FD_ISSET(fdread,&input)){
-      // if we are only checking if we have a message we are done here
-      if(!getMsg){
-        ec= boost::system::error_code{};
-        return T{};
-      }
-      // read up to '\n' inclusive
-      while(true){
-        // read next character in message
-        char c;
-        ssize_t stat;
-        while((stat=::read(fdread,&c,1))==EINTR){}
-        if(stat!=1){
-          // check if we have a valid read error or simply that there are no more bytes in fd
-          if(errno==EWOULDBLOCK)break;
-
-          // we have a real read error
-          ec=boost::system::error_code(errno,boost::system::get_posix_category());
-          return T{};
-        }
-        // save character just read
-        strstrm<<c;
-
-        // if we reached newline, send message including newline)
-        if(c==sep)return deser(strstrm);
-      }
+    if(stat<0&&errno!=EWOULDBLOCK&&errno!=EAGAIN){
+      ec=boost::system::error_code(errno,boost::system::get_posix_category());
+      return T{};
     }
     // restet tmo 0 zero ms since we don't timeout ones we start reading a message
     ms=0;
@@ -87,83 +314,203 @@ T recvwait(int fdread,std::size_t ms,boost::system::error_code&ec,bool getMsg,ch
   // dummy return value - will nver get here
   return T{};
 }
-// serialise an object from an fd stream or wait until we timeout
-// (returns true we we could serialise object, false otherwise - error code will be non-zero if false)
-template<typename T,typename SERIAL>
-bool sendwait(int fdwrite,T const*t,std::size_t ms,boost::system::error_code&ec,bool sendMsg,char sep,SERIAL serial){
-  std::stringstream strstrm;        // serialised object
-
-  // serialise object and get it as a string
-  // (no need if we don't need to send object)
-  std::string str;
-  if(sendMsg){
-    serial(strstrm,*t);
-    strstrm<<sep;
-    str=strstrm.str();
-  }
-  std::string::iterator sbegin{str.begin()};
-  std::string::iterator send{str.end()};
-
-  // loop until we have written message or timed out
-  while(true){
-    // setup to listen on fd descriptor
-    fd_set output;
-    FD_ZERO(&output);
-    FD_SET(fdwrite,&output);
-    int maxfd=fdwrite;
-
-    // setup for timeout (ones we start writing a message we won't timeout)
-    struct timeval tmo;
-    tmo.tv_sec=ms/1000;
-    tmo.tv_usec=(ms%1000)*1000;
-    
-    // block on select - timeout if configured
-    assert(maxfd!=-1);
-    int n=::select(++maxfd,NULL,&output,NULL,ms>0?&tmo:NULL);
-
-    // check for error
-    if(n<0){
-      ec=boost::system::error_code(errno,boost::system::get_posix_category());
-      return false;
+// serialise an object into a string including framing
+// (if the serialised object is too large for the framing an empty string is returned and error code is set to message_size)
+template<typename T,typename SERIAL,typename Framing>
+std::string serialise(T const&t,Framing const&framing,SERIAL serial,boost::system::error_code&ec){
+  std::string ret;
+  serialiseAppend(ret,t,serial);
+  framing.trailer(ret);
+  if(!framing.fits(ret.size())){
+    ec=boost::asio::error::message_size;
+    return std::string();
+  }
+  ec=boost::system::error_code();
+  std::string const hdr{framing.header(ret.size())};
+  if(!hdr.empty())ret.insert(0,hdr);
+  return ret;
+}
+// wait until we can write to an fd or until we timeout
+// (returns true if fd is writable, false otherwise - error code will be non-zero if false)
+inline bool waitWritable(int fdwrite,std::size_t ms,boost::system::error_code&ec){
+  return waitReady(fdwrite,POLLOUT,ms,ec);
+}
+// write a set of buffers to an fd using writev()
+// (if 'sock' is true the fd is a socket and sendmsg() with MSG_NOSIGNAL is used so that writing to a socket closed by
+//  the peer gives an EPIPE error instead of raising SIGPIPE)
+// (if 'maxrec' > 0 at most 'maxrec' bytes are written in one call - used for record based sockets where each write is
+//  delivered as one record which must fit in the read buffer of the receiver)
+// (we only timeout before the first byte is written - ones we have started to write we'll never timeout)
+// (returns true if all buffers were written, false otherwise - error code will be non-zero if false)
+inline bool writeBuffers(int fdwrite,std::vector<struct iovec>&iov,std::size_t ms,boost::system::error_code&ec,bool sock=false,std::size_t maxrec=0){
+  std::size_t first{0};
+  while(first<iov.size()){
+    // wait until we can write
+    if(!waitWritable(fdwrite,ms,ec))return false;
+
+    // write as much as we can (at most IOV_MAX buffers in one call)
+    int cnt{static_cast<int>(std::min<std::size_t>(iov.size()-first,IOV_MAX))};
+
+    // limit #of bytes written (last buffer is cut temporarily)
+    std::size_t last{first+cnt-1};
+    std::size_t lastlen{iov[last].iov_len};
+    if(maxrec>0){
+      std::size_t n{0};
+      for(last=first;last<first+cnt-1&&n+iov[last].iov_len<maxrec;++last)n+=iov[last].iov_len;
+      lastlen=iov[last].iov_len;
+      iov[last].iov_len=std::min(lastlen,maxrec-n);
+      cnt=static_cast<int>(last-first+1);
+    }
+    ssize_t stat;
+    if(sock){
+      struct msghdr msg{};
+      msg.msg_iov=&iov[first];
+      msg.msg_iovlen=cnt;
+      while((stat=::sendmsg(fdwrite,&msg,MSG_NOSIGNAL))<0&&errno==EINTR){}
+    }else{
+      while((stat=::writev(fdwrite,&iov[first],cnt))<0&&errno==EINTR){}
     }
-    // check for tmo
-    if(n==0){
-      ec=boost::asio::error::timed_out;
+    iov[last].iov_len=lastlen;
+    if(stat<0){
+      // check if we have a valid write error or simply that there is not enough capacity in fd
+      if(errno==EWOULDBLOCK||errno==EAGAIN)continue;
+
+      // we have a real write error
+      ec=boost::system::error_code(errno,boost::system::get_posix_category());
       return false;
     }
-    // check if we wrote some data
-    if(FD_ISSET(fdwrite,&output)){
-      // if we are only checking if we can send a message
-      if(!sendMsg){
-        ec= boost::system::error_code{};
-        return true;
-      }
-      // write as much as we can
-      while(sbegin!=send){
-        // write next character in message
-        char c{*sbegin};
-        ssize_t stat;
-        while((stat=::write(fdwrite,&c,1))==EINTR){}
-        if(stat!=1){
-          // check if we have a valid write error or simply that there isnot eneough capacity in fd
-          if(errno==EWOULDBLOCK)break;
-
-          // we have a real write error
-          ec=boost::system::error_code(errno,boost::system::get_posix_category());
-          return false;
-        }
-        // we wrote one byte
-        ++sbegin;
-      }
+    // skip what was written
+    std::size_t nwritten{static_cast<std::size_t>(stat)};
+    while(first<iov.size()&&nwritten>=iov[first].iov_len)nwritten-=iov[first++].iov_len;
+    if(first<iov.size()){
+      iov[first].iov_base=static_cast<char*>(iov[first].iov_base)+nwritten;
+      iov[first].iov_len-=nwritten;
     }
-    // check if we are done
-    if(sbegin==send)return true;
-
-    // restet tmo 0 zero ms since we don't timeout ones we start reading a message
+    // restet tmo 0 zero ms since we don't timeout ones we start writing
     ms=0;
   }
+  ec=boost::system::error_code{};
+  return true;
 }
+// serialise an object from an fd stream or wait until we timeout
+// (returns true we we could serialise object, false otherwise - error code will be non-zero if false)
+template<typename T,typename SERIAL,typename Framing>
+bool sendwait(int fdwrite,T const*t,std::size_t ms,boost::system::error_code&ec,bool sendMsg,Framing const&framing,SERIAL serial,bool sock=false,
+              std::size_t maxrec=0){
+  // if we are only checking if we can send a message
+  if(!sendMsg)return waitWritable(fdwrite,ms,ec);
+
+  // serialise object and write it
+  std::string str{serialise(*t,framing,serial,ec)};
+  if(ec!=boost::system::error_code())return false;
+  std::vector<struct iovec>iov{{const_cast<char*>(str.data()),str.size()}};
+  return writeBuffers(fdwrite,iov,ms,ec,sock,maxrec);
 }
+// buffer for coalescing serialised messages written to an fd
+// (messages are written using writev() when the buffer is full, when the buffer has been kept too long or when flush() is called)
+// (a background thread flushes the buffer when messages have been kept too long - errors from the background thread are
+//  reported by the next call to enq() or flush())
+// (the object must be held on the heap since the background thread refers to it)
+class fdcork{
+public:
+  // ctors,assign,dtor
+  // (if 'sock' is true the fd is a socket, 'maxrec' limits the size of a write - see writeBuffers())
+  explicit fdcork(cork_options const&opts,bool sock=false,std::size_t maxrec=0):opts_(opts),sock_(sock),maxrec_(maxrec){
+    if(opts_.max_delay_us>0)thr_=std::thread([this](){run();});
+  }
+  fdcork(fdcork const&)=delete;
+  fdcork(fdcork&&)=delete;
+  fdcork&operator=(fdcork const&)=delete;
+  fdcork&operator=(fdcork&&)=delete;
+  ~fdcork(){
+    {
+      std::unique_lock<std::mutex>lock(mtx_);
+      stop_=true;
+      cond_.notify_all();
+    }
+    if(thr_.joinable())thr_.join();
+  }
+  // buffer a message to be written to fd
+  // (if the buffer is full it is flushed - 'ms' is then the timeout for starting to write)
+  bool enq(int fd,std::string&&msg,std::size_t ms,boost::system::error_code&ec){
+    std::unique_lock<std::mutex>lock(mtx_);
+    if(takeError(ec))return false;
+    fd_=fd;
+    if(msgs_.empty())deadline_=std::chrono::steady_clock::now()+std::chrono::microseconds(opts_.max_delay_us);
+    nbytes_+=msg.size();
+    msgs_.push_back(std::move(msg));
+    if(opts_.max_bytes>0&&nbytes_>=opts_.max_bytes)return flushNolock(ms,ec);
+    cond_.notify_all();
+    ec=boost::system::error_code{};
+    return true;
+  }
+  // write buffered messages
+  bool flush(boost::system::error_code&ec){
+    std::unique_lock<std::mutex>lock(mtx_);
+    if(takeError(ec))return false;
+    return flushNolock(0,ec);
+  }
+  // drop buffered messages and pending errors
+  // (must be called before the fd is closed)
+  void reset(){
+    std::unique_lock<std::mutex>lock(mtx_);
+    msgs_.clear();
+    nbytes_=0;
+    err_=boost::system::error_code{};
+    fd_=-1;
+  }
+private:
+  // write buffered messages
+  // (lock must be held when calling this function)
+  bool flushNolock(std::size_t ms,boost::system::error_code&ec){
+    ec=boost::system::error_code{};
+    if(msgs_.empty())return true;
+    std::vector<struct iovec>iov;
+    iov.reserve(msgs_.size());
+    for(auto&m:msgs_)iov.push_back({const_cast<char*>(m.data()),m.size()});
+    bool ret{writeBuffers(fd_,iov,ms,ec,sock_,maxrec_)};
+
+    // if we timed out nothing was written - keep messages
+    if(ec==boost::asio::error::timed_out)return false;
+    msgs_.clear();
+    nbytes_=0;
+    return ret;
+  }
+  // get error from background flush (clears the error)
+  // (lock must be held when calling this function)
+  bool takeError(boost::system::error_code&ec){
+    if(err_==boost::system::error_code{})return false;
+    ec=err_;
+    err_=boost::system::error_code{};
+    return true;
+  }
+  // background thread flushing messages which have been kept too long
+  void run(){
+    std::unique_lock<std::mutex>lock(mtx_);
+    while(!stop_){
+      if(msgs_.empty()){
+        cond_.wait(lock);
+        continue;
+      }
+      if(cond_.wait_until(lock,deadline_)==std::cv_status::timeout&&!msgs_.empty()&&std::chrono::steady_clock::now()>=deadline_){
+        boost::system::error_code ec;
+        if(!flushNolock(0,ec))err_=ec;
+      }
+    }
+  }
+  cork_options const opts_;                             // when to flush
+  bool const sock_;                                     // fd is a socket
+  std::size_t const maxrec_;                            // max #of bytes in one write (0: no limit)
+  std::mutex mtx_;                                      // protects state below
+  std::condition_variable cond_;                        // signalled when a message is buffered or when we stop
+  std::vector<std::string>msgs_;                        // buffered messages
+  std::size_t nbytes_=0;                                // #of buffered bytes
+  int fd_=-1;                                           // fd to write to
+  std::chrono::steady_clock::time_point deadline_;      // when buffered messages must be written
+  boost::system::error_code err_;                       // error from background flush
+  bool stop_=false;                                     // stop background thread
+  std::thread thr_;                                     // background thread
+};
 }
 }
 }
@@ -0,0 +1,192 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0.
+
+#ifndef __POLLDIR_INDEX_H__
+#define __POLLDIR_INDEX_H__
+#include "queue_support.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace boost{
+namespace asio{
+namespace detail{
+namespace queue_support{
+
+namespace fs=boost::filesystem;
+namespace ipc=boost::interprocess;
+
+// persistent head/tail index of a polldir queue directory
+// (messages are stored in files named by a zero padded sequence number - head is the oldest message, tail the next
+//  sequence number to publish - so messages are located in order without listing or stat:ing the directory)
+// (head/tail live in a memory mapped file '.polldir-index' in the queue directory shared by all processes using the queue)
+// (tail is only modified while holding the queue lock, head is advanced lock free by consumers using compare-and-swap)
+// (the index is a hint - if it is stale after a crash it is repaired when opened by probing the directory around head/tail)
+class polldir_index{
+public:
+  // ctors,assign,dtor
+  // (queue lock must be held when opening the index)
+  // (if the index does not exist it is built from the directory - files not named by sequence numbers are migrated in mtime order)
+  explicit polldir_index(fs::path const&dir):dir_(dir){
+    fs::path const path{dir/".polldir-index"};
+    bool fresh{!fs::exists(path)||fs::file_size(path)!=sizeof(layout)};
+    if(fresh){
+      std::ofstream os{path.string(),std::ofstream::binary|std::ofstream::trunc};
+      if(!os)throw std::runtime_error(std::string("asio::detail::polldir_index::polldir_index: could not create index: ")+path.string());
+      os.close();
+      fs::resize_file(path,sizeof(layout));
+    }
+    fm_=ipc::file_mapping(path.string().c_str(),ipc::read_write);
+    region_=ipc::mapped_region(fm_,ipc::read_write,0,sizeof(layout));
+    idx_=static_cast<layout*>(region_.get_address());
+    if(fresh||idx_->magic!=MAGIC)rebuild();
+    else repair();
+  }
+  polldir_index(polldir_index const&)=delete;
+  polldir_index(polldir_index&&)=delete;
+  polldir_index&operator=(polldir_index const&)=delete;
+  polldir_index&operator=(polldir_index&&)=delete;
+  ~polldir_index()=default;
+
+  // check if index is empty
+  // (drops messages already claimed from the head of the index)
+  bool empty(){
+    while(true){
+      std::uint64_t h{idx_->head.load()};
+      if(seq(h)>=idx_->tail.load())return true;
+      if(fs::exists(file(seq(h))))return false;
+      idx_->head.compare_exchange_strong(h,h+1);
+    }
+  }
+  // get #of messages in index
+  // (this is an upper bound - it counts every sequence number between head and tail, including messages claimed but not
+  //  yet dropped from the head and holes left when head was moved back for a message put back in the queue)
+  // (the bound becomes exact again once consumers have moved head past the holes)
+  std::size_t size()const{
+    std::uint64_t h{seq(idx_->head.load())};
+    std::uint64_t t{idx_->tail.load()};
+    return t>h?t-h:0;
+  }
+  // move a file into the queue as the next message
+  // (queue lock must be held when calling this function)
+  // (returns path of message in queue directory)
+  fs::path publish(fs::path const&from){
+    // skip sequence numbers left behind by a process which died between publishing a file and moving tail
+    std::uint64_t s{idx_->tail.load()};
+    while(fs::exists(file(s)))++s;
+    fs::path to{file(s)};
+    if(std::rename(from.string().c_str(),to.string().c_str())!=0){
+      throw std::runtime_error(std::string("asio::detail::polldir_index::publish: could not move file: ")+from.string()+", errno: "+strerror(errno));
+    }
+    // message is visible to consumers only after tail moves past it
+    idx_->tail.store(s+1);
+    return to;
+  }
+  // claim the oldest message by moving it into 'claimdir'
+  // (lock free - returns empty path if there are no messages)
+  fs::path claim(fs::path const&claimdir){
+    while(true){
+      std::uint64_t h{idx_->head.load()};
+      if(seq(h)>=idx_->tail.load())return fs::path();
+
+      // whether we won the message or someone else did, head moves past it
+      // (cas fails if someone else moved head or if a message was put back in the queue)
+      fs::path claimed{detail::queue_support::claim(file(seq(h)),claimdir)};
+      idx_->head.compare_exchange_strong(h,h+1);
+      if(!claimed.empty())return claimed;
+    }
+  }
+  // notify index that a file was moved back into the queue directory
+  // (queue lock must be held when calling this function)
+  // (files not named by a sequence number are published as new messages)
+  void restored(fs::path const&path){
+    std::string const name{path.filename().string()};
+    if(!isSeqName(name)){
+      publish(path);
+      return;
+    }
+    lowerHead(std::stoull(name));
+  }
+  // get path of file for sequence number
+  fs::path file(std::uint64_t s)const{
+    char buf[SEQ_DIGITS+1];
+    std::snprintf(buf,sizeof(buf),"%020llu",static_cast<unsigned long long>(s));
+    return dir_/buf;
+  }
+private:
+  // layout of index file
+  // (head: low 48 bits is sequence number of oldest message, high 16 bits is incremented whenever head is moved back -
+  //  a consumer holding a stale head value can therefore never skip a message put back in the queue)
+  struct layout{
+    std::uint64_t magic;
+    std::atomic<std::uint64_t>head;
+    std::atomic<std::uint64_t>tail;
+  };
+  static_assert(ATOMIC_LLONG_LOCK_FREE==2,"polldir_index requires lock free 64 bit atomics");
+  constexpr static std::uint64_t MAGIC=0x706f6c6c64697231ULL;
+  constexpr static std::uint64_t SEQ_MASK=(1ULL<<48)-1;
+  constexpr static std::size_t SEQ_DIGITS=20;
+
+  // get sequence number from head value
+  static std::uint64_t seq(std::uint64_t h){return h&SEQ_MASK;}
+
+  // check if a filename is a sequence number
+  static bool isSeqName(std::string const&name){
+    return name.size()==SEQ_DIGITS&&name.find_first_not_of("0123456789")==std::string::npos;
+  }
+  // move head back to 's' if 's' is before head
+  void lowerHead(std::uint64_t s){
+    std::uint64_t h{idx_->head.load()};
+    while(!idx_->head.compare_exchange_weak(h,(((h>>48)+1)<<48)|std::min(seq(h),s)));
+  }
+  // repair index after a crash
+  // (tail may be behind the last published file, head may have moved past a file put back in the queue)
+  void repair(){
+    std::uint64_t t{idx_->tail.load()};
+    while(fs::exists(file(t)))++t;
+    idx_->tail.store(t);
+    std::uint64_t s{seq(idx_->head.load())};
+    while(s>0&&fs::exists(file(s-1)))--s;
+    lowerHead(s);
+  }
+  // build index from the files in the directory
+  // (files with sequence numbers keep their position, other files are appended in mtime order)
+  void rebuild(){
+    std::uint64_t head{SEQ_MASK},tail{0};
+    std::multimap<time_t,fs::path>legacy;
+    for(fs::directory_iterator it(dir_);it!=fs::directory_iterator();++it){
+      std::string const name{it->path().filename().string()};
+      if(name.empty()||name[0]=='.'||!fs::is_regular_file(it->status()))continue;
+      if(isSeqName(name)){
+        std::uint64_t s{std::stoull(name)};
+        head=std::min(head,s);
+        tail=std::max(tail,s+1);
+      }else{
+        legacy.insert(std::make_pair(fs::last_write_time(it->path()),it->path()));
+      }
+    }
+    if(head>tail)head=tail;
+    idx_->head.store(head);
+    idx_->tail.store(tail);
+    for(auto const&f:legacy)publish(f.second);
+    idx_->magic=MAGIC;
+  }
+  // state
+  fs::path const dir_;                   // queue directory
+  ipc::file_mapping fm_;                 // index file
+  ipc::mapped_region region_;            // mapping of index file
+  layout*idx_=nullptr;                   // index in mapped memory
+};
+}
+}
+}
+}
+#endif
@@ -8,14 +8,20 @@
 #include <string>
 #include <map>
 #include <list>
+#include <vector>
 #include <iostream>
 #include <utility>
 #include <fstream>
 #include <memory>
 #include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
 #include <errno.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <boost/lexical_cast.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/uuid/uuid.hpp>
@@ -23,6 +29,7 @@
 #include <boost/uuid/uuid_io.hpp>
 #include <boost/iostreams/device/file_descriptor.hpp>
 #include <boost/iostreams/stream.hpp>
+#include "serial_support.hpp"
 
 namespace boost{
 namespace asio{
@@ -32,35 +39,138 @@ namespace queue_support{
 namespace fs=boost::filesystem;
 namespace io=boost::iostreams;
 
-namespace{
-// helper function for serialising an object
-// (lock must be held when calling this function)
+// write an object to a file using a stream serialiser
 template<typename T,typename SERIAL>
-void write(T const&t,fs::path const&dir,SERIAL serial){
-  // create a unique filename, open file for writing and serialise object to file (user defined function)
-  // (serialization function is a user supplied function - see ctor)
-  std::string const id{boost::lexical_cast<std::string>(boost::uuids::random_generator()())};
-  fs::path fullpath{dir/id};
+void writeFile(fs::path const&fullpath,T const&t,SERIAL&serial,std::true_type){
   std::ofstream os{fullpath.string(),std::ofstream::binary};
   if(!os)throw std::runtime_error(std::string("asio::detail::dirqueue_support::::write: could not open file: ")+fullpath.string());
   serial(os,t);
   os.close();
+  if(!os)throw std::runtime_error(std::string("asio::detail::dirqueue_support::::write: failed writing file: ")+fullpath.string());
 }
-// helper function for deserialising an object
-// (lock must be held when calling this function)
+// write an object to a file using a buffer serialiser
+// (object is serialised into memory and written with a single write() - no file stream is created)
+template<typename T,typename SERIAL>
+void writeFile(fs::path const&fullpath,T const&t,SERIAL&serial,std::false_type){
+  std::string buf;
+  serialiseAppend(buf,t,serial);
+  int fd;
+  while((fd=::open(fullpath.string().c_str(),O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC,0666))<0&&errno==EINTR);
+  if(fd<0)throw std::runtime_error(std::string("asio::detail::dirqueue_support::::write: could not open file: ")+fullpath.string());
+  std::size_t nwritten{0};
+  while(nwritten<buf.size()){
+    ssize_t stat{::write(fd,buf.data()+nwritten,buf.size()-nwritten)};
+    if(stat<0&&errno==EINTR)continue;
+    if(stat<0){
+      int err{errno};
+      while(::close(fd)<0&&errno==EINTR);
+      throw std::runtime_error(std::string("asio::detail::dirqueue_support::::write: failed writing file: ")+fullpath.string()+", errno: "+strerror(err));
+    }
+    nwritten+=stat;
+  }
+  if(::close(fd)<0&&errno!=EINTR){
+    throw std::runtime_error(std::string("asio::detail::dirqueue_support::::write: failed writing file: ")+fullpath.string()+", errno: "+strerror(errno));
+  }
+}
+// helper function for serialising an object
+// (the file is named '<pid>.<uuid>' and should be written to a temporary directory and then moved to the queue using 'restore')
+// (returns path to file the object was written to)
+template<typename T,typename SERIAL>
+fs::path write(T const&t,fs::path const&dir,SERIAL serial){
+  // create a unique filename, open file for writing and serialise object to file (user defined function)
+  // (serialization function is a user supplied function - see ctor)
+  std::string const id{boost::lexical_cast<std::string>(::getpid())+"."+boost::lexical_cast<std::string>(boost::uuids::random_generator()())};
+  fs::path fullpath{dir/id};
+  writeFile(fullpath,t,serial,std::integral_constant<bool,is_stream_serial<SERIAL,T>::value>());
+  return fullpath;
+}
+// read an object from a file using a stream de-serialiser
 template<typename T,typename DESER>
-T read(fs::path const&fullpath,DESER deser){
-  // open input stream, deserialize stream into an object and remove file
-  // (deserialization function is a user supplied function - see ctor)
+T readFile(fs::path const&fullpath,DESER&deser,std::false_type){
   std::ifstream is{fullpath.string(),std::ifstream::binary};
   if(!is)throw std::runtime_error(std::string("asio::detail::dirqueue_support::read: could not open file: ")+fullpath.string());
   T ret{deser(is)};
   is.close();
-  std::remove(fullpath.string().c_str());
   return ret;
 }
+// read an object from a file using a buffer de-serialiser
+// (file is read into memory and handed to the de-serialiser as a range of bytes - no file stream is created)
+template<typename T,typename DESER>
+T readFile(fs::path const&fullpath,DESER&deser,std::true_type){
+  int fd;
+  while((fd=::open(fullpath.string().c_str(),O_RDONLY|O_CLOEXEC))<0&&errno==EINTR);
+  if(fd<0)throw std::runtime_error(std::string("asio::detail::dirqueue_support::read: could not open file: ")+fullpath.string());
+  std::string buf;
+  struct stat st;
+  if(::fstat(fd,&st)==0&&st.st_size>0)buf.reserve(st.st_size);
+  char chunk[4096];
+  while(true){
+    ssize_t n{::read(fd,chunk,sizeof(chunk))};
+    if(n<0&&errno==EINTR)continue;
+    if(n<0){
+      int err{errno};
+      while(::close(fd)<0&&errno==EINTR);
+      throw std::runtime_error(std::string("asio::detail::dirqueue_support::read: failed reading file: ")+fullpath.string()+", errno: "+strerror(err));
+    }
+    if(n==0)break;
+    buf.append(chunk,n);
+  }
+  while(::close(fd)<0&&errno==EINTR);
+  return deser(buf.data(),buf.size());
+}
+// helper function for deserialising an object
+// (lock must be held when calling this function unless file has been claimed by caller)
+template<typename T,typename DESER>
+T read(fs::path const&fullpath,DESER deser,bool removeFile=true){
+  // open input stream, deserialize stream into an object and remove file
+  // (deserialization function is a user supplied function - see ctor)
+  T ret{readFile<T>(fullpath,deser,std::integral_constant<bool,is_buffer_deser<DESER>::value>())};
+  if(removeFile)std::remove(fullpath.string().c_str());
+  return ret;
+}
+// claim a file by moving it into a claim directory
+// (the claimed file is named '<pid>.<filename>' so that claims of dead processes can be recovered)
+// (returns empty path if file was claimed by someone else)
+inline fs::path claim(fs::path const&file,fs::path const&claimdir){
+  fs::path claimed{claimdir/(boost::lexical_cast<std::string>(::getpid())+"."+file.filename().string())};
+  if(std::rename(file.string().c_str(),claimed.string().c_str())==0)return claimed;
+  if(errno==ENOENT)return fs::path();
+  throw std::runtime_error(std::string("asio::detail::dirqueue_support::claim: could not claim file: ")+file.string()+", errno: "+strerror(errno));
+}
+// move a file named '<pid>.<filename>' (claimed or newly written file) into the queue directory as '<filename>'
+// (returns path to file in queue directory)
+inline fs::path restore(fs::path const&stamped,fs::path const&dir){
+  std::string name{stamped.filename().string()};
+  fs::path file{dir/name.substr(name.find('.')+1)};
+  if(std::rename(stamped.string().c_str(),file.string().c_str())!=0){
+    throw std::runtime_error(std::string("asio::detail::dirqueue_support::restore: could not move file: ")+stamped.string()+", errno: "+strerror(errno));
+  }
+  return file;
+}
+// check if the process owning a file named '<pid>.<filename>' no longer exists
+inline bool ownerDead(fs::path const&stamped){
+  pid_t pid{static_cast<pid_t>(std::strtol(stamped.filename().string().c_str(),nullptr,10))};
+  return pid<=0||(::kill(pid,0)<0&&errno==ESRCH);
+}
+// put back claimed files owned by processes which no longer exist
+// (returns paths of files put back in the queue directory)
+inline std::vector<fs::path>recoverClaims(fs::path const&claimdir,fs::path const&dir){
+  std::vector<fs::path>ret;
+  std::vector<fs::path>files{fs::directory_iterator(claimdir),fs::directory_iterator()};
+  for(auto const&f:files){
+    if(ownerDead(f))ret.push_back(restore(f,dir));
+  }
+  return ret;
+}
+// remove partially written files owned by processes which no longer exist
+inline void removeOrphans(fs::path const&tmpdir){
+  std::vector<fs::path>files{fs::directory_iterator(tmpdir),fs::directory_iterator()};
+  for(auto const&f:files){
+    if(ownerDead(f))std::remove(f.string().c_str());
+  }
+}
 // close a file descriptor
-int eclose(int fd,bool throwExcept){
+inline int eclose(int fd,bool throwExcept){
   while(close(fd)<0&&errno==EINTR);
   if(errno&&throwExcept){
     std::string err{strerror(errno)};
@@ -70,14 +180,23 @@ int eclose(int fd,bool throwExcept){
   }
   return errno;
 }
+// flush a file or directory to stable storage
+// (returns errno if failure, else 0)
+inline int esync(fs::path const&path){
+  int fd;
+  while((fd=::open(path.string().c_str(),O_RDONLY))<0&&errno==EINTR);
+  if(fd<0)return errno;
+  int ret{0};
+  if(::fsync(fd)<0)ret=errno;
+  eclose(fd,false);
+  return ret;
+}
 // set fd to non-blocking
-int setFdNonblock(int fd){
+inline int setFdNonblock(int fd){
   int flags=fcntl(fd,F_GETFL,0);
   if(fcntl(fd, F_SETFL,flags|O_NONBLOCK)<0)return errno;
   return 0;
 }
-
-}
 }
 }
 }
@@ -0,0 +1,115 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0.
+
+#ifndef __REACTOR_SUPPORT_H__
+#define __REACTOR_SUPPORT_H__
+#include "queue_support.hpp"
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <cstdint>
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <boost/asio/error.hpp>
+
+namespace boost{
+namespace asio{
+namespace detail{
+namespace queue_support{
+
+// wait until an fd is ready for 'events' (POLLIN/POLLOUT) or until we timeout
+// (if ms == 0 there is no timeout)
+// (returns true if fd is ready, false otherwise - error code will be non-zero if false)
+// (uses poll() so there is no limit on the value of the fd as there is with select())
+inline bool waitReady(int fd,short events,std::size_t ms,boost::system::error_code&ec){
+  while(true){
+    struct pollfd pfd{fd,events,0};
+    int n=::poll(&pfd,1,ms>0?static_cast<int>(ms):-1);
+
+    // check for error
+    if(n<0){
+      if(errno==EINTR)continue;
+      ec=boost::system::error_code(errno,boost::system::get_posix_category());
+      return false;
+    }
+    // check for tmo
+    if(n==0){
+      ec=boost::asio::error::timed_out;
+      return false;
+    }
+    // fd is ready (or has an error/hangup which is reported by the following read/write)
+    ec=boost::system::error_code();
+    return true;
+  }
+}
+// readiness notification for a set of fds based on epoll
+// (fds stay registered between calls to wait() - there is no per call setup and no limit on the value of an fd)
+// (the reactor is meant to be used by a single thread)
+class epoll_reactor{
+public:
+  // max #of events returned by one call to wait()
+  constexpr static std::size_t MAXEVENTS=256;
+
+  // ctors,assign,dtor
+  epoll_reactor():epfd_(::epoll_create1(EPOLL_CLOEXEC)),events_(MAXEVENTS){
+    if(epfd_<0)throw std::runtime_error(std::string("epoll_reactor::epoll_reactor: failed creating epoll fd: ")+strerror(errno));
+  }
+  epoll_reactor(epoll_reactor const&)=delete;
+  epoll_reactor(epoll_reactor&&)=delete;
+  epoll_reactor&operator=(epoll_reactor const&)=delete;
+  epoll_reactor&operator=(epoll_reactor&&)=delete;
+  ~epoll_reactor(){eclose(epfd_,false);}
+
+  // register fd for events (EPOLLIN, EPOLLOUT, ...)
+  // (returns false if fd could not be registered - error code is then set)
+  bool add(int fd,std::uint32_t events,boost::system::error_code&ec){
+    return ctl(EPOLL_CTL_ADD,fd,events,ec);
+  }
+  // change events fd is registered for
+  bool modify(int fd,std::uint32_t events,boost::system::error_code&ec){
+    return ctl(EPOLL_CTL_MOD,fd,events,ec);
+  }
+  // unregister fd
+  // (must be called before fd is closed if fd has been dup:ed)
+  void remove(int fd){
+    struct epoll_event ev{};
+    ::epoll_ctl(epfd_,EPOLL_CTL_DEL,fd,&ev);
+  }
+  // wait for events - timeout after 'ms' ms (if ms == 0 there is no timeout)
+  // (returns #of ready fds which are accessed with fd(i) and events(i), returns 0 on timeout or if interrupted)
+  // (returns -1 on error - error code is then set)
+  int wait(std::size_t ms,boost::system::error_code&ec){
+    ec=boost::system::error_code();
+    int n=::epoll_wait(epfd_,events_.data(),static_cast<int>(events_.size()),ms>0?static_cast<int>(ms):-1);
+    if(n<0){
+      if(errno==EINTR)return 0;
+      ec=boost::system::error_code(errno,boost::system::get_posix_category());
+    }
+    return n;
+  }
+  // get fd and events of i:th ready fd after wait()
+  int fd(int i)const{return events_[i].data.fd;}
+  std::uint32_t events(int i)const{return events_[i].events;}
+private:
+  // add/modify registration of fd
+  bool ctl(int op,int fd,std::uint32_t events,boost::system::error_code&ec){
+    struct epoll_event ev{};
+    ev.events=events;
+    ev.data.fd=fd;
+    if(::epoll_ctl(epfd_,op,fd,&ev)<0){
+      ec=boost::system::error_code(errno,boost::system::get_posix_category());
+      return false;
+    }
+    ec=boost::system::error_code();
+    return true;
+  }
+  int epfd_;                                     // epoll fd
+  std::vector<struct epoll_event>events_;        // events returned by last wait()
+};
+}
+}
+}
+}
+#endif
@@ -0,0 +1,102 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0.
+
+#ifndef __SERIAL_SUPPORT_H__
+#define __SERIAL_SUPPORT_H__
+#include <string>
+#include <iostream>
+#include <streambuf>
+#include <type_traits>
+#include <utility>
+
+// serialisers and de-serialisers come in two flavours:
+// (stream:  void serial(std::ostream&,T const&) and T deser(std::istream&))
+// (buffer:  void serial(std::string&,T const&) appending the serialised object to the string and
+//           T deser(char const*,std::size_t) de-serialising an object from a contiguous range of bytes)
+// (buffer serialisers avoid constructing a stream per message - the buffer is reused by the queue when possible)
+// (a serialiser callable with an std::ostream is treated as a stream serialiser - buffer serialisers must therefore
+//  take an 'std::string&' parameter, not a generic 'auto&' parameter)
+namespace boost{
+namespace asio{
+namespace detail{
+namespace queue_support{
+
+// check if a serialiser can be called with an std::ostream
+template<typename SERIAL,typename T>
+struct is_stream_serial{
+private:
+  template<typename S>static auto test(int)->decltype(std::declval<S&>()(std::declval<std::ostream&>(),std::declval<T const&>()),std::true_type());
+  template<typename>static std::false_type test(...);
+public:
+  constexpr static bool value=decltype(test<SERIAL>(0))::value;
+};
+// check if a de-serialiser can be called with a contiguous range of bytes
+template<typename DESER>
+struct is_buffer_deser{
+private:
+  template<typename D>static auto test(int)->decltype(std::declval<D&>()(std::declval<char const*>(),std::declval<std::size_t>()),std::true_type());
+  template<typename>static std::false_type test(...);
+public:
+  constexpr static bool value=decltype(test<DESER>(0))::value;
+};
+// stream buffer appending to a string
+// (used for running a stream serialiser without an intermediate std::stringstream buffer)
+class strbuf:public std::streambuf{
+public:
+  explicit strbuf(std::string&str):str_(str){}
+protected:
+  int_type overflow(int_type c)override{
+    if(!traits_type::eq_int_type(c,traits_type::eof()))str_.push_back(traits_type::to_char_type(c));
+    return traits_type::not_eof(c);
+  }
+  std::streamsize xsputn(char const*s,std::streamsize n)override{
+    str_.append(s,static_cast<std::size_t>(n));
+    return n;
+  }
+private:
+  std::string&str_;
+};
+// read only stream buffer over a range of memory
+// (used for handing a message to a de-serialiser without copying it)
+class membuf:public std::streambuf{
+public:
+  membuf(char const*begin,char const*end){
+    char*b{const_cast<char*>(begin)};
+    setg(b,b,b+(end-begin));
+  }
+};
+// append a serialised object to a string
+template<typename T,typename SERIAL>
+void serialiseAppend(std::string&out,T const&t,SERIAL&serial,std::true_type){
+  strbuf sb(out);
+  std::ostream os(&sb);
+  serial(os,t);
+}
+template<typename T,typename SERIAL>
+void serialiseAppend(std::string&out,T const&t,SERIAL&serial,std::false_type){
+  serial(out,t);
+}
+template<typename T,typename SERIAL>
+void serialiseAppend(std::string&out,T const&t,SERIAL&serial){
+  serialiseAppend(out,t,serial,std::integral_constant<bool,is_stream_serial<SERIAL,T>::value>());
+}
+// de-serialise an object from a range of bytes
+template<typename T,typename DESER>
+T deserialiseBuffer(char const*msg,std::size_t len,DESER&deser,std::true_type){
+  return deser(msg,len);
+}
+template<typename T,typename DESER>
+T deserialiseBuffer(char const*msg,std::size_t len,DESER&deser,std::false_type){
+  membuf mb(msg,msg+len);
+  std::istream is(&mb);
+  return deser(is);
+}
+template<typename T,typename DESER>
+T deserialiseBuffer(char const*msg,std::size_t len,DESER&deser){
+  return deserialiseBuffer<T>(msg,len,deser,std::integral_constant<bool,is_buffer_deser<DESER>::value>());
+}
+}
+}
+}
+}
+#endif
@@ -4,7 +4,10 @@
 #ifndef __FSOCK_QUEUE_SUPPPORT_H__
 #define __FSOCK_QUEUE_SUPPPORT_H__
 // support functions
-#include "sockqueue_support.hpp"
+#include "queue_support.hpp"
+#include "fdqueue_support.hpp"
+#include "reactor_support.hpp"
+#include "uring_support.hpp"
 
 // standard and boost stuff
 #include <atomic>
@@ -14,14 +17,22 @@
 #include <vector>
 #include <stdexcept>
 #include <unordered_map>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <cstddef>
 #include <unistd.h>
-#include <sys/select.h>
 #include <boost/asio/error.hpp>
 
 // socket stuff
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 
 // boost stuff
 #include <boost/lexical_cast.hpp>
@@ -29,187 +40,514 @@
 
 namespace boost{
 namespace asio{
+
+// socket tuning options for socket queues
+// (options are set on listening sockets, on accepted sockets and on client sockets before they connect)
+// (a 0/false value leaves the system default in place)
+// (TCP_QUICKACK is not sticky in linux - the kernel may fall back to delayed acks after the socket has been set up)
+struct socket_options{
+  bool nodelay=false;                    // TCP_NODELAY - disable Nagle
+  bool quickack=false;                   // TCP_QUICKACK - disable delayed acks
+  int sndbuf=0;                          // SO_SNDBUF - size in bytes of send buffer
+  int rcvbuf=0;                          // SO_RCVBUF - size in bytes of receive buffer
+  int busy_poll_us=0;                    // SO_BUSY_POLL - us to busy poll device queue on blocking reads
+  bool keepalive=false;                  // SO_KEEPALIVE - send keepalive probes
+  int keepidle_s=0;                      // TCP_KEEPIDLE - idle time in seconds before first probe
+  int keepintvl_s=0;                     // TCP_KEEPINTVL - seconds between probes
+  int keepcnt=0;                         // TCP_KEEPCNT - #of unanswered probes before connection is dropped
+  io_engine engine=io_engine::epoll;     // engine used by sockdeq_serv_queue reactors reading from clients (see io_engine)
+};
+// endpoint of a unix domain socket queue (same host only)
+// (path is the file system path of the socket - a server removes a stale socket file before binding and removes
+//  the socket file when it is destroyed)
+// (if seqpacket is true SOCK_SEQPACKET is used instead of SOCK_STREAM - messages are framed as for stream sockets, but
+//  each write is delivered as one record which must fit in the read chunk of the receiving queue (64KB))
+struct unix_endpoint{
+  std::string path;                      // path of socket file
+  bool seqpacket=false;                  // use SOCK_SEQPACKET
+};
 namespace detail{
 namespace sockqueue_support{
 
-namespace{
+// address of a server
+struct sockaddr_entry{
+  struct sockaddr_storage addr;          // address (IPv4, IPv6 or unix domain)
+  socklen_t len;                         // size of address
+  int family;                            // address family
+  int type;                              // socket type
+};
+// process wide cache of resolved server addresses
+// (names are resolved with getaddrinfo() which is thread safe - resolved addresses are kept for 'ttl_ms' ms and
+//  dropped early with invalidate() when connecting to the addresses fails so a moved server is found again)
+class resolver_cache{
+public:
+  // time resolved addresses are kept
+  constexpr static std::size_t TTL_MS=60000;
+
+  // get cache
+  static resolver_cache&instance(){
+    static resolver_cache cache;
+    return cache;
+  }
+  // resolve host/port
+  // (returns empty vector if name could not be resolved - error code is then set)
+  std::vector<sockaddr_entry>resolve(std::string const&host,int port,boost::system::error_code&ec){
+    std::string const key{host+":"+boost::lexical_cast<std::string>(port)};
+    auto now=std::chrono::steady_clock::now();
+    {
+      std::unique_lock<std::mutex>lock(mtx_);
+      auto it=cache_.find(key);
+      if(it!=cache_.end()&&it->second.expires>now){
+        ec=boost::system::error_code();
+        return it->second.addrs;
+      }
+    }
+    // resolve without holding lock (getaddrinfo() may block)
+    struct addrinfo hints{};
+    hints.ai_family=AF_UNSPEC;
+    hints.ai_socktype=SOCK_STREAM;
+    struct addrinfo*res{nullptr};
+    int stat{::getaddrinfo(host.c_str(),boost::lexical_cast<std::string>(port).c_str(),&hints,&res)};
+    if(stat!=0){
+      ec=boost::asio::error::host_not_found;
+      return std::vector<sockaddr_entry>();
+    }
+    std::vector<sockaddr_entry>addrs;
+    for(struct addrinfo*ai=res;ai!=nullptr;ai=ai->ai_next){
+      sockaddr_entry e{};
+      memcpy(&e.addr,ai->ai_addr,ai->ai_addrlen);
+      e.len=ai->ai_addrlen;
+      e.family=ai->ai_family;
+      e.type=SOCK_STREAM;
+      addrs.push_back(e);
+    }
+    ::freeaddrinfo(res);
+    std::unique_lock<std::mutex>lock(mtx_);
+    cache_[key]=entry{addrs,now+std::chrono::milliseconds(static_cast<long long>(TTL_MS))};
+    ec=boost::system::error_code();
+    return addrs;
+  }
+  // drop cached addresses for host/port
+  void invalidate(std::string const&host,int port){
+    std::unique_lock<std::mutex>lock(mtx_);
+    cache_.erase(host+":"+boost::lexical_cast<std::string>(port));
+  }
+private:
+  struct entry{
+    std::vector<sockaddr_entry>addrs;                    // resolved addresses
+    std::chrono::steady_clock::time_point expires;       // when addresses must be resolved again
+  };
+  resolver_cache()=default;
+  std::mutex mtx_;                                       // protects cache
+  std::map<std::string,entry>cache_;                     // 'host:port' --> addresses
+};
 
+// set an int valued socket option (returns false if failure - error code is then set)
+inline bool setIntSockopt(int fd,int level,int name,int val,boost::system::error_code&ec){
+  if(::setsockopt(fd,level,name,&val,sizeof(val))==-1){
+    ec=boost::system::error_code(errno,boost::system::get_posix_category());
+    return false;
+  }
+  return true;
+}
+// apply socket options to a socket (returns false if failure - error code is then set)
+// (TCP level options are only set on TCP sockets)
+inline bool applySocketOptions(int fd,socket_options const&opts,boost::system::error_code&ec){
+  ec=boost::system::error_code();
+  if(opts.sndbuf>0&&!setIntSockopt(fd,SOL_SOCKET,SO_SNDBUF,opts.sndbuf,ec))return false;
+  if(opts.rcvbuf>0&&!setIntSockopt(fd,SOL_SOCKET,SO_RCVBUF,opts.rcvbuf,ec))return false;
+  if(opts.busy_poll_us>0&&!setIntSockopt(fd,SOL_SOCKET,SO_BUSY_POLL,opts.busy_poll_us,ec))return false;
+  if(opts.keepalive&&!setIntSockopt(fd,SOL_SOCKET,SO_KEEPALIVE,1,ec))return false;
+
+  // check if this is a TCP socket
+  int protocol{0};
+  socklen_t len{sizeof(protocol)};
+  if(::getsockopt(fd,SOL_SOCKET,SO_PROTOCOL,&protocol,&len)==-1){
+    ec=boost::system::error_code(errno,boost::system::get_posix_category());
+    return false;
+  }
+  if(protocol!=IPPROTO_TCP)return true;
+  if(opts.nodelay&&!setIntSockopt(fd,IPPROTO_TCP,TCP_NODELAY,1,ec))return false;
+  if(opts.quickack&&!setIntSockopt(fd,IPPROTO_TCP,TCP_QUICKACK,1,ec))return false;
+  if(opts.keepalive){
+    if(opts.keepidle_s>0&&!setIntSockopt(fd,IPPROTO_TCP,TCP_KEEPIDLE,opts.keepidle_s,ec))return false;
+    if(opts.keepintvl_s>0&&!setIntSockopt(fd,IPPROTO_TCP,TCP_KEEPINTVL,opts.keepintvl_s,ec))return false;
+    if(opts.keepcnt>0&&!setIntSockopt(fd,IPPROTO_TCP,TCP_KEEPCNT,opts.keepcnt,ec))return false;
+  }
+  return true;
+}
 // create listen socket (throws exception if failure)
+// (if reuseport is true, SO_REUSEPORT is set so that several sockets can listen on the same port - the kernel then
+//  distributes incoming connections across the sockets)
+// (socket options are set before the socket starts listening so that buffer sizes are inherited by accepted sockets)
 // (returns server socket)
-int createListenSocket(int port,struct sockaddr_in&serveraddr,std::size_t maxclients,int*yes){
+inline int createListenSocket(int port,struct sockaddr_in&serveraddr,std::size_t maxclients,socket_options const&opts,bool reuseport=false){
   // get socket to listen on
   int ret{-1};
   if((ret=socket(AF_INET,SOCK_STREAM,0))==-1){
     throw std::runtime_error(std::string("createListenSocket: failed creating listening socket, errno: ")+boost::lexical_cast<std::string>(errno));
   }
+  // close socket and throw exception
+  auto fail=[&](std::string const&what){
+    int err{errno};
+    detail::queue_support::eclose(ret,false);
+    throw std::runtime_error(std::string("createListenSocket: ")+what+", errno: "+boost::lexical_cast<std::string>(err));
+  };
   // set socket options for listning socket
-  if(setsockopt(ret,SOL_SOCKET,SO_REUSEADDR,&yes,sizeof(int))==-1){
-    throw std::runtime_error(std::string("createListenSocket: failed setting socket options, errno: ")+boost::lexical_cast<std::string>(errno));
-  }
+  boost::system::error_code ec;
+  if(!setIntSockopt(ret,SOL_SOCKET,SO_REUSEADDR,1,ec))fail("failed setting socket options");
+  if(reuseport&&!setIntSockopt(ret,SOL_SOCKET,SO_REUSEPORT,1,ec))fail("failed setting SO_REUSEPORT");
+  if(!applySocketOptions(ret,opts,ec))fail("failed setting socket options");
+
   // bind adddr/socket
   serveraddr.sin_family=AF_INET;
   serveraddr.sin_addr.s_addr=INADDR_ANY;
   serveraddr.sin_port=htons(port);
   memset(&(serveraddr.sin_zero),'\0',8);
-  if(bind(ret,(struct sockaddr*)&serveraddr,sizeof(serveraddr))==-1){
-    throw std::runtime_error(std::string("createListenSocket: failed binding socket to address, errno: ")+boost::lexical_cast<std::string>(errno));
-  }
+  if(bind(ret,(struct sockaddr*)&serveraddr,sizeof(serveraddr))==-1)fail("failed binding socket to address");
+
   // start listening on socket
-  if(listen(ret,maxclients)==-1){
-    throw std::runtime_error(std::string("createListenSocket: failed listening on socket, errno: ")+boost::lexical_cast<std::string>(errno));
-  }
+  if(listen(ret,maxclients)==-1)fail("failed listening on socket");
+
   // return server socket
   return ret;
 }
-// wait until a client connects and acept connection
-// (if ms == 0, no timeout, we must be in state IDLE when being called0
-int waitForClientConnect(int servsocket,struct sockaddr_in&serveraddr,struct sockaddr_in&clientaddr,std::size_t ms,boost::system::error_code&ec){
+// get address of a unix domain socket (throws exception if failure)
+inline sockaddr_entry unixAddress(unix_endpoint const&ep){
+  sockaddr_entry ret{};
+  struct sockaddr_un*addr{reinterpret_cast<struct sockaddr_un*>(&ret.addr)};
+  if(ep.path.empty()||ep.path.size()>=sizeof(addr->sun_path)){
+    throw std::runtime_error(std::string("unixAddress: invalid unix domain socket path: \"")+ep.path+"\"");
+  }
+  addr->sun_family=AF_UNIX;
+  memcpy(addr->sun_path,ep.path.c_str(),ep.path.size()+1);
+  ret.len=offsetof(struct sockaddr_un,sun_path)+ep.path.size()+1;
+  ret.family=AF_UNIX;
+  ret.type=ep.seqpacket?SOCK_SEQPACKET:SOCK_STREAM;
+  return ret;
+}
+// create unix domain listen socket (throws exception if failure)
+// (a stale socket file left by a server which did not terminate cleanly is removed - other files are left alone)
+// (returns server socket)
+inline int createUnixListenSocket(unix_endpoint const&ep,std::size_t maxclients,socket_options const&opts){
+  sockaddr_entry addr{unixAddress(ep)};
   int ret{-1};
+  if((ret=socket(AF_UNIX,addr.type|SOCK_CLOEXEC,0))==-1){
+    throw std::runtime_error(std::string("createUnixListenSocket: failed creating listening socket, errno: ")+boost::lexical_cast<std::string>(errno));
+  }
+  // close socket and throw exception
+  auto fail=[&](std::string const&what){
+    int err{errno};
+    detail::queue_support::eclose(ret,false);
+    throw std::runtime_error(std::string("createUnixListenSocket: ")+what+", errno: "+boost::lexical_cast<std::string>(err));
+  };
+  boost::system::error_code ec;
+  if(!applySocketOptions(ret,opts,ec))fail("failed setting socket options");
 
-  // setup to listen on server file descriptor
-  fd_set input;
-  FD_ZERO(&input);
-  FD_SET(servsocket,&input);
-  int maxfd=servsocket;
-
-  // setup for timeout (ones we get a message we don't timeout)
-  struct timeval tmo;
-  tmo.tv_sec=ms/1000;
-  tmo.tv_usec=(ms%1000)*1000;
-      
-  // block on select - timeout if configured
-  assert(maxfd!=-1);
-  int n=::select(++maxfd,&input,NULL,NULL,ms>0?&tmo:NULL);
-
-  // error
-  if(n<0){
+  // remove stale socket file, bind and start listening
+  struct stat st;
+  if(::lstat(ep.path.c_str(),&st)==0&&S_ISSOCK(st.st_mode))::unlink(ep.path.c_str());
+  if(bind(ret,reinterpret_cast<struct sockaddr const*>(&addr.addr),addr.len)==-1)fail("failed binding socket to "+ep.path);
+  if(listen(ret,maxclients)==-1)fail("failed listening on socket");
+  return ret;
+}
+// check if a socket is record based (SOCK_SEQPACKET)
+inline bool isRecordSocket(int fd){
+  int type{0};
+  socklen_t len{sizeof(type)};
+  return ::getsockopt(fd,SOL_SOCKET,SO_TYPE,&type,&len)==0&&type==SOCK_SEQPACKET;
+}
+// connect a new non-blocking socket to an address - timeout after 'ms' ms (if ms == 0 there is no timeout)
+// (returns connected socket or -1 if the connection failed - error code is then set)
+inline int connectSocket(sockaddr_entry const&addr,socket_options const&opts,std::size_t ms,boost::system::error_code&ec){
+  int fd{::socket(addr.family,addr.type|SOCK_NONBLOCK|SOCK_CLOEXEC,0)};
+  if(fd<0){
     ec=boost::system::error_code(errno,boost::system::get_posix_category());
-    return ret;
+    return -1;
   }
-  // tmo
-  if(n==0){
-    ec=boost::asio::error::timed_out;
-    return ret;
+  if(!applySocketOptions(fd,opts,ec)){
+    detail::queue_support::eclose(fd,false);
+    return -1;
+  }
+  int stat;
+  while((stat=::connect(fd,reinterpret_cast<struct sockaddr const*>(&addr.addr),addr.len))<0&&errno==EINTR){}
+  if(stat<0&&errno!=EINPROGRESS){
+    ec=boost::system::error_code(errno,boost::system::get_posix_category());
+    detail::queue_support::eclose(fd,false);
+    return -1;
+  }
+  // wait for connection to complete and check result
+  if(stat<0){
+    if(!detail::queue_support::waitReady(fd,POLLOUT,ms,ec)){
+      detail::queue_support::eclose(fd,false);
+      return -1;
+    }
+    int err{0};
+    socklen_t len{sizeof(err)};
+    if(::getsockopt(fd,SOL_SOCKET,SO_ERROR,&err,&len)<0)err=errno;
+    if(err!=0){
+      ec=boost::system::error_code(err,boost::system::get_posix_category());
+      detail::queue_support::eclose(fd,false);
+      return -1;
+    }
   }
+  ec=boost::system::error_code();
+  return fd;
+}
+// wait until a client connects and acept connection
+// (if ms == 0, no timeout, we must be in state IDLE when being called0
+inline int waitForClientConnect(int servsocket,struct sockaddr_in&serveraddr,struct sockaddr_storage&clientaddr,socket_options const&opts,std::size_t ms,
+                         boost::system::error_code&ec){
+  int ret{-1};
+
+  // wait for a client to connect - timeout if configured
+  if(!detail::queue_support::waitReady(servsocket,POLLIN,ms,ec))return ret;
+
   // client connected
-  unsigned int addrlen;
+  socklen_t addrlen{sizeof(clientaddr)};
   if((ret=::accept(servsocket,(struct sockaddr*)&clientaddr,&addrlen)) == -1){
     ec=boost::system::error_code(errno,boost::system::get_posix_category());
     return ret;
   }
+  // set socket options on client socket
+  if(!applySocketOptions(ret,opts,ec)){
+    detail::queue_support::eclose(ret,false);
+    return -1;
+  }
   // no errors - client is now connected, return client socket
   ec=boost::system::error_code();
   return ret;
 }
-// read data and accept client connections in a select loop
-template<typename F>
-void acceptClientsAndDequeue(int servsocket,char sep,std::size_t tmoPollMs,std::atomic<bool>&stop_server,F fcallback){
+#if defined(IORING_RECV_MULTISHOT)&&defined(__NR_io_uring_setup)
+// read data and accept client connections in an io_uring event loop
+// (clients are accepted with a multishot accept and read with one multishot receive per client - the kernel reads into
+//  buffers picked from a registered buffer ring and the loop copies the bytes into the read buffer of the client)
+// (requests (re)armed while handling completions are submitted by the io_uring_enter() call waiting for the next completions)
+// (while the callback blocks the kernel keeps receiving until the buffer ring is used up - reading then stops until the
+//  loop hands buffers back, so senders are still pushed back on)
+// (a client is closed when its receive has terminated so a closed fd is never reused while a request on it is outstanding)
+// (see acceptClientsAndDequeue)
+template<typename Framing,typename F>
+void acceptClientsAndDequeueUring(int servsocket,Framing const&framing,socket_options const&opts,std::size_t tmoPollMs,std::atomic<bool>&stop_server,F fcallback){
+  // size of rings and buffers
+  constexpr unsigned ENTRIES=256;
+  constexpr unsigned NBUFS=128;
+  constexpr std::size_t BUFSIZE=16*1024;
+  constexpr unsigned short BGID=0;
+
+  // request kinds (kind is stored in the high 32 bits and the fd in the low 32 bits of the user data of a request)
+  constexpr std::uint64_t ACCEPT=1;
+  constexpr std::uint64_t RECV=2;
+
+  // client state
+  // (closing is set when the client is shut down - the fd is closed when its receive terminates)
+  struct client{
+    detail::queue_support::fdreadbuf buf;
+    bool closing=false;
+  };
+  std::unordered_map<int,client>client_data;
+  std::vector<std::pair<char const*,std::size_t>>msgs;
+
+  detail::queue_support::uring ring(ENTRIES);
+  ring.registerBuffers(BGID,NBUFS,BUFSIZE);
+
+  // queue requests
+  // (if a request cannot be queued the error is kept in 'armerr' and the loop fails once completions have been handled)
+  boost::system::error_code armerr;
+  auto armAccept=[&](){
+    struct io_uring_sqe*sqe{ring.sqe(armerr)};
+    if(sqe==nullptr)return;
+    sqe->opcode=IORING_OP_ACCEPT;
+    sqe->fd=servsocket;
+    sqe->ioprio=IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags=SOCK_CLOEXEC;
+    sqe->user_data=ACCEPT<<32|static_cast<std::uint32_t>(servsocket);
+  };
+  auto armRecv=[&](int fd){
+    struct io_uring_sqe*sqe{ring.sqe(armerr)};
+    if(sqe==nullptr)return;
+    sqe->opcode=IORING_OP_RECV;
+    sqe->fd=fd;
+    sqe->ioprio=IORING_RECV_MULTISHOT;
+    sqe->flags=IOSQE_BUFFER_SELECT;
+    sqe->buf_group=BGID;
+    sqe->user_data=RECV<<32|static_cast<std::uint32_t>(fd);
+  };
+  // handle a completion
+  boost::system::error_code ec;
+  auto complete=[&](struct io_uring_cqe const&cqe){
+    std::uint64_t kind{cqe.user_data>>32};
+    int fd{static_cast<int>(cqe.user_data&0xffffffff)};
+    bool more{(cqe.flags&IORING_CQE_F_MORE)!=0};
+
+    // client connecting
+    // (a failed accept is ignored - the multishot accept is re-armed if it terminated)
+    if(kind==ACCEPT){
+      if(cqe.res>=0){
+        int client_fd{cqe.res};
+        if(!applySocketOptions(client_fd,opts,ec)){
+          detail::queue_support::eclose(client_fd,false);
+        }else{
+          client_data[client_fd];
+          armRecv(client_fd);
+        }
+      }
+      if(!more)armAccept();
+      return;
+    }
+    // data on client connection
+    // (the buffer holding the data is handed back to the kernel once we have copied the data)
+    bool hasbuf{(cqe.flags&IORING_CQE_F_BUFFER)!=0};
+    unsigned short bid{static_cast<unsigned short>(cqe.flags>>IORING_CQE_BUFFER_SHIFT)};
+    auto it=client_data.find(fd);
+    if(it==client_data.end()){
+      if(hasbuf)ring.recycle(bid);
+      return;
+    }
+    client&c(it->second);
+    if(hasbuf){
+      if(cqe.res>0&&!c.closing){
+        c.buf.append(ring.buffer(bid),static_cast<std::size_t>(cqe.res));
+
+        // hand all complete messages we have read to callback in one batch
+        char const*msg;
+        std::size_t len;
+        msgs.clear();
+        while(framing.next(c.buf,msg,len,ec))msgs.emplace_back(msg,len);
+        if(!msgs.empty())fcallback(msgs);
+        if(ec!=boost::system::error_code()){
+          // invalid frame - shut down client, the receive then terminates
+          ::shutdown(fd,SHUT_RDWR);
+          c.closing=true;
+        }
+      }
+      ring.recycle(bid);
+    }
+    // receive terminated
+    // (end of file, error or shut down - close client, otherwise we ran out of buffers - re-arm receive)
+    if(!more){
+      if(c.closing||cqe.res==0||(cqe.res<0&&cqe.res!=-ENOBUFS)){
+        detail::queue_support::eclose(fd,false);
+        client_data.erase(it);
+      }else{
+        armRecv(fd);
+      }
+    }
+  };
+  // close clients and throw exception
+  auto fail=[&](boost::system::error_code const&err){
+    for(auto const&p:client_data)detail::queue_support::eclose(p.first,false);
+    throw std::runtime_error(std::string("acceptClientsAndDequeueUring: ")+err.message());
+  };
+  // loop until server 'stop_server' flag is set
+  // (wake up every 'tmoPollMs' to check if we should stop)
+  // (a request which could not be queued would leave the listening socket or a client without a request - we fail)
+  armAccept();
+  while(!stop_server.load()){
+    if(armerr!=boost::system::error_code())fail(armerr);
+    if(!ring.enter(1,tmoPollMs,ec))fail(ec);
+    ring.completions(complete);
+    ring.publishBuffers();
+  }
+  // close all client fds
+  // (outstanding requests are cancelled when the ring is destroyed)
+  for(auto const&p:client_data){
+    detail::queue_support::eclose(p.first,false);
+  }
+}
+#endif
+// read data and accept client connections in an event loop
+// (client fds are registered ones with an epoll reactor so the loop scales to a large number of clients)
+// (clients sending data which is not a valid frame are disconnected)
+// (complete messages read in one go from a client are handed to the callback as a batch of byte ranges:
+//  fcallback(std::vector<std::pair<char const*,std::size_t>>const&msgs))
+// (with opts.engine == io_engine::uring the io_uring event loop is used if the kernel supports it - record based
+//  sockets always use the epoll loop since a multishot receive cannot report a truncated record)
+template<typename Framing,typename F>
+void acceptClientsAndDequeue(int servsocket,Framing const&framing,socket_options const&opts,std::size_t tmoPollMs,std::atomic<bool>&stop_server,F fcallback){
+#if defined(IORING_RECV_MULTISHOT)&&defined(__NR_io_uring_setup)
+  if(opts.engine==io_engine::uring&&!isRecordSocket(servsocket)&&detail::queue_support::uringSupported()){
+    acceptClientsAndDequeueUring(servsocket,framing,opts,tmoPollMs,stop_server,fcallback);
+    return;
+  }
+#endif
   // data structures tracking client fds and correpsonding data
-  std::unordered_map<int,std::vector<char>>client_data;
+  // (each client has its own buffer holding bytes not yet part of a complete message)
+  std::unordered_map<int,detail::queue_support::fdreadbuf>client_data;
+  std::vector<std::pair<char const*,std::size_t>>msgs;
+  bool const records{isRecordSocket(servsocket)};
 
+  // listen for clients connecting
+  detail::queue_support::epoll_reactor reactor;
+  boost::system::error_code ec;
+  if(!reactor.add(servsocket,EPOLLIN,ec)){
+    throw std::runtime_error(std::string("acceptClientsAndDequeue: ")+ec.message());
+  }
+  // close a client connection
+  auto disconnect=[&](int client_fd){
+    reactor.remove(client_fd);
+    detail::queue_support::eclose(client_fd,false);
+    client_data.erase(client_fd);
+    //BOOST_LOG_TRIVIAL(trace)<<"acceptClientsAndDequeue: client socket ("<<client_fd<<") disconnected ...";
+  };
   // loop until server 'stop_server' flag is set
+  // (wake up every 'tmoPollMs' to check if we should stop)
   while(!stop_server.load()){
-    // setup to listen on server descriptor
-    fd_set input;
-    FD_ZERO(&input);
-    FD_SET(servsocket,&input);
-    int maxfd=servsocket;
-
-    // setup to listen on client fds
-    for(auto const&p:client_data){
-      FD_SET(p.first,&input);
-      maxfd=std::max(maxfd,p.first);
-    }
-    // setup poll intervall to check if we should stop select loop
-    struct timeval tmo;
-    tmo.tv_sec=tmoPollMs/1000;
-    tmo.tv_usec=(tmoPollMs%1000)*1000;
-    
-    // block on select - timeout if configured
-    assert(maxfd!=-1);
-    int n=::select(++maxfd,&input,NULL,NULL,&tmo);
+    int n=reactor.wait(tmoPollMs,ec);
 
     // check for error
     if(n<0){
-      throw std::runtime_error(std::string("acceptClientsAndDequeue: ")+std::strerror(errno));
+      throw std::runtime_error(std::string("acceptClientsAndDequeue: ")+ec.message());
     }
-    // check for tmo
-    if(n==0){
-      //BOOST_LOG_TRIVIAL(trace)<<"acceptClientsAndDequeue: <tmo>";
-      continue;
-    }
-    // check for client connecting
-    if(FD_ISSET(servsocket,&input)){
-      // accept client connection
-      // (if failure - continue)
-      unsigned int addrlen;
-      struct sockaddr_in clientaddr;
-      int client_fd;
-      if((client_fd=::accept(servsocket,(struct sockaddr*)&clientaddr,&addrlen))==-1){
-        //BOOST_LOG_TRIVIAL(trace)<<"acceptClientsAndDequeue: failed accept()ing client connection: "<<std::strerror(errno);
+    for(int i=0;i<n;++i){
+      int fd{reactor.fd(i)};
+
+      // check for client connecting
+      if(fd==servsocket){
+        // accept client connection
+        // (if failure - continue)
+        socklen_t addrlen{sizeof(struct sockaddr_storage)};
+        struct sockaddr_storage clientaddr;
+        int client_fd;
+        if((client_fd=::accept(servsocket,(struct sockaddr*)&clientaddr,&addrlen))==-1){
+          //BOOST_LOG_TRIVIAL(trace)<<"acceptClientsAndDequeue: failed accept()ing client connection: "<<std::strerror(errno);
+          continue;
+        }
+        // set client fd to non blocking, set socket options and register it with reactor
+        if(detail::queue_support::setFdNonblock(client_fd)!=0||!applySocketOptions(client_fd,opts,ec)||!reactor.add(client_fd,EPOLLIN,ec)){
+          //BOOST_LOG_TRIVIAL(error)<<"acceptClientsAndDequeue: failed setting up client socket ("<<client_fd<<")";
+          detail::queue_support::eclose(client_fd,false);
+          continue;
+        }
+        // add client connection to active clients
+        //BOOST_LOG_TRIVIAL(trace)<<"acceptClientsAndDequeue: client socket ("<<client_fd<<") connected ...";
+        auto it=client_data.insert(std::make_pair(client_fd,detail::queue_support::fdreadbuf{})).first;
+        it->second.records(records);
         continue;
       }
-      // set client fd to non blocking
-      auto err=detail::queue_support::setFdNonblock(client_fd);
-      if(err!=0){
-        //BOOST_LOG_TRIVIAL(error)<<"acceptClientsAndDequeue: failed setting client socket ("<<client_fd<<") to non-blocking mode: "<<std::strerror(errno);
-        detail::queue_support::eclose(client_fd,false);
+      // data on existing client connection
+      auto it=client_data.find(fd);
+      if(it==client_data.end())continue;
+      auto&buf(it->second);
+
+      // read a chunk from client fd
+      // (if we get end of file or a read error we have lost the client connection - remove client fd and close it)
+      ssize_t stat{buf.fill(fd)};
+      if(stat==0||(stat<0&&errno!=EWOULDBLOCK&&errno!=EAGAIN)){
+        disconnect(fd);
         continue;
       }
-      // add client connection to active clients
-      //BOOST_LOG_TRIVIAL(trace)<<"acceptClientsAndDequeue: client socket ("<<client_fd<<") connected ...";
-      client_data.insert(std::make_pair(client_fd,std::vector<char>{}));
-    }
-    // check for data on existing client connection
-    std::vector<int>fd2erase;
-    for(auto&p:client_data){
-      int client_fd(p.first);
-      auto&buf(p.second);
-
-      // if no activity on this fd, skip it
-      if(!FD_ISSET(client_fd,&input))continue;
-
-      // read as much as we can from client_fd
-      // (create objects as we read)
-      bool firstTime{true};
-      while(true){
-        // read next character in message
-        char c;
-        ssize_t stat;
-        while((stat=::read(client_fd,&c,1))==EINTR){}
-
-        // check if there is nothing more to read
-        // (if we have already read characters and we get a read error we'll continue to track the client_fd)
-        if(!firstTime&&stat!=1){
-          break;
-        }
-        // we lost client connection
-        if(stat!=1){
-          // we have a real read error - remove client fd and close it
-          // (no need to check for EWOULDBLOCK since we'll never block on client_fd)
-          detail::queue_support::eclose(client_fd,false);
-          fd2erase.push_back(client_fd);
-          //BOOST_LOG_TRIVIAL(trace)<<"acceptClientsAndDequeue: client socket ("<<client_fd<<") disconnected ...";
-          break;
-        }
-        // save character just read and remember that we have read at least one character from client_fd this time around
-        buf.push_back(c);
-        firstTime=false;
-
-        // if we reached sep deserialise data into an object and save
-        if(c==sep){
-          //BOOST_LOG_TRIVIAL(trace)<<"acceptClientsAndDequeue: received queue item from client socket ("<<client_fd<<")";
-          // create stream and call callback function with stream
-          std::stringstream strm;
-          copy(buf.begin(),buf.end(),std::ostream_iterator<char>(strm));
-          buf.clear();
-          fcallback(strm);
-        }
+      // hand all complete messages we have read to callback in one batch
+      // (messages stay in the read buffer until the next read from the client)
+      char const*msg;
+      std::size_t len;
+      msgs.clear();
+      while(framing.next(buf,msg,len,ec)){
+        //BOOST_LOG_TRIVIAL(trace)<<"acceptClientsAndDequeue: received queue item from client socket ("<<fd<<")";
+        msgs.emplace_back(msg,len);
       }
-    }
-    // erase client fds which disconnected
-    for(int client_fd:fd2erase){
-      client_data.erase(client_fd);
+      if(!msgs.empty())fcallback(msgs);
+      if(ec!=boost::system::error_code())disconnect(fd);
     }
   }
   // close all client fds
@@ -222,5 +560,4 @@ void acceptClientsAndDequeue(int servsocket,char sep,std::size_t tmoPollMs,std::
 }
 }
 }
-}
 #endif
@@ -0,0 +1,317 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0.
+
+#ifndef __URING_SUPPORT_H__
+#define __URING_SUPPORT_H__
+#include "queue_support.hpp"
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <linux/io_uring.h>
+#include <boost/asio/error.hpp>
+
+namespace boost{
+namespace asio{
+
+// engine used by a server event loop reading from its clients
+// (epoll: wait for readiness with epoll and read with one read() per ready client)
+// (uring: read with io_uring multishot receives into a ring of registered buffers - all requests queued while handling
+//  completions are submitted by the same io_uring_enter() call that waits for the next completions)
+// (uring falls back to epoll at runtime if the kernel does not support the io_uring features used)
+// (the engine is used by the reactor threads of sockdeq_serv_queue - the other queues ignore it: fd queues and single
+//  connection socket queues wait for one fd with poll() and do one read()/write() per operation, where io_uring has nothing
+//  to batch, and the sockmserv_queue reactor also writes to its clients, which the io_uring loop does not do)
+enum class io_engine:int{epoll=0,uring=1};
+
+namespace detail{
+namespace queue_support{
+
+// (io_uring is only used if the kernel headers have multishot receives - linux 6.0 and later)
+#if defined(IORING_RECV_MULTISHOT)&&defined(__NR_io_uring_setup)
+
+// io_uring instance driven by raw system calls (liburing is not needed)
+// (one submission queue entry is used per request - requests are queued with sqe() and submitted by enter())
+// (a ring of provided buffers can be registered - the kernel picks a buffer from the ring for each multishot receive)
+// (the ring is meant to be used by a single thread)
+class uring{
+public:
+  // ctors,assign,dtor
+  // (throws exception if io_uring is not available or lacks features we need)
+  explicit uring(unsigned entries){
+    struct io_uring_params p;
+    std::memset(&p,0,sizeof(p));
+    fd_=static_cast<int>(::syscall(__NR_io_uring_setup,entries,&p));
+    if(fd_<0)throw std::runtime_error(std::string("uring::uring: io_uring_setup failed: ")+strerror(errno));
+    try{
+      if(!(p.features&IORING_FEAT_EXT_ARG))throw std::runtime_error("uring::uring: io_uring does not support timed waits");
+      map(p);
+    }
+    catch(...){
+      unmap();
+      eclose(fd_,false);
+      throw;
+    }
+  }
+  uring(uring const&)=delete;
+  uring(uring&&)=delete;
+  uring&operator=(uring const&)=delete;
+  uring&operator=(uring&&)=delete;
+  ~uring(){
+    // closing the ring cancels all outstanding requests
+    eclose(fd_,false);
+    unmap();
+  }
+  // get a cleared submission queue entry
+  // (if the submission queue is full, queued entries are submitted first)
+  // (returns nullptr if the queue is full and queued entries could not be submitted - error code is then set)
+  struct io_uring_sqe*sqe(boost::system::error_code&ec){
+    ec=boost::system::error_code();
+    if(sqFull()){
+      if(!enter(0,0,ec))return nullptr;
+      if(sqFull()){
+        ec=boost::system::error_code(EBUSY,boost::system::get_posix_category());
+        return nullptr;
+      }
+    }
+    struct io_uring_sqe*ret{&sqes_[sqtail_&sqmask_]};
+    std::memset(ret,0,sizeof(*ret));
+    sqarray_[sqtail_&sqmask_]=sqtail_&sqmask_;
+    ++sqtail_;
+    return ret;
+  }
+  // submit queued entries and wait for at least 'waitnr' completions - timeout after 'ms' ms (if ms == 0 there is no timeout)
+  // (a timeout or an interrupt is not an error)
+  // (returns false on error - error code is then set)
+  bool enter(unsigned waitnr,std::size_t ms,boost::system::error_code&ec){
+    ec=boost::system::error_code();
+    __atomic_store_n(sqktail_,sqtail_,__ATOMIC_RELEASE);
+    unsigned nsubmit{sqtail_-__atomic_load_n(sqhead_,__ATOMIC_ACQUIRE)};
+    struct __kernel_timespec ts{static_cast<long long>(ms/1000),static_cast<long long>((ms%1000)*1000000)};
+    struct io_uring_getevents_arg arg;
+    std::memset(&arg,0,sizeof(arg));
+    arg.sigmask_sz=_NSIG/8;
+    arg.ts=reinterpret_cast<std::uint64_t>(&ts);
+    unsigned flags{(ms>0?IORING_ENTER_EXT_ARG:0u)|(waitnr>0?IORING_ENTER_GETEVENTS:0u)};
+    if(::syscall(__NR_io_uring_enter,fd_,nsubmit,waitnr,flags,ms>0?&arg:nullptr,ms>0?sizeof(arg):0)<0){
+      if(errno==ETIME||errno==EINTR||errno==EAGAIN||errno==EBUSY)return true;
+      ec=boost::system::error_code(errno,boost::system::get_posix_category());
+      return false;
+    }
+    return true;
+  }
+  // call 'f(cqe)' for each completion and mark the completions as seen
+  // (returns #of completions)
+  template<typename F>
+  unsigned completions(F f){
+    unsigned head{*cqhead_};
+    unsigned tail{__atomic_load_n(cqtail_,__ATOMIC_ACQUIRE)};
+    for(unsigned i=head;i!=tail;++i)f(cqes_[i&cqmask_]);
+    __atomic_store_n(cqhead_,tail,__ATOMIC_RELEASE);
+    return tail-head;
+  }
+  // register a ring of 'nbufs' (power of 2) buffers of 'bufsize' bytes as buffer group 'bgid'
+  // (throws exception if failure)
+  void registerBuffers(unsigned short bgid,unsigned nbufs,std::size_t bufsize){
+    bufsize_=bufsize;
+    bufmask_=nbufs-1;
+    bufmem_.resize(nbufs*bufsize);
+    bringsize_=nbufs*sizeof(struct io_uring_buf);
+    void*p{::mmap(nullptr,bringsize_,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0)};
+    if(p==MAP_FAILED)throw std::runtime_error(std::string("uring::registerBuffers: mmap failed: ")+strerror(errno));
+    bring_=static_cast<struct io_uring_buf_ring*>(p);
+    struct io_uring_buf_reg reg;
+    std::memset(&reg,0,sizeof(reg));
+    reg.ring_addr=reinterpret_cast<std::uint64_t>(bring_);
+    reg.ring_entries=nbufs;
+    reg.bgid=bgid;
+    if(::syscall(__NR_io_uring_register,fd_,IORING_REGISTER_PBUF_RING,&reg,1)<0){
+      throw std::runtime_error(std::string("uring::registerBuffers: registering buffer ring failed: ")+strerror(errno));
+    }
+    for(unsigned i=0;i<nbufs;++i)recycle(static_cast<unsigned short>(i));
+    publishBuffers();
+  }
+  // get buffer with id 'bid'
+  char const*buffer(unsigned short bid)const{return bufmem_.data()+bid*bufsize_;}
+
+  // hand buffer back to the kernel (the buffer is visible to the kernel after publishBuffers())
+  void recycle(unsigned short bid){
+    // (entries are indexed from the start of the ring - in C++ the flexible 'bufs' member of io_uring_buf_ring is
+    //  not at offset 0 since the kernel header declares it after an empty struct)
+    struct io_uring_buf&b(reinterpret_cast<struct io_uring_buf*>(bring_)[btail_&bufmask_]);
+    b.addr=reinterpret_cast<std::uint64_t>(bufmem_.data()+bid*bufsize_);
+    b.len=static_cast<std::uint32_t>(bufsize_);
+    b.bid=bid;
+    ++btail_;
+  }
+  // make recycled buffers visible to the kernel
+  void publishBuffers(){
+    __atomic_store_n(&bring_->tail,btail_,__ATOMIC_RELEASE);
+  }
+private:
+  // check if all submission queue entries are in use
+  bool sqFull()const{
+    return sqtail_-__atomic_load_n(sqhead_,__ATOMIC_ACQUIRE)>=sqentries_;
+  }
+  // map submission and completion queues
+  void map(struct io_uring_params const&p){
+    sqringsize_=p.sq_off.array+p.sq_entries*sizeof(unsigned);
+    cqringsize_=p.cq_off.cqes+p.cq_entries*sizeof(struct io_uring_cqe);
+    if(p.features&IORING_FEAT_SINGLE_MMAP)sqringsize_=cqringsize_=std::max(sqringsize_,cqringsize_);
+    sqring_=::mmap(nullptr,sqringsize_,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,fd_,IORING_OFF_SQ_RING);
+    if(sqring_==MAP_FAILED)throw std::runtime_error(std::string("uring::map: mmap failed: ")+strerror(errno));
+    if(p.features&IORING_FEAT_SINGLE_MMAP){
+      cqring_=sqring_;
+    }else{
+      cqring_=::mmap(nullptr,cqringsize_,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,fd_,IORING_OFF_CQ_RING);
+      if(cqring_==MAP_FAILED)throw std::runtime_error(std::string("uring::map: mmap failed: ")+strerror(errno));
+    }
+    sqessize_=p.sq_entries*sizeof(struct io_uring_sqe);
+    void*sqes{::mmap(nullptr,sqessize_,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,fd_,IORING_OFF_SQES)};
+    if(sqes==MAP_FAILED)throw std::runtime_error(std::string("uring::map: mmap failed: ")+strerror(errno));
+    sqes_=static_cast<struct io_uring_sqe*>(sqes);
+
+    char*sq{static_cast<char*>(sqring_)};
+    sqhead_=reinterpret_cast<unsigned*>(sq+p.sq_off.head);
+    sqktail_=reinterpret_cast<unsigned*>(sq+p.sq_off.tail);
+    sqarray_=reinterpret_cast<unsigned*>(sq+p.sq_off.array);
+    sqmask_=*reinterpret_cast<unsigned*>(sq+p.sq_off.ring_mask);
+    sqentries_=p.sq_entries;
+    sqtail_=*sqktail_;
+    char*cq{static_cast<char*>(cqring_)};
+    cqhead_=reinterpret_cast<unsigned*>(cq+p.cq_off.head);
+    cqtail_=reinterpret_cast<unsigned*>(cq+p.cq_off.tail);
+    cqes_=reinterpret_cast<struct io_uring_cqe*>(cq+p.cq_off.cqes);
+    cqmask_=*reinterpret_cast<unsigned*>(cq+p.cq_off.ring_mask);
+  }
+  // unmap everything we have mapped
+  void unmap(){
+    if(bring_!=nullptr)::munmap(bring_,bringsize_);
+    if(sqes_!=nullptr)::munmap(sqes_,sqessize_);
+    if(cqring_!=nullptr&&cqring_!=MAP_FAILED&&cqring_!=sqring_)::munmap(cqring_,cqringsize_);
+    if(sqring_!=nullptr&&sqring_!=MAP_FAILED)::munmap(sqring_,sqringsize_);
+  }
+  int fd_=-1;                                    // io_uring fd
+  void*sqring_=nullptr;                          // mapped submission queue ring
+  void*cqring_=nullptr;                          // mapped completion queue ring (same as sqring_ with single mmap)
+  std::size_t sqringsize_=0;                     // size of mapped submission queue ring
+  std::size_t cqringsize_=0;                     // size of mapped completion queue ring
+  std::size_t sqessize_=0;                       // size of mapped submission queue entries
+  struct io_uring_sqe*sqes_=nullptr;             // submission queue entries
+  unsigned*sqhead_=nullptr;                      // kernel head of submission queue
+  unsigned*sqktail_=nullptr;                     // kernel tail of submission queue
+  unsigned*sqarray_=nullptr;                     // submission queue index array
+  unsigned sqmask_=0;                            // ...
+  unsigned sqentries_=0;                         // #of entries in submission queue
+  unsigned sqtail_=0;                            // tail of submission queue including entries not yet submitted
+  unsigned*cqhead_=nullptr;                      // head of completion queue
+  unsigned*cqtail_=nullptr;                      // tail of completion queue
+  struct io_uring_cqe*cqes_=nullptr;             // completion queue entries
+  unsigned cqmask_=0;                            // ...
+  struct io_uring_buf_ring*bring_=nullptr;       // ring of provided buffers (nullptr if not registered)
+  std::size_t bringsize_=0;                      // size of mapped buffer ring
+  std::vector<char>bufmem_;                      // memory of provided buffers
+  std::size_t bufsize_=0;                        // size of a provided buffer
+  unsigned bufmask_=0;                           // ...
+  unsigned short btail_=0;                       // tail of buffer ring
+};
+// run one request on a ring and get its completion
+// (returns false if the request could not be submitted or did not complete within 'ms' ms)
+template<typename F>
+bool uringRunOne(uring&ring,std::size_t ms,F prep,struct io_uring_cqe&cqe){
+  boost::system::error_code ec;
+  struct io_uring_sqe*sqe{ring.sqe(ec)};
+  if(sqe==nullptr)return false;
+  prep(*sqe);
+  if(!ring.enter(1,ms,ec))return false;
+  return ring.completions([&](struct io_uring_cqe const&c){cqe=c;})==1;
+}
+// check if io_uring can be used by server event loops
+// (io_uring may be missing, disabled by the system or too old to have buffer rings and multishot accepts/receives)
+// (we probe once per process by using the features the server loop uses: registering a buffer ring (EINVAL if not supported)
+//  and running a multishot accept and a multishot receive with buffer selection over a unix domain socket - a kernel without
+//  multishot support completes the requests with EINVAL)
+inline bool uringSupported(){
+  static bool const ret{[](){
+    int lsock{-1},csock{-1},asock{-1};
+    auto cleanup=[&](){for(int fd:{lsock,csock,asock})if(fd>=0)eclose(fd,false);};
+    try{
+      uring ring(4);
+      ring.registerBuffers(0,1,4096);
+
+      // listen on an autobound abstract unix socket and connect to it
+      struct sockaddr_un addr;
+      socklen_t addrlen{sizeof(sa_family_t)};
+      std::memset(&addr,0,sizeof(addr));
+      addr.sun_family=AF_UNIX;
+      lsock=::socket(AF_UNIX,SOCK_STREAM|SOCK_CLOEXEC,0);
+      csock=::socket(AF_UNIX,SOCK_STREAM|SOCK_CLOEXEC,0);
+      if(lsock<0||csock<0||::bind(lsock,reinterpret_cast<struct sockaddr*>(&addr),addrlen)<0||::listen(lsock,1)<0){
+        cleanup();
+        return false;
+      }
+      addrlen=sizeof(addr);
+      ::getsockname(lsock,reinterpret_cast<struct sockaddr*>(&addr),&addrlen);
+      if(::connect(csock,reinterpret_cast<struct sockaddr*>(&addr),addrlen)<0){
+        cleanup();
+        return false;
+      }
+      // multishot accept
+      struct io_uring_cqe cqe;
+      bool ok{uringRunOne(ring,1000,[&](struct io_uring_sqe&sqe){
+          sqe.opcode=IORING_OP_ACCEPT;
+          sqe.fd=lsock;
+          sqe.ioprio=IORING_ACCEPT_MULTISHOT;
+          sqe.accept_flags=SOCK_CLOEXEC;
+        },cqe)};
+      if(!ok||cqe.res<0||!(cqe.flags&IORING_CQE_F_MORE)){
+        if(ok&&cqe.res>=0)eclose(cqe.res,false);
+        cleanup();
+        return false;
+      }
+      asock=cqe.res;
+
+      // multishot receive into buffer ring
+      char const c{0};
+      if(::write(csock,&c,1)!=1){
+        cleanup();
+        return false;
+      }
+      ok=uringRunOne(ring,1000,[&](struct io_uring_sqe&sqe){
+          sqe.opcode=IORING_OP_RECV;
+          sqe.fd=asock;
+          sqe.ioprio=IORING_RECV_MULTISHOT;
+          sqe.flags=IOSQE_BUFFER_SELECT;
+          sqe.buf_group=0;
+        },cqe);
+      ok=ok&&cqe.res==1&&(cqe.flags&IORING_CQE_F_MORE)&&(cqe.flags&IORING_CQE_F_BUFFER);
+      cleanup();
+      return ok;
+    }
+    catch(std::exception const&){
+      cleanup();
+      return false;
+    }
+  }()};
+  return ret;
+}
+#else
+// io_uring multishot receives are not available with these kernel headers
+inline bool uringSupported(){return false;}
+#endif
+}
+}
+}
+}
+#endif
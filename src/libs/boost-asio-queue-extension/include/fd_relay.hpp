@@ -0,0 +1,198 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0.
+
+#ifndef __FD_RELAY_H__
+#define __FD_RELAY_H__
+#include "detail/queue_support.hpp"
+#include "detail/fdqueue_support.hpp"
+#include "detail/reactor_support.hpp"
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <boost/asio/error.hpp>
+
+namespace boost{
+namespace asio{
+
+// relay framed messages from one fd to another without de-serialising them
+// (bytes are moved from 'srcfd' into a kernel pipe and from the pipe to 'dstfd' using splice() so payloads never enter user space)
+// (frame boundaries are located by peeking at the pipe with tee() - for length prefixed framings only the header is peeked at,
+//  for separator framing the bytes in the pipe are scanned for the separator)
+// (bytes read past the end of a message stay in the pipe until the next message is relayed - the relay must therefore be
+//  the only reader of 'srcfd')
+// (with separator framing a message must fit in the pipe - if not, relay() fails with asio::error::message_size)
+// (the tmo in ms is a message timeout - once we have started to relay a message, the message will never timeout)
+// (the class is meant to be used in single threaded mode and is not thread safe)
+template<typename Framing=sep_framing>
+class fd_relay{
+public:
+  // requested size of internal pipe
+  constexpr static std::size_t PIPESIZE=1024*1024;
+
+  // ctors,assign,dtor
+  fd_relay(int srcfd,int dstfd,Framing const&framing=Framing{},bool closeOnExit=false):
+      srcfd_(srcfd),dstfd_(dstfd),framing_(framing),closeOnExit_(closeOnExit){
+    createPipe(pipe_);
+    createPipe(peek_);
+
+    // try to get a large pipe (fails silently if we are not allowed to) and make both pipes the same size
+    ::fcntl(pipe_[1],F_SETPIPE_SZ,static_cast<int>(PIPESIZE));
+    int sz=::fcntl(pipe_[1],F_GETPIPE_SZ);
+    if(sz<=0)throw std::runtime_error(std::string("fd_relay::fd_relay: failed getting pipe size, errno: ")+strerror(errno));
+    if(::fcntl(peek_[1],F_SETPIPE_SZ,sz)<sz){
+      throw std::runtime_error(std::string("fd_relay::fd_relay: failed setting pipe size, errno: ")+strerror(errno));
+    }
+    cap_=sz;
+    scratch_.resize(cap_);
+  }
+  fd_relay(fd_relay const&)=delete;
+  fd_relay(fd_relay&&)=delete;
+  fd_relay&operator=(fd_relay const&)=delete;
+  fd_relay&operator=(fd_relay&&)=delete;
+  ~fd_relay(){
+    for(int fd:{pipe_[0],pipe_[1],peek_[0],peek_[1]})detail::queue_support::eclose(fd,false);
+    if(closeOnExit_){
+      detail::queue_support::eclose(srcfd_,false);
+      detail::queue_support::eclose(dstfd_,false);
+    }
+  }
+  // relay one message - timeout if no message starts arriving within 'ms' ms (if ms == 0 there is no timeout)
+  // (returns false if no message was relayed - error code is asio::error::eof if 'srcfd' was closed)
+  bool relay(std::size_t ms,boost::system::error_code&ec){
+    return relayAux(framing_,ms,ec);
+  }
+  // relay messages until an error occurs or 'srcfd' is closed
+  // (returns #of messages relayed - error code is asio::error::eof if 'srcfd' was closed)
+  std::size_t run(boost::system::error_code&ec){
+    std::size_t ret{0};
+    while(relay(0,ec))++ret;
+    return ret;
+  }
+  // get #of bytes read from 'srcfd' which have not yet been relayed
+  std::size_t pending()const{
+    return inpipe_;
+  }
+private:
+  // relay a message framed by a separator
+  bool relayAux(sep_framing const&framing,std::size_t ms,boost::system::error_code&ec){
+    std::size_t scanned{0};
+    while(true){
+      // scan bytes we have not yet looked at for a separator
+      if(inpipe_>scanned){
+        std::size_t n{peek(inpipe_,ec)};
+        if(n==0&&ec!=boost::system::error_code())return false;
+        void const*p{std::memchr(scratch_.data()+scanned,framing.sep(),n-scanned)};
+        if(p!=nullptr)return drain(static_cast<char const*>(p)-scratch_.data()+1,ec);
+        scanned=n;
+      }
+      // message does not fit in pipe
+      if(inpipe_>=cap_){
+        ec=boost::asio::error::message_size;
+        return false;
+      }
+      // get more bytes (we only timeout before the first byte of a message)
+      if(!fill(inpipe_==0?ms:0,ec))return false;
+    }
+  }
+  // relay a length prefixed message
+  template<typename LengthFraming>
+  bool relayAux(LengthFraming const&framing,std::size_t ms,boost::system::error_code&ec){
+    std::size_t const maxhdr{LengthFraming::MAXHDR};
+    while(true){
+      // try to decode header from the bytes we have
+      if(inpipe_>0){
+        std::size_t n{peek(std::min(inpipe_,maxhdr),ec)};
+        if(n==0&&ec!=boost::system::error_code())return false;
+        std::size_t hdrlen,len;
+        if(framing.length(scratch_.data(),n,hdrlen,len,ec))return drain(hdrlen+len,ec);
+        if(ec!=boost::system::error_code())return false;
+      }
+      // get more bytes (we only timeout before the first byte of a message)
+      if(!fill(inpipe_==0?ms:0,ec))return false;
+    }
+  }
+  // move bytes from 'srcfd' into pipe
+  // (returns false if we timed out, got an error or 'srcfd' was closed)
+  bool fill(std::size_t ms,boost::system::error_code&ec){
+    if(!detail::queue_support::waitReady(srcfd_,POLLIN,ms,ec))return false;
+    ssize_t n;
+    while((n=::splice(srcfd_,nullptr,pipe_[1],nullptr,cap_-inpipe_,SPLICE_F_MOVE|SPLICE_F_NONBLOCK))<0&&errno==EINTR){}
+    if(n==0){
+      ec=boost::asio::error::eof;
+      return false;
+    }
+    if(n<0){
+      if(errno==EAGAIN||errno==EWOULDBLOCK)return true;
+      ec=boost::system::error_code(errno,boost::system::get_posix_category());
+      return false;
+    }
+    inpipe_+=n;
+    return true;
+  }
+  // copy the first 'len' bytes in pipe into scratch buffer without removing them from the pipe
+  // (returns #of bytes copied)
+  std::size_t peek(std::size_t len,boost::system::error_code&ec){
+    ssize_t n;
+    while((n=::tee(pipe_[0],peek_[1],len,SPLICE_F_NONBLOCK))<0&&errno==EINTR){}
+    if(n<0){
+      ec=boost::system::error_code(errno,boost::system::get_posix_category());
+      return 0;
+    }
+    std::size_t got{0};
+    while(got<static_cast<std::size_t>(n)){
+      ssize_t stat;
+      while((stat=::read(peek_[0],scratch_.data()+got,n-got))<0&&errno==EINTR){}
+      if(stat<=0){
+        ec=boost::system::error_code(stat<0?errno:EIO,boost::system::get_posix_category());
+        return 0;
+      }
+      got+=stat;
+    }
+    ec=boost::system::error_code();
+    return got;
+  }
+  // move 'len' bytes from pipe to 'dstfd' - reading more from 'srcfd' if needed
+  bool drain(std::size_t len,boost::system::error_code&ec){
+    while(len>0){
+      if(inpipe_==0){
+        if(!fill(0,ec))return false;
+        continue;
+      }
+      if(!detail::queue_support::waitReady(dstfd_,POLLOUT,0,ec))return false;
+      ssize_t n;
+      while((n=::splice(pipe_[0],nullptr,dstfd_,nullptr,std::min(len,inpipe_),SPLICE_F_MOVE|SPLICE_F_NONBLOCK))<0&&errno==EINTR){}
+      if(n<0){
+        if(errno==EAGAIN||errno==EWOULDBLOCK)continue;
+        ec=boost::system::error_code(errno,boost::system::get_posix_category());
+        return false;
+      }
+      inpipe_-=n;
+      len-=n;
+    }
+    ec=boost::system::error_code();
+    return true;
+  }
+  // create a pipe (throws exception if failure)
+  static void createPipe(int fds[2]){
+    if(::pipe2(fds,O_CLOEXEC)<0){
+      throw std::runtime_error(std::string("fd_relay::createPipe: failed creating pipe, errno: ")+strerror(errno));
+    }
+  }
+  // state of relay
+  int srcfd_;                            // fd to read from
+  int dstfd_;                            // fd to write to
+  Framing framing_;                      // message framing
+  bool closeOnExit_;                     // close src/dst fds on exit
+  int pipe_[2];                          // pipe holding bytes read from 'srcfd'
+  int peek_[2];                          // pipe used for peeking at bytes in 'pipe_'
+  std::size_t cap_=0;                    // capacity of pipes
+  std::size_t inpipe_=0;                 // #of bytes in 'pipe_'
+  std::vector<char>scratch_;             // bytes peeked at
+};
+}
+}
+#endif
@@ -4,7 +4,6 @@
 /* TODO
 IMPROVEMENTS:
 	- we should have two timeouts, message timeout, byte timeout
-	- read more than one character at a time ... must then buffer what we have read
 */
 
 #ifndef __FDDEQ_QUEUE_H__
@@ -24,11 +23,14 @@ namespace boost{
 namespace asio{
 
 // a simple queue based on sending messages separated by '\n'
-// (if sending objects first serialise the object, the base64 encode it in the serialiser)
+// (messages can instead be framed by a length header - see Framing)
+// (if sending binary objects with separator framing, base64 encode them in the serialiser - or use varint_framing/fixed_framing)
+// (serialisers/de-serialisers are either stream or buffer based - see detail/serial_support.hpp)
 // (the tmo in ms is based on message timeout - if no message starts arriving within timeout, the function times out)
 // (ones we have started to read a message, the message will never timeout)
+// (bytes are read in chunks - bytes read past the end of a message are buffered and used for the next message)
 // (the class is meant to be used in singele threaded mode and is not thread safe)
-template<typename T,typename DESER,typename Base=detail::base::queue_empty_base<T>>
+template<typename T,typename DESER,typename Base=detail::base::queue_empty_base<T>,typename Framing=sep_framing>
 class fddeq_queue:public Base{
 public:
   // default message separaor
@@ -36,23 +38,27 @@ public:
 
   // ctors,assign,dtor
   fddeq_queue(int fdread,DESER deser,bool closeOnExit=false,char sep=NEWLINE):
-      fdread_(fdread),deser_(deser),sep_{sep},closeOnExit_(closeOnExit),mtx_{std::make_unique<std::mutex>()}{
+      fddeq_queue(fdread,deser,closeOnExit,detail::queue_support::makeFraming<Framing>(sep)){
+  }
+  fddeq_queue(int fdread,DESER deser,bool closeOnExit,Framing const&framing):
+      fdread_(fdread),deser_(deser),framing_(framing),closeOnExit_(closeOnExit),mtx_{std::make_unique<std::mutex>()}{
   }
   fddeq_queue(fddeq_queue const&)=delete;
   fddeq_queue(fddeq_queue&&other):
-      fdread_(other.fdread_),deser_(std::move(other.deser_)),sep_(other.sep_),closeOnExit_(other.closeOnExit_),
-      mtx_(std::move(other.mtx_)),deq_enabled_(other.deq_enabled_){
+      fdread_(other.fdread_),deser_(std::move(other.deser_)),framing_(other.framing_),closeOnExit_(other.closeOnExit_),
+      mtx_(std::move(other.mtx_)),deq_enabled_(other.deq_enabled_),rbuf_(std::move(other.rbuf_)){
     other.closeOnExit_=false; // make sure we don't close twice
   }
   fddeq_queue&operator=(fddeq_queue const&)=delete;
   fddeq_queue&operator=(fddeq_queue&&other){
     fdread_=other.fdread_;
     deser_=std::move(other.deser_);
-    sep_=other.sep_;
+    framing_=other.framing_;
     closeOnExit_=closeOnExit_;
     other.closeOnExit_=false; // make sure we don't close twice
     mtx_=std::move(other.mtx_);
     deq_enabled_=other.deq_enabled_;
+    rbuf_=std::move(other.rbuf_);
     return*this;
   }
   ~fddeq_queue(){if(closeOnExit_)detail::queue_support::eclose(fdread_,false);}
@@ -65,9 +71,9 @@ public:
       ec=boost::asio::error::operation_aborted;
       return std::make_pair(false,T{});
     }
-    T ret{detail::queue_support::recvwait<T,DESER>(fdread_,0,ec,true,sep_,deser_)};
+    T ret{detail::queue_support::recvwait<T,DESER>(fdread_,rbuf_,0,ec,true,framing_,deser_)};
     if(ec!=boost::system::error_code())return std::make_pair(false,ret);
-    return make_pair(true,ret);
+    return std::make_pair(true,ret);
   }
   // dequeue a message (return.first == false if deq() was disabled) - timeout if waiting too long
   std::pair<bool,T>timed_deq(std::size_t ms,boost::system::error_code&ec){
@@ -77,9 +83,9 @@ public:
       ec=boost::asio::error::operation_aborted;
       return std::make_pair(false,T{});
     }
-    T ret{detail::queue_support::recvwait<T,DESER>(fdread_,ms,ec,true,sep_,deser_)};
+    T ret{detail::queue_support::recvwait<T,DESER>(fdread_,rbuf_,ms,ec,true,framing_,deser_)};
     if(ec!=boost::system::error_code())return std::make_pair(false,ret);
-    return make_pair(true,ret);
+    return std::make_pair(true,ret);
   }
   // wait until we can retrieve a message from queue
   bool wait_deq(boost::system::error_code&ec){
@@ -89,7 +95,7 @@ public:
       ec=boost::asio::error::operation_aborted;
       return false;
     }
-    detail::queue_support::recvwait<T,DESER>(fdread_,0,ec,false,sep_,deser_);
+    detail::queue_support::recvwait<T,DESER>(fdread_,rbuf_,0,ec,false,framing_,deser_);
     if(ec.value()!=0)return false;
     return true;
   }
@@ -101,7 +107,7 @@ public:
       ec=boost::asio::error::operation_aborted;
       return false;
     }
-    detail::queue_support::recvwait<T,DESER>(fdread_,ms,ec,false,sep_,deser_);
+    detail::queue_support::recvwait<T,DESER>(fdread_,rbuf_,ms,ec,false,framing_,deser_);
     if(ec==boost::asio::error::timed_out)return false;
     if(ec.value()!=0)return false;
     return true;
@@ -119,10 +125,11 @@ private:
   // state of queue
   int fdread_;                           // file descriptors to read from from
   DESER deser_;                          // de-serialiser
-  char sep_;                             // message separator
+  Framing framing_;                      // message framing
   bool closeOnExit_;                     // close fd on exit
   mutable std::unique_ptr<std::mutex>mtx_;// mutex protected enable flag
   bool deq_enabled_=true;                // is dequing enabled
+  detail::queue_support::fdreadbuf rbuf_;// bytes read but not yet dequeued
 };
 }
 }
@@ -4,7 +4,6 @@
 /* TODO
 IMPROVEMENTS:
 	- we should have two timeouts, message timeout, byte timeout
-	- read more than one character at a time ... must then buffer what we have read
 	- maybe we should createa stream and serialise directoy into fd - we would have problems with tmos though ...
 */
 
@@ -23,38 +22,53 @@ namespace boost{
 namespace asio{
 
 // a simple queue based on receiving messages separated by '\n'
+// (messages can instead be framed by a length header - see Framing)
 // (if recieving objects which are serialised, they should have been serialised and then encoded)
+// (serialisers/de-serialisers are either stream or buffer based - see detail/serial_support.hpp)
 // (the tmo in ms is based on message timeout - if no message starts arriving within timeout, the function times out)
 // (ones we have started to send a message, the message will never timeout)
+// (if corking is configured messages are buffered and written in batches - see cork_options - flush() writes buffered messages)
 // (the class is meant to be used in singele threaded mode and is not thread safe)
-template<typename T,typename SERIAL,typename Base=detail::base::queue_empty_base<T>>
+template<typename T,typename SERIAL,typename Base=detail::base::queue_empty_base<T>,typename Framing=sep_framing>
 class fdenq_queue:public Base{
 public:
   // default message separaor
   constexpr static char NEWLINE='\n';
 
   // ctors,assign,dtor
-  fdenq_queue(int fdwrite,SERIAL serial,bool closeOnExit=false,char sep=NEWLINE):
-      fdwrite_(fdwrite),serial_(serial),sep_(sep),closeOnExit_(closeOnExit),mtx_{std::make_unique<std::mutex>()}{
+  fdenq_queue(int fdwrite,SERIAL serial,bool closeOnExit=false,char sep=NEWLINE,cork_options const&cork=cork_options{}):
+      fdenq_queue(fdwrite,serial,closeOnExit,detail::queue_support::makeFraming<Framing>(sep),cork){
+  }
+  fdenq_queue(int fdwrite,SERIAL serial,bool closeOnExit,Framing const&framing,cork_options const&cork=cork_options{}):
+      fdwrite_(fdwrite),serial_(serial),framing_(framing),closeOnExit_(closeOnExit),mtx_{std::make_unique<std::mutex>()}{
+    if(cork.max_bytes>0||cork.max_delay_us>0)cork_=std::make_unique<detail::queue_support::fdcork>(cork);
   }
   fdenq_queue(fdenq_queue const&)=delete;
   fdenq_queue(fdenq_queue&&other):
-      fdwrite_(other.fdwrite_),serial_(std::move(other.serial_)),sep_(other.sep_),closeOnExit_(other.closeOnExit_),
-      mtx_(std::move(other.mtx_)),enq_enabled_(other.enq_enabled_){
+      fdwrite_(other.fdwrite_),serial_(std::move(other.serial_)),framing_(other.framing_),closeOnExit_(other.closeOnExit_),
+      mtx_(std::move(other.mtx_)),enq_enabled_(other.enq_enabled_),cork_(std::move(other.cork_)){
     other.closeOnExit_=false; // make sure we don't close twice
   }
   fdenq_queue&operator=(fdenq_queue const&)=delete;
   fdenq_queue&operator=(fdenq_queue&&other){
     fdwrite_=other.fdwrite_;
     serial_=std::move(other.serial_);
-    sep_=other.sep_;
+    framing_=other.framing_;
     closeOnExit_=other.closeOnExit_;
     other.closeOnExit_=false; // make sure we don't close twice
     mtx_=std::move(other.mtx_);
     enq_enabled_=other.enq_enabled_;
+    cork_=std::move(other.cork_);
     return*this;
   }
-  ~fdenq_queue(){if(closeOnExit_)detail::queue_support::eclose(fdwrite_,false);}
+  ~fdenq_queue(){
+    // write buffered messages before closing fd
+    if(cork_){
+      boost::system::error_code ec;
+      cork_->flush(ec);
+    }
+    if(closeOnExit_)detail::queue_support::eclose(fdwrite_,false);
+  }
   
   // enqueue a message (return.first == false if enq() was disabled)
   bool enq(T t,boost::system::error_code&ec){
@@ -63,7 +77,7 @@ public:
       ec=boost::asio::error::operation_aborted;
       return false;
     }
-    return detail::queue_support::sendwait<T,SERIAL>(fdwrite_,&t,0,ec,true,sep_,serial_);
+    return enqAux(t,0,ec);
   }
   // enqueue a message (return.first == false if enq() was disabled) - timeout if waiting too long
   bool timed_enq(T t,std::size_t ms,boost::system::error_code&ec){
@@ -72,7 +86,7 @@ public:
       ec=boost::asio::error::operation_aborted;
       return false;
     }
-    return detail::queue_support::sendwait<T,SERIAL>(fdwrite_,&t,ms,ec,true,sep_,serial_);
+    return enqAux(t,ms,ec);
   }
   // wait until we can retrieve a message from queue
   bool wait_enq(boost::system::error_code&ec){
@@ -81,7 +95,7 @@ public:
       ec=boost::asio::error::operation_aborted;
       return false;
     }
-    return detail::queue_support::sendwait<T,SERIAL>(fdwrite_,nullptr,0,ec,false,sep_,serial_);
+    return detail::queue_support::sendwait<T,SERIAL>(fdwrite_,nullptr,0,ec,false,framing_,serial_);
   }
   // wait until we can retrieve a message from queue -  timeout if waiting too long
   bool timed_wait_enq(std::size_t ms,boost::system::error_code&ec){
@@ -90,7 +104,14 @@ public:
       ec=boost::asio::error::operation_aborted;
       return false;
     }
-    return detail::queue_support::sendwait<T,SERIAL>(fdwrite_,nullptr,ms,ec,false,sep_,serial_);
+    return detail::queue_support::sendwait<T,SERIAL>(fdwrite_,nullptr,ms,ec,false,framing_,serial_);
+  }
+  // write buffered messages (no-op if corking is not configured)
+  bool flush(boost::system::error_code&ec){
+    std::unique_lock<std::mutex>lock(*mtx_);
+    ec=boost::system::error_code();
+    if(!cork_)return true;
+    return cork_->flush(ec);
   }
   // cancel enq operations (will also release blocking threads)
   void disable_enq(bool disable){
@@ -102,13 +123,21 @@ public:
     return fdwrite_;
   }
 private:
+  // write or buffer a message
+  bool enqAux(T const&t,std::size_t ms,boost::system::error_code&ec){
+    if(!cork_)return detail::queue_support::sendwait<T,SERIAL>(fdwrite_,&t,ms,ec,true,framing_,serial_);
+    std::string msg{detail::queue_support::serialise(t,framing_,serial_,ec)};
+    if(ec!=boost::system::error_code())return false;
+    return cork_->enq(fdwrite_,std::move(msg),ms,ec);
+  }
   // state of queue
   int fdwrite_;                          // file descriptors serialize object tpo
   SERIAL serial_;                        // serialise
-  char sep_;                             // message separator
+  Framing framing_;                      // message framing
   bool closeOnExit_;                     // close fd on exit
   mutable std::unique_ptr<std::mutex>mtx_;// must be pointer since not movable
   bool enq_enabled_=true;                // is enqueing enabled
+  std::unique_ptr<detail::queue_support::fdcork>cork_;// buffers messages if corking is configured
 };
 }
 }
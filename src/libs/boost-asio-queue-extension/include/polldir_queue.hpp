@@ -4,8 +4,7 @@
 /*
 	Q: what advantage would it be to use inotify for event notification
 		- possibly using normal copying of files into a directory
-		- we would not need a cache
-	D: add shared memory to keep track of #elements in queue
+	D: add shared memory to keep track of #elements in queue (done: memory mapped head/tail index)
 	D: (add a base class to queues (queue_base))
 	D: test queue through producer/consumer in separate processes (requires: boost 1.56)
 	D: possibly add callback when an event happens at the queue level
@@ -19,10 +18,17 @@
 #define __POLLDIR_QUEUE_H__
 #include "detail/queue_empty_base.hpp"
 #include "detail/queue_support.hpp"
+#include "detail/durability_support.hpp"
+#include "detail/polldir_index.hpp"
 #include <string>
 #include <utility>
-#include <list>
+#include <deque>
 #include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
 #include <boost/thread/thread_time.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/interprocess/sync/scoped_lock.hpp>
@@ -38,87 +44,103 @@ namespace pt=boost::posix_time;
 
 // a simple threadsafe/interprocess-safe queue using directory as queue and files as storage media for queue items
 // (mutex/condition variable names are derived from the queue name)
-// (enq/deq have locks around them so that we cannot read partial messages)
+// (messages are written to the '.tmp' sub directory and moved into the queue directory when complete,
+//  so consumers never see partial messages)
+// (messages are named by sequence numbers tracked in a memory mapped head/tail index so opening the queue and
+//  finding the next message does not require listing the directory - see detail::queue_support::polldir_index)
+// (consumers claim a message by moving its file into the '.claimed' sub directory - only one consumer can win the
+//  rename so no two consumers ever deliver the same message - the claimed file is removed when deq returns the message)
+// (claiming and reading messages is done without holding the interprocess lock - the lock is only used for
+//  blocking when the queue is empty/full and for waking up blocked threads, so consumers in separate processes run in parallel)
+// (durability controls if/how messages are fsync()ed before enq returns - the file is synced while it is still in the
+//  '.tmp' directory and the queue directory is synced after the file has been published, so enq never touches a
+//  published file which a consumer may already have claimed)
+// (if readahead > 0 a background thread claims, reads and deserialises up to 'readahead' messages ahead of deq)
+// (serialisers/de-serialisers are either stream or buffer based - see detail/serial_support.hpp)
 template<typename T,typename DESER,typename SERIAL,typename Base=detail::base::queue_empty_base<T>>
 class polldir_queue:public Base{
 public:
   // ctors,assign,dtor
   // (if maxsize == 0 checking for max numbert of queue elements is ignored)
-  polldir_queue(std::string const&qname,std::size_t maxsize,fs::path const&dir,DESER deser,SERIAL serial,bool removelocks):
-      qname_(qname),maxsize_(maxsize),dir_(dir),deser_(deser),serial_(serial),removelocks_(removelocks),
+  // (maxsize is checked against size() which may over count after claimed messages have been put back - see size())
+  // (commit_window_us is only used with queue_durability::group_commit)
+  // (if readahead == 0 messages are read synchronously in deq)
+  polldir_queue(std::string const&qname,std::size_t maxsize,fs::path const&dir,DESER deser,SERIAL serial,bool removelocks,
+                queue_durability durability=queue_durability::none,std::size_t commit_window_us=1000,std::size_t readahead=0):
+      qname_(qname),maxsize_(maxsize),dir_(dir),deser_(deser),serial_(serial),removelocks_(removelocks),durability_(durability),
       ipcmtx_(std::make_shared<boost::interprocess::named_mutex>(ipc::open_or_create,qname.c_str())),
-      ipcond_(std::make_shared<boost::interprocess::named_condition>(ipc::open_or_create,qname.c_str())){
+      ipcond_(std::make_shared<boost::interprocess::named_condition>(ipc::open_or_create,qname.c_str())),
+      readahead_(readahead),claimdir_(dir/".claimed"),tmpdir_(dir/".tmp"),
+      ramtx_{std::make_unique<std::mutex>()},racond_{std::make_unique<std::condition_variable>()}{
     // make sure path is a directory
     if(!fs::is_directory(dir_))throw std::logic_error(std::string("polldir_queue::polldir_queue: dir_: ")+dir.string()+" is not a directory");
+
+    // group commits are shared by all threads using this queue object
+    // (one batch syncs written files before they are published, another syncs the queue directory after publishing)
+    if(durability_==queue_durability::group_commit){
+      committer_=std::make_unique<detail::queue_support::group_commit>(fs::path(),commit_window_us);
+      dircommitter_=std::make_unique<detail::queue_support::group_commit>(dir_,commit_window_us);
+    }
+
+    // open index, create claim/tmp directories and cleanup after processes which died
+    {
+      ipc::scoped_lock<ipc::named_mutex>lock(*ipcmtx_);
+      fs::create_directory(claimdir_);
+      fs::create_directory(tmpdir_);
+      index_=std::make_unique<detail::queue_support::polldir_index>(dir_);
+      for(auto const&f:detail::queue_support::recoverClaims(claimdir_,dir_))index_->restored(f);
+      detail::queue_support::removeOrphans(tmpdir_);
+    }
+    startReadahead();
   }
   polldir_queue(polldir_queue const&)=delete;
-  polldir_queue(polldir_queue&&other):
-      qname_(std::move(other.qname_)),maxsize_(other.maxsize_),dir_(other.dir_),deser_(std::move(other.deser_)),serial_(std::move(other.serial_)),
-      removelocks_(other.removelocks_),deq_enabled_(other.deq_enabled_),enq_enabled_(other.enq_enabled_),
-      ipcmtx_(std::move(other.ipcmtx_)),ipcond_(std::move(other.ipcond_)),cache_(std::move(other.cache_)){
-    other.ipcmtx_=nullptr;
-    other.ipcond_=nullptr;
-    other.removelocks_=false; // make sure we don't remove locks twice
+  polldir_queue(polldir_queue&&other):polldir_queue(std::move(other),other.stopReadahead()){
   }
   polldir_queue&operator=(polldir_queue const&)=delete;
   polldir_queue&operator=(polldir_queue&&other){
+    stopReadahead();
+    releaseReadaheadBuffer();
+    other.stopReadahead();
     qname_=std::move(other.qname_);
-    maxsize_=other.maxsize_;
+    maxsize_=other.maxsize_.load();
     dir_=std::move(other.dir_);
     removelocks_=other.removelocks_;
     deser_=std::move(other.deser_);
     serial_=std::move(other.serial_);
-    deq_enabled_=other.deq_enabled_;
+    durability_=other.durability_;
+    committer_=std::move(other.committer_);
+    dircommitter_=std::move(other.dircommitter_);
+    deq_enabled_=other.deq_enabled_.load();
     enq_enabled_=other.enq_enabled_;
     ipcmtx_=std::move(other.ipcmtx_);
     ipcond_=std::move(other.ipcond_);
     other.ipcmtx_=nullptr;
     other.ipcond_=nullptr;
-    cache_=std::move(other.cache_);
+    index_=std::move(other.index_);
     other.removelocks_=false; // make sure we don't remove locks twice
+    readahead_=other.readahead_;
+    claimdir_=std::move(other.claimdir_);
+    tmpdir_=std::move(other.tmpdir_);
+    ramtx_=std::move(other.ramtx_);
+    racond_=std::move(other.racond_);
+    rabuf_=std::move(other.rabuf_);
+    startReadahead();
     return*this;
   }
   ~polldir_queue(){
+    stopReadahead();
+    releaseReadaheadBuffer();
     if(removelocks_)removeLockVariables(qname_);
   }
   // put a message into queue
   // (returns true if message was enqueued, false if enqueing was disabled)
   bool enq(T t,boost::system::error_code&ec){
-    // wait for state of queue is such that we can enque an element
-    ipc::scoped_lock<ipc::named_mutex>lock(*ipcmtx_);
-    ipcond_->wait(lock,[&](){return !enq_enabled_||!fullNolock();});
-
-    // if enq is disabled we'll return
-    if(!enq_enabled_){
-      ec=boost::asio::error::operation_aborted;
-      return false;
-    }
-    // we know we can now write message
-    detail::queue_support::write(t,dir_,serial_);
-    ipcond_->notify_all();
-    return true;
+    return enqAux(t,0,false,ec);
   }
   // put a message into queue - timeout if waiting too lo
   // (returns true if message was enqueued, false if enqueing was disabled)
   bool timed_enq(T t,std::size_t ms,boost::system::error_code&ec){
-    // wait for state of queue is such that we can enque an element
-    ipc::scoped_lock<ipc::named_mutex>lock(*ipcmtx_);
-    boost::system_time const tmo_ms=boost::get_system_time()+boost::posix_time::milliseconds(ms);
-    bool tmo=!ipcond_->timed_wait(lock,tmo_ms,[&](){return !enq_enabled_||!fullNolock();});
-
-    if(tmo){
-      ec=boost::asio::error::timed_out;
-      return false;
-    }
-    if(!enq_enabled_){
-      ec=boost::asio::error::operation_aborted;
-      return false;
-    }
-    // we know we can now write message
-    detail::queue_support::write(t,dir_,serial_);
-    ipcond_->notify_all();
-    ec=boost::system::error_code();
-    return true;
+    return enqAux(t,ms,true,ec);
   }
   // wait until we can put a message in queue
   // (returns false if enqueing was disabled, else true)
@@ -157,80 +179,59 @@ public:
   }
   // dequeue a message (return.first == false if deq() was disabled)
   std::pair<bool,T>deq(boost::system::error_code&ec){
-    // wait for the state of queue is such that we can return something
-    ipc::scoped_lock<ipc::named_mutex>lock(*ipcmtx_);
-    ipcond_->wait(lock,[&](){return !deq_enabled_||!emptyNolock();});
+    // if we read ahead, message comes from read-ahead buffer
+    if(readahead_>0)return deqReadahead(0,false,true,ec);
 
-    // if deq is disabled or timeout
-    if(!enq_enabled_){
-      ec=boost::asio::error::operation_aborted;
-      return std::make_pair(false,T{});
-    }
-    // we know the cache is not empty now so no need to check
-    fs::path file{cache_.front()};
-    cache_.pop_front();
-    T ret{detail::queue_support::read<T>(file,deser_)};
-    ipcond_->notify_all();
-    ec=boost::system::error_code();
-    return std::make_pair(true,ret);
+    // claim a message and read it
+    fs::path claimed{claimWait(0,false,[&](){return !deq_enabled_.load();},ec)};
+    if(claimed.empty())return std::make_pair(false,T{});
+    return std::make_pair(true,readClaimed(claimed));
   }
   // dequeue a message (return.first == false if deq() was disabled) - timeout if waiting too long
   std::pair<bool,T>timed_deq(std::size_t ms,boost::system::error_code&ec){
-    // wait for the state of queue is such that we can return something
-    ipc::scoped_lock<ipc::named_mutex>lock(*ipcmtx_);
-    boost::system_time const tmo_ms=boost::get_system_time()+boost::posix_time::milliseconds(ms);
-    bool tmo=!ipcond_->timed_wait(lock,tmo_ms,[&](){return !deq_enabled_||!emptyNolock();});
+    // if we read ahead, message comes from read-ahead buffer
+    if(readahead_>0)return deqReadahead(ms,true,true,ec);
 
-    // if deq is disabled or queue is empty return or timeout
-    if(tmo){
-      ec=boost::asio::error::timed_out;
-       return std::make_pair(false,T{});
-    }
-    if(!deq_enabled_){
-      ec=boost::asio::error::operation_aborted;
-      return std::make_pair(false,T{});
-    }
-    // we know the cache is not empty now so no need to check
-    fs::path file{cache_.front()};
-    cache_.pop_front();
-    T ret{detail::queue_support::read<T>(file,deser_)};
-    ipcond_->notify_all();
-    ec=boost::system::error_code();
-    return std::make_pair(true,ret);
+    // claim a message and read it
+    fs::path claimed{claimWait(ms,true,[&](){return !deq_enabled_.load();},ec)};
+    if(claimed.empty())return std::make_pair(false,T{});
+    return std::make_pair(true,readClaimed(claimed));
   }
   // wait until we can retrieve a message from queue
   bool wait_deq(boost::system::error_code&ec){
+    // if we read ahead, wait for read-ahead buffer
+    if(readahead_>0)return deqReadahead(0,false,false,ec).first;
+
     // wait for the state of queue is such that we can return something
     ipc::scoped_lock<ipc::named_mutex>lock(*ipcmtx_);
-    ipcond_->wait(lock,[&](){return !deq_enabled_||!emptyNolock();});
+    ipcond_->wait(lock,[&](){return !deq_enabled_.load()||!emptyNolock();});
 
     // check if dequeue was disabled
-    if(!deq_enabled_){
+    if(!deq_enabled_.load()){
       ec=boost::asio::error::operation_aborted;
       return false;
     }
-    // we know the cache is not empty now so no need to check
-    fs::path file{cache_.front()};
     ipcond_->notify_all();
     ec=boost::system::error_code();
     return true;
   }
   // wait until we can retrieve a message from queue -  timeout if waiting too long
   bool timed_wait_deq(std::size_t ms,boost::system::error_code&ec){
+    // if we read ahead, wait for read-ahead buffer
+    if(readahead_>0)return deqReadahead(ms,true,false,ec).first;
+
     // wait for the state of queue is such that we can return something
     ipc::scoped_lock<ipc::named_mutex>lock(*ipcmtx_);
     boost::system_time const tmo_ms=boost::get_system_time()+boost::posix_time::milliseconds(ms);
-    bool tmo=!ipcond_->timed_wait(lock,tmo_ms,[&](){return !deq_enabled_||!emptyNolock();});
+    bool tmo=!ipcond_->timed_wait(lock,tmo_ms,[&](){return !deq_enabled_.load()||!emptyNolock();});
     if(tmo){
       ec=boost::asio::error::timed_out;
       return false;
     }
-    if(!deq_enabled_){
+    if(!deq_enabled_.load()){
       ec=boost::asio::error::operation_aborted;
       return false;
     }
-    // we know the cache is not empty now so no need to check
-    fs::path file{cache_.front()};
     ipcond_->notify_all();
     ec=boost::system::error_code();
     return true;
@@ -238,8 +239,10 @@ public:
   // cancel deq operations (will also release blocking threads)
   void disable_deq(bool disable){
     ipc::scoped_lock<ipc::named_mutex>lock(*ipcmtx_);
-    deq_enabled_=!disable;
+    std::unique_lock<std::mutex>ralock(*ramtx_);
+    deq_enabled_.store(!disable);
     ipcond_->notify_all();
+    racond_->notify_all();
   }
   // cancel enq operations (will also release blocking threads)
   void disable_enq(bool disable){
@@ -250,10 +253,16 @@ public:
   // set max size of queue
   void set_maxsize(std::size_t maxsize){
     ipc::scoped_lock<ipc::named_mutex>lock(*ipcmtx_);
-    return maxsize_;
+    maxsize_.store(maxsize);
+    ipcond_->notify_all();
   }
   // check if queue is empty
+  // (messages in the read-ahead buffer are part of the queue)
   bool empty()const{
+    {
+      std::unique_lock<std::mutex>ralock(*ramtx_);
+      if(!rabuf_.empty())return false;
+    }
     ipc::scoped_lock<ipc::named_mutex>lock(*ipcmtx_);
     return emptyNolock();
   }
@@ -263,19 +272,30 @@ public:
     return fullNolock();
   }
   // get #of items in queue
+  // (messages in the read-ahead buffer are part of the queue)
+  // (after claimed messages have been put back in the queue - on recovery, failed reads or when a read-ahead consumer
+  //  stops - this is an upper bound until consumers have passed the put back messages, see detail::queue_support::polldir_index)
   std::size_t size()const{
+    std::size_t nbuf{0};
+    {
+      std::unique_lock<std::mutex>ralock(*ramtx_);
+      nbuf=rabuf_.size();
+    }
     ipc::scoped_lock<ipc::named_mutex>lock(*ipcmtx_);
-    return sizeNolock();
+    return nbuf+sizeNolock();
   }
   // get max items in queue
   std::size_t maxsize()const{
-    ipc::scoped_lock<ipc::named_mutex>lock(*ipcmtx_);
-    return maxsize_;
+    return maxsize_.load();
   }
   // get name of queue
   std::string qname()const{
     return qname_;
   }
+  // get durability policy of queue
+  queue_durability durability()const{
+    return durability_;
+  }
   // remove lock variables for queue
   // (name of lock variables are computed from the path to the queue directory)
   static void removeLockVariables(std::string const&name){
@@ -283,80 +303,255 @@ public:
     ipc::named_condition::remove(name.c_str());
   }
 private:
+  // returned by stopReadahead() - lets the move ctor stop the read-ahead thread of 'other' before any state is moved
+  struct readahead_stopped{};
+
+  // move ctor stealing the state of a queue whose read-ahead thread has been stopped
+  polldir_queue(polldir_queue&&other,readahead_stopped):
+      qname_(std::move(other.qname_)),maxsize_(other.maxsize_.load()),dir_(other.dir_),deser_(std::move(other.deser_)),serial_(std::move(other.serial_)),
+      removelocks_(other.removelocks_),durability_(other.durability_),committer_(std::move(other.committer_)),
+      dircommitter_(std::move(other.dircommitter_)),
+      deq_enabled_(other.deq_enabled_.load()),enq_enabled_(other.enq_enabled_),
+      ipcmtx_(std::move(other.ipcmtx_)),ipcond_(std::move(other.ipcond_)),index_(std::move(other.index_)),
+      readahead_(other.readahead_),claimdir_(std::move(other.claimdir_)),tmpdir_(std::move(other.tmpdir_)),
+      ramtx_(std::move(other.ramtx_)),racond_(std::move(other.racond_)),rabuf_(std::move(other.rabuf_)){
+    other.ipcmtx_=nullptr;
+    other.ipcond_=nullptr;
+    other.removelocks_=false; // make sure we don't remove locks twice
+    startReadahead();
+  }
+  // a message read ahead of deq
+  struct readahead_item{
+    T t;                                 // deserialised message
+    fs::path claimed;                    // claimed file message was read from
+    std::exception_ptr err;              // set if message could not be read
+  };
+  // #of ms read-ahead thread waits for messages before checking if it should stop
+  constexpr static std::size_t RA_POLL_MS=100;
+
+  // enqueue a message
+  // (message is written and made durable without holding the lock and then moved into the queue when there is space in the queue)
+  bool enqAux(T const&t,std::size_t ms,bool timed,boost::system::error_code&ec){
+    fs::path tmpfile{detail::queue_support::write(t,tmpdir_,serial_)};
+    if(!commitFile(tmpfile,ec)){
+      std::remove(tmpfile.string().c_str());
+      return false;
+    }
+    // wait for state of queue is such that we can enque an element
+    ipc::scoped_lock<ipc::named_mutex>lock(*ipcmtx_);
+    boost::system_time const tmo_ms=boost::get_system_time()+boost::posix_time::milliseconds(ms);
+    auto pred=[&](){return !enq_enabled_||!fullNolock();};
+    if(!timed)ipcond_->wait(lock,pred);
+    else if(!ipcond_->timed_wait(lock,tmo_ms,pred)){
+      std::remove(tmpfile.string().c_str());
+      ec=boost::asio::error::timed_out;
+      return false;
+    }
+    // if enq is disabled we'll return
+    if(!enq_enabled_){
+      std::remove(tmpfile.string().c_str());
+      ec=boost::asio::error::operation_aborted;
+      return false;
+    }
+    // publish message
+    index_->publish(tmpfile);
+    ipcond_->notify_all();
+
+    // make directory entry of message durable without holding the lock
+    // (the published file may already have been claimed by a consumer so we must not touch it here)
+    lock.unlock();
+    return commitDir(ec);
+  }
+  // claim a message - block until a message is available, 'stop()' returns true or we time out
+  // (returns empty path and sets error code if no message was claimed)
+  template<typename STOP>
+  fs::path claimWait(std::size_t ms,bool timed,STOP stop,boost::system::error_code&ec){
+    boost::system_time const tmo_ms=boost::get_system_time()+boost::posix_time::milliseconds(ms);
+    while(!stop()){
+      // try to claim a message without holding the lock
+      fs::path claimed{claimNext()};
+      if(!claimed.empty()){
+        ec=boost::system::error_code();
+        return claimed;
+      }
+      // queue looks empty - block until a producer notifies us
+      // (producers publish messages while holding the lock so we cannot miss a message here)
+      ipc::scoped_lock<ipc::named_mutex>lock(*ipcmtx_);
+      auto pred=[&](){return stop()||!emptyNolock();};
+      if(!timed)ipcond_->wait(lock,pred);
+      else if(!ipcond_->timed_wait(lock,tmo_ms,pred)){
+        ec=boost::asio::error::timed_out;
+        return fs::path();
+      }
+    }
+    ec=boost::asio::error::operation_aborted;
+    return fs::path();
+  }
+  // claim oldest message
+  // (returns empty path if there are no messages)
+  fs::path claimNext(){
+    fs::path claimed{index_->claim(claimdir_)};
+
+    // wakeup producers blocked on a full queue
+    if(!claimed.empty()&&maxsize_.load()>0){
+      ipc::scoped_lock<ipc::named_mutex>lock(*ipcmtx_);
+      ipcond_->notify_all();
+    }
+    return claimed;
+  }
+  // read and remove a claimed message
+  // (if the message cannot be read, it is put back into the queue and the exception is re-thrown)
+  T readClaimed(fs::path const&claimed){
+    try{
+      return detail::queue_support::read<T>(claimed,deser_);
+    }
+    catch(...){
+      restoreClaimed(claimed);
+      throw;
+    }
+  }
+  // put back a claimed message into the queue
+  void restoreClaimed(fs::path const&claimed){
+    ipc::scoped_lock<ipc::named_mutex>lock(*ipcmtx_);
+    index_->restored(detail::queue_support::restore(claimed,dir_));
+    ipcond_->notify_all();
+  }
+  // start read-ahead thread if read-ahead is configured
+  void startReadahead(){
+    if(readahead_==0)return;
+    rastop_.store(false);
+    rathr_=std::thread([this](){runReadahead();});
+  }
+  // stop read-ahead thread if it is running
+  // (messages already read are kept in the read-ahead buffer)
+  readahead_stopped stopReadahead(){
+    if(!rathr_.joinable())return readahead_stopped{};
+    rastop_.store(true);
+    {
+      std::unique_lock<std::mutex>ralock(*ramtx_);
+      racond_->notify_all();
+    }
+    {
+      ipc::scoped_lock<ipc::named_mutex>lock(*ipcmtx_);
+      ipcond_->notify_all();
+    }
+    rathr_.join();
+    return readahead_stopped{};
+  }
+  // put messages in read-ahead buffer back in queue
+  // (read-ahead thread must not be running)
+  void releaseReadaheadBuffer(){
+    if(rabuf_.empty())return;
+    ipc::scoped_lock<ipc::named_mutex>lock(*ipcmtx_);
+    for(auto const&item:rabuf_)index_->restored(detail::queue_support::restore(item.claimed,dir_));
+    rabuf_.clear();
+    ipcond_->notify_all();
+  }
+  // read-ahead thread function
+  // (claims messages, reads and deserialises them into the read-ahead buffer)
+  void runReadahead(){
+    while(!rastop_.load()){
+      // wait until there is space in the read-ahead buffer
+      {
+        std::unique_lock<std::mutex>ralock(*ramtx_);
+        racond_->wait(ralock,[&](){return rastop_.load()||rabuf_.size()<readahead_;});
+        if(rastop_.load())break;
+      }
+      // wait for a message and claim it
+      // (wake up regularly to check if we should stop)
+      boost::system::error_code ec;
+      fs::path claimed{claimWait(RA_POLL_MS,true,[&](){return rastop_.load();},ec)};
+      if(claimed.empty())continue;
+
+      // deserialise message (errors are reported when message is dequeued)
+      readahead_item item{T{},claimed,nullptr};
+      try{
+        item.t=detail::queue_support::read<T>(claimed,deser_,false);
+      }
+      catch(...){
+        item.err=std::current_exception();
+      }
+      std::unique_lock<std::mutex>ralock(*ramtx_);
+      rabuf_.push_back(std::move(item));
+      racond_->notify_all();
+    }
+  }
+  // dequeue a message from read-ahead buffer
+  // (if getMsg is false we only wait for a message to become available)
+  std::pair<bool,T>deqReadahead(std::size_t ms,bool timed,bool getMsg,boost::system::error_code&ec){
+    std::unique_lock<std::mutex>ralock(*ramtx_);
+    auto pred=[&](){return !deq_enabled_.load()||!rabuf_.empty();};
+    if(!timed)racond_->wait(ralock,pred);
+    else if(!racond_->wait_for(ralock,std::chrono::milliseconds(ms),pred)){
+      ec=boost::asio::error::timed_out;
+      return std::make_pair(false,T{});
+    }
+    if(!deq_enabled_.load()){
+      ec=boost::asio::error::operation_aborted;
+      return std::make_pair(false,T{});
+    }
+    ec=boost::system::error_code();
+    if(!getMsg)return std::make_pair(true,T{});
+
+    // take message and let read-ahead thread refill buffer
+    readahead_item item{std::move(rabuf_.front())};
+    rabuf_.pop_front();
+    racond_->notify_all();
+    ralock.unlock();
+
+    // if message could not be read, put it back in queue and report error, else message is now delivered
+    if(item.err){
+      restoreClaimed(item.claimed);
+      std::rethrow_exception(item.err);
+    }
+    std::remove(item.claimed.string().c_str());
+    return std::make_pair(true,std::move(item.t));
+  }
+  // make a written (not yet published) message file durable according to durability policy
+  // (lock must not be held when calling this function)
+  bool commitFile(fs::path const&tmpfile,boost::system::error_code&ec){
+    ec=boost::system::error_code();
+    if(durability_==queue_durability::group_commit)return committer_->commit(tmpfile,ec);
+    if(durability_==queue_durability::fsync)return syncAux({tmpfile},fs::path(),ec);
+    return true;
+  }
+  // make directory entries of published messages durable according to durability policy
+  // (lock must not be held when calling this function)
+  bool commitDir(boost::system::error_code&ec){
+    ec=boost::system::error_code();
+    if(durability_==queue_durability::group_commit)return dircommitter_->commit(fs::path(),ec);
+    if(durability_==queue_durability::fsync)return syncAux({},dir_,ec);
+    return true;
+  }
+  // sync files and/or directory (returns false and sets error code if failure)
+  bool syncAux(std::vector<fs::path>const&files,fs::path const&dir,boost::system::error_code&ec){
+    int err{detail::queue_support::syncFiles(files,dir)};
+    if(err!=0){
+      ec=boost::system::error_code(err,boost::system::get_posix_category());
+      return false;
+    }
+    return true;
+  }
   // check if queue is full
   // (lock must be held when calling this function)
   bool fullNolock()const{
     // if maxsize_ == 0 we ignore checking the size of the queue
-    if(maxsize_==0)return false;
-    return sizeNolock()>=maxsize_;
+    if(maxsize_.load()==0)return false;
+    return sizeNolock()>=maxsize_.load();
   }
   // check if queue is empty 
   // (lock must be held when calling this function)
   bool emptyNolock()const{
-    // cleanup cache and check if we have queue elements
-    cleanCacheNolock();
-    if(cache_.size()>0)return false;
-
-    // cache is empty, fill it up and check if we are still empty
-    fillCacheNolock(true);
-    return cache_.size()==0;
-  }
-  // fill cache
-  // (must be called when having the lock)
-  void fillCacheNolock(bool forceRefill)const{
-    // trash cache and re-read if 'forceRefill' is set or if cache is empty
-    if(forceRefill||cache_.empty()){
-      std::list<fs::path>sortedFiles{getTsOrderedFiles()};
-      cache_.swap(sortedFiles);
-    }
-  }
-  // remove any file in cache which do not exist in dir_
-  // (must be called when having the lock)
-  void cleanCacheNolock()const{
-    std::list<fs::path>tmpCache;
-    for(auto const&p:cache_)
-      if(fs::exists(p))tmpCache.push_back(p);
-    swap(tmpCache,cache_);
+    return index_->empty();
   }
   // get size of queue
   // (lock must be held when calling this function)
   size_t sizeNolock()const{
-    // must forcefill cache to know the queue size
-    fillCacheNolock(true);
-    return cache_.size();
-  }
-  // get oldest file + manage cache_ if needed
-  // (lock must be held when calling this function)
-  std::pair<bool,fs::path>nextFileNolock()const{
-    // clean cache and only fill cache if it's empty
-    cleanCacheNolock();
-    fillCacheNolock(false);
-    if(cache_.empty())return std::make_pair(false,fs::path());
-    std::pair<bool,fs::path>ret{std::make_pair(true,cache_.front())};
-    cache_.pop_front();
-    return ret;
-  }
-  // get all filenames in time sorted order in a dircetory
-  std::list<fs::path>getTsOrderedFiles()const{
-    // need a map with key=time, value=filename
-    typedef std::multimap<time_t,fs::path>time_file_map_t;
-    time_file_map_t time_file_map;
-
-    // insert all files together with time as key into map
-    fs::directory_iterator dir_end_iter;
-    for(fs::directory_iterator it(dir_);it!=dir_end_iter;++it){
-      if(!is_regular_file(*it))continue;
-      time_t time_stamp(last_write_time(*it));
-      time_file_map.insert(time_file_map_t::value_type(time_stamp,*it));
-    }
-    // create return list and return
-    std::list<fs::path>ret;
-    for(auto const&f:time_file_map)ret.push_back(f.second);
-    return ret;
+    return index_->size();
   }
   // user specified characteristics of queue
   std::string qname_;
-  std::size_t maxsize_;
+  std::atomic<std::size_t>maxsize_;
   fs::path dir_;
 
   // serialization/deserialization functions
@@ -366,8 +561,14 @@ private:
   // should locks be removed
   bool removelocks_;
 
+  // durability of enqueued messages
+  queue_durability durability_;
+  std::unique_ptr<detail::queue_support::group_commit>committer_;     // syncs written files
+  std::unique_ptr<detail::queue_support::group_commit>dircommitter_;  // syncs queue directory
+
   // state of queue
-  bool deq_enabled_=true;
+  // (deq_enabled_ is read without holding the lock)
+  std::atomic<bool>deq_enabled_{true};
   bool enq_enabled_=true;
 
   // mutex/condition variables
@@ -375,8 +576,19 @@ private:
   mutable std::shared_ptr<boost::interprocess::named_mutex>ipcmtx_;
   mutable std::shared_ptr<boost::interprocess::named_condition>ipcond_;
 
-  // cache of message
-  mutable std::list<fs::path>cache_;
+  // index of messages in queue directory
+  std::unique_ptr<detail::queue_support::polldir_index>index_;
+
+  // read-ahead state
+  // (mutex/condition variable are pointers since they are not movable)
+  std::size_t readahead_;                                // max #of messages to read ahead (0 = no read-ahead)
+  fs::path claimdir_;                                    // directory holding claimed messages
+  fs::path tmpdir_;                                      // directory holding messages being written
+  mutable std::unique_ptr<std::mutex>ramtx_;             // protects read-ahead buffer
+  mutable std::unique_ptr<std::condition_variable>racond_;
+  std::deque<readahead_item>rabuf_;                      // messages read ahead
+  std::thread rathr_;                                    // read-ahead thread
+  std::atomic<bool>rastop_{false};                       // tells read-ahead thread to stop
 };
 }
 }
@@ -0,0 +1,208 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0.
+
+#ifndef __RPC_CLIENT_H__
+#define __RPC_CLIENT_H__
+#include "detail/serial_support.hpp"
+#include <boost/asio/error.hpp>
+#include <boost/system/system_error.hpp>
+#include <string>
+#include <utility>
+#include <functional>
+#include <future>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <cstdint>
+
+namespace boost{
+namespace asio{
+
+// message exchanged by rpc_client and rpc_serve
+// (id correlates a reply with its request - ids handed out by rpc_client start at 1)
+template<typename T>
+struct rpc_msg{
+  std::uint64_t id=0;                    // correlation id
+  T body{};                              // request or reply
+};
+// buffer serialiser for rpc_msg<T> wrapping a serialiser for T
+// (the id is written as decimal digits followed by a space so the message can be sent with any framing)
+template<typename T,typename SERIAL>
+class rpc_serial{
+public:
+  explicit rpc_serial(SERIAL serial):serial_(serial){}
+  void operator()(std::string&out,rpc_msg<T>const&msg)const{
+    out.append(std::to_string(msg.id));
+    out.push_back(' ');
+    detail::queue_support::serialiseAppend(out,msg.body,serial_);
+  }
+private:
+  SERIAL serial_;
+};
+// buffer de-serialiser for rpc_msg<T> wrapping a de-serialiser for T
+// (a message without a valid id gets id 0 - it is dropped by rpc_client)
+template<typename T,typename DESER>
+class rpc_deser{
+public:
+  explicit rpc_deser(DESER deser):deser_(deser){}
+  rpc_msg<T>operator()(char const*msg,std::size_t len)const{
+    rpc_msg<T>ret;
+    std::size_t i{0};
+    for(;i<len&&msg[i]>='0'&&msg[i]<='9';++i)ret.id=10*ret.id+(msg[i]-'0');
+    if(i==0||i==len||msg[i]!=' '){
+      ret.id=0;
+      return ret;
+    }
+    ret.body=detail::queue_support::deserialiseBuffer<T>(msg+i+1,len-i-1,deser_);
+    return ret;
+  }
+private:
+  DESER deser_;
+};
+// create serialiser/de-serialiser for rpc_msg<T>
+template<typename T,typename SERIAL>
+rpc_serial<T,SERIAL>make_rpc_serial(SERIAL serial){return rpc_serial<T,SERIAL>(serial);}
+template<typename T,typename DESER>
+rpc_deser<T,DESER>make_rpc_deser(DESER deser){return rpc_deser<T,DESER>(deser);}
+
+// client side of a request/reply channel over a single full duplex queue carrying rpc_msg<T>
+// (each request is stamped with a correlation id - any number of requests can be outstanding on the queue and a reply
+//  completes the handler or future of the request with the same id, in whatever order replies arrive)
+// (replies are read by a thread owned by the client - handlers are called from that thread and should not block)
+// (the queue must allow enq while another thread waits in deq - sockclient_queue does)
+// (if reading from the queue fails with an error other than a timeout, all outstanding requests complete with the error
+//  since their replies were lost with the connection)
+// (outstanding requests complete with operation_aborted when the client is destroyed)
+// (tmo_poll_ms (must be > 0) is the max time the reader thread waits in deq before checking if it should stop)
+// (the server side answers requests with rpc_serve)
+// (the class is thread safe)
+template<typename T,typename Queue>
+class rpc_client{
+public:
+  // handler called when a reply arrives
+  using handler_t=std::function<void(boost::system::error_code const&,T const&)>;
+
+  // ctor
+  explicit rpc_client(Queue&q,std::size_t tmo_poll_ms=100):q_(q),tmo_poll_ms_(tmo_poll_ms),stop_(false){
+    thr_=std::thread([this](){run();});
+  }
+  // copy/move/assign - for simplicity, delete them
+  rpc_client(rpc_client const&)=delete;
+  rpc_client(rpc_client&&)=delete;
+  rpc_client&operator=(rpc_client const&)=delete;
+  rpc_client&operator=(rpc_client&&)=delete;
+
+  // dtor
+  ~rpc_client(){
+    {
+      std::unique_lock<std::mutex>lock(mtx_);
+      stop_.store(true);
+      cond_.notify_all();
+    }
+    if(thr_.joinable())thr_.join();
+    fail(boost::asio::error::operation_aborted);
+  }
+  // send a request - 'h' is called when the reply arrives
+  // (returns false if the request could not be sent - the handler is then not called)
+  bool async_call(T req,handler_t h,boost::system::error_code&ec){
+    std::uint64_t id{++nextid_};
+    {
+      std::unique_lock<std::mutex>lock(mtx_);
+      pending_.insert(std::make_pair(id,std::move(h)));
+    }
+    if(q_.enq(rpc_msg<T>{id,std::move(req)},ec))return true;
+
+    // if the request was failed by the reader thread meanwhile, the handler has already been called
+    std::unique_lock<std::mutex>lock(mtx_);
+    return pending_.erase(id)==0;
+  }
+  // send a request - the future is ready when the reply arrives
+  // (errors are reported as boost::system::system_error exceptions from the future)
+  std::future<T>call(T req){
+    auto p=std::make_shared<std::promise<T>>();
+    std::future<T>ret{p->get_future()};
+    boost::system::error_code ec;
+    bool sent{async_call(std::move(req),[p](boost::system::error_code const&ec,T const&reply){
+        if(ec!=boost::system::error_code())p->set_exception(std::make_exception_ptr(boost::system::system_error(ec)));
+        else p->set_value(reply);
+      },ec)};
+    if(!sent)p->set_exception(std::make_exception_ptr(boost::system::system_error(ec)));
+    return ret;
+  }
+  // get #of outstanding requests
+  std::size_t pending()const{
+    std::unique_lock<std::mutex>lock(mtx_);
+    return pending_.size();
+  }
+private:
+  // read replies and complete requests
+  void run(){
+    while(!stop_.load()){
+      boost::system::error_code ec;
+      std::pair<bool,rpc_msg<T>>r{q_.timed_deq(tmo_poll_ms_,ec)};
+      if(r.first){
+        complete(r.second.id,r.second.body);
+        continue;
+      }
+      if(ec==boost::asio::error::timed_out)continue;
+
+      // connection lost - replies to outstanding requests will never arrive
+      // (wait before reading again so we don't spin while the queue is disconnected)
+      fail(ec);
+      std::unique_lock<std::mutex>lock(mtx_);
+      cond_.wait_for(lock,std::chrono::milliseconds(tmo_poll_ms_),[&](){return stop_.load();});
+    }
+  }
+  // complete request with reply
+  void complete(std::uint64_t id,T const&reply){
+    handler_t h;
+    {
+      std::unique_lock<std::mutex>lock(mtx_);
+      auto it=pending_.find(id);
+      if(it==pending_.end())return;
+      h=std::move(it->second);
+      pending_.erase(it);
+    }
+    h(boost::system::error_code(),reply);
+  }
+  // complete all outstanding requests with an error
+  void fail(boost::system::error_code const&ec){
+    std::unordered_map<std::uint64_t,handler_t>pending;
+    {
+      std::unique_lock<std::mutex>lock(mtx_);
+      pending.swap(pending_);
+    }
+    for(auto&p:pending)p.second(ec,T{});
+  }
+  // state
+  Queue&q_;                                              // queue carrying requests and replies
+  std::size_t const tmo_poll_ms_;                        // max time reader waits in deq
+  std::atomic<std::uint64_t>nextid_{0};                  // last id handed out
+  mutable std::mutex mtx_;                               // protects outstanding requests
+  std::condition_variable cond_;                         // used for waking up reader when stopping
+  std::unordered_map<std::uint64_t,handler_t>pending_;   // outstanding requests
+  std::atomic<bool>stop_;                                // when set to true, reader stops
+  std::thread thr_;                                      // reader thread
+};
+// serve requests arriving on a full duplex server queue carrying rpc_msg<T> - 'f' maps a request to a reply
+// (replies are stamped with the id of the request and enqueued on the same queue - with sockmserv_queue the reply is
+//  routed to the client which sent the request since requests are served one at a time)
+// (returns the error which stopped serving - deq or enq failed)
+template<typename T,typename Queue,typename F>
+boost::system::error_code rpc_serve(Queue&q,F f){
+  boost::system::error_code ec;
+  while(true){
+    std::pair<bool,rpc_msg<T>>r{q.deq(ec)};
+    if(!r.first)return ec;
+    if(!q.enq(rpc_msg<T>{r.second.id,f(r.second.body)},ec))return ec;
+  }
+}
+}
+}
+#endif
@@ -0,0 +1,152 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0.
+
+#ifndef __SOCK_CLIENT_POOL_QUEUE_H__
+#define __SOCK_CLIENT_POOL_QUEUE_H__
+#include "detail/queue_empty_base.hpp"
+#include "detail/fdqueue_support.hpp"
+#include "sockclient_queue.hpp"
+#include <boost/asio/error.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+
+namespace boost{
+namespace asio{
+
+// policy for selecting the connection a message is sent on in a sockclient_pool_queue
+// (round_robin:   connections are used in turn)
+// (least_backlog: the connection with the fewest enq calls in progress is used)
+enum class sockclient_pool_policy:int{round_robin=0,least_backlog=1};
+
+// a socket based client queue sending messages to a server over a pool of connections
+// (each connection is a sockclient_queue with its own socket and lock so a slow write on one connection does not
+//  stall threads enqueueing on the other connections)
+// (connections are established on first use and re-established when they fail - a message which fails on one
+//  connection is retried on the other connections, so a message may be delivered twice if a connection failed
+//  after the message was written - as with any TCP connection, messages written just before the server went away
+//  may also be lost without an error)
+// (messages sent on different connections may arrive in any order)
+// (the pool is a send side queue - replies from the server are not read)
+// (the tmo in ms is based on message timeout - see sockclient_queue)
+// (the queue is thread safe)
+template<typename T,typename DESER,typename SERIAL,typename Base=detail::base::queue_empty_base<T>,typename Framing=sep_framing>
+class sockclient_pool_queue:public Base{
+public:
+  // default message separaor
+  constexpr static char NEWLINE='\n';
+
+  // type of a connection
+  using conn_t=sockclient_queue<T,DESER,SERIAL,detail::base::queue_empty_base<T>,Framing>;
+
+  // ctor
+  sockclient_pool_queue(std::string const&serverName,int port,DESER deser,SERIAL serial,std::size_t nconn,
+                        sockclient_pool_policy policy=sockclient_pool_policy::round_robin,char sep=NEWLINE,cork_options const&cork=cork_options{},
+                        reconnect_options const&reconnect=reconnect_options{},socket_options const&sockopts=socket_options{}):
+      sockclient_pool_queue(serverName,port,deser,serial,nconn,policy,detail::queue_support::makeFraming<Framing>(sep),cork,reconnect,sockopts){
+  }
+  sockclient_pool_queue(std::string const&serverName,int port,DESER deser,SERIAL serial,std::size_t nconn,
+                        sockclient_pool_policy policy,Framing const&framing,cork_options const&cork=cork_options{},
+                        reconnect_options const&reconnect=reconnect_options{},socket_options const&sockopts=socket_options{}):
+      policy_(policy),nconn_(std::max<std::size_t>(nconn,1)),inflight_(new std::atomic<std::size_t>[nconn_]){
+    for(std::size_t i=0;i<nconn_;++i){
+      conns_.push_back(std::make_unique<conn_t>(serverName,port,deser,serial,framing,cork,reconnect,sockopts));
+      inflight_[i].store(0);
+    }
+  }
+  // copy/move/assign - for simplicity, delete them
+  sockclient_pool_queue(sockclient_pool_queue const&)=delete;
+  sockclient_pool_queue(sockclient_pool_queue&&)=delete;
+  sockclient_pool_queue&operator=(sockclient_pool_queue const&)=delete;
+  sockclient_pool_queue&operator=(sockclient_pool_queue&&)=delete;
+  ~sockclient_pool_queue()=default;
+
+  // enqueue a message
+  bool enq(T t,boost::system::error_code&ec){
+    return enqAux(t,0,false,ec);
+  }
+  // enqueue a message - timeout if waiting too long
+  bool timed_enq(T t,std::size_t ms,boost::system::error_code&ec){
+    return enqAux(t,ms,true,ec);
+  }
+  // wait until we can send a message on some connection
+  bool wait_enq(boost::system::error_code&ec){
+    std::size_t i{select()};
+    Guard g(inflight_[i]);
+    return conns_[i]->wait_enq(ec);
+  }
+  // wait until we can send a message on some connection - timeout if waiting too long
+  bool timed_wait_enq(std::size_t ms,boost::system::error_code&ec){
+    std::size_t i{select()};
+    Guard g(inflight_[i]);
+    return conns_[i]->timed_wait_enq(ms,ec);
+  }
+  // write buffered messages on all connections (no-op if corking is not configured)
+  // (returns false if some connection failed - error code is from the first failure)
+  bool flush(boost::system::error_code&ec){
+    ec=boost::system::error_code();
+    for(auto&c:conns_){
+      boost::system::error_code ec1;
+      if(!c->flush(ec1)&&ec==boost::system::error_code())ec=ec1;
+    }
+    return ec==boost::system::error_code();
+  }
+  // cancel enq operations
+  void disable_enq(bool disable){
+    for(auto&c:conns_)c->disable_enq(disable);
+  }
+  // get #of connections
+  std::size_t size()const{return nconn_;}
+private:
+  // keep track of #of enq calls in progress on a connection
+  struct Guard{
+    explicit Guard(std::atomic<std::size_t>&cnt):cnt_(cnt){++cnt_;}
+    ~Guard(){--cnt_;}
+    std::atomic<std::size_t>&cnt_;
+  };
+  // select connection to use
+  std::size_t select(){
+    std::size_t start{next_.fetch_add(1)%nconn_};
+    if(policy_==sockclient_pool_policy::round_robin)return start;
+
+    // least backlog - start scanning at a rotating position so ties are spread across connections
+    std::size_t ret{start};
+    std::size_t min{inflight_[start].load()};
+    for(std::size_t k=1;k<nconn_&&min>0;++k){
+      std::size_t i{(start+k)%nconn_};
+      std::size_t n{inflight_[i].load()};
+      if(n<min){
+        min=n;
+        ret=i;
+      }
+    }
+    return ret;
+  }
+  // send message - retry on the other connections if a connection fails
+  bool enqAux(T const&t,std::size_t ms,bool timed,boost::system::error_code&ec){
+    std::size_t i{select()};
+    for(std::size_t attempt=0;attempt<nconn_;++attempt){
+      {
+        Guard g(inflight_[i]);
+        bool ret{timed?conns_[i]->timed_enq(t,ms,ec):conns_[i]->enq(t,ec)};
+        if(ret)return true;
+      }
+      // timeout, disabled queue and a message too large for the framing are not connection failures
+      if(ec==boost::asio::error::timed_out||ec==boost::asio::error::operation_aborted||ec==boost::asio::error::message_size)return false;
+      i=(i+1)%nconn_;
+    }
+    return false;
+  }
+  // state
+  sockclient_pool_policy const policy_;                  // policy for selecting connection
+  std::size_t const nconn_;                              // #of connections
+  std::vector<std::unique_ptr<conn_t>>conns_;            // connections
+  std::unique_ptr<std::atomic<std::size_t>[]>inflight_;  // #of enq calls in progress per connection
+  std::atomic<std::size_t>next_{0};                      // next connection to start selecting from
+};
+}
+}
+#endif
@@ -4,7 +4,6 @@
 /* TODO
 IMPROVEMENTS:
 	- we should have two timeouts, message timeout, byte timeout
-	- read/write more than one character at a time ... must then buffer what we have read
 
 TESTING:
 	- test with serializing real object and base64 encode them
@@ -15,12 +14,16 @@ TESTING:
 #include "detail/queue_empty_base.hpp"
 #include "detail/queue_support.hpp"
 #include "detail/fdqueue_support.hpp"
+#include "detail/sockqueue_support.hpp"
 #include <string>
 #include <utility>
 #include <iostream>
 #include <string>
 #include <mutex>
 #include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
 #include <string.h>
 
 // socket stuff
@@ -34,34 +37,65 @@ TESTING:
 namespace boost{
 namespace asio{
 
+// options for connecting a client queue to a server
+// (connect_tmo_ms: max time in ms a connect may take - the timeout of timed_* calls is used if shorter - 0 means no limit)
+// (after a failed connect no new attempt is made for backoff ms - calls made meanwhile fail immediately with the error from
+//  the failed attempt - the backoff starts at backoff_min_ms and is doubled after each failure up to backoff_max_ms)
+struct reconnect_options{
+  std::size_t connect_tmo_ms=5000;       // max time for connecting
+  std::size_t backoff_min_ms=10;         // backoff after first failure
+  std::size_t backoff_max_ms=5000;       // max backoff
+};
+
 // a socket based client queue connecting to a server - full duplex queue - only 1 client can connect to the server
-// (if sending objects first serialise the object, the base64 encode it in the serialiser)
+// (if sending binary objects with separator framing, base64 encode them in the serialiser - or use varint_framing/fixed_framing)
+// (serialisers/de-serialisers are either stream or buffer based - see detail/serial_support.hpp)
 // (the tmo in ms is based on message timeout - if no message starts arriving within timeout, the function times out)
 // (ones we have started to read a message, the message will never timeout)
-// (the class is meant to be used in singele threaded mode and is not thread safe)
-template<typename T,typename DESER,typename SERIAL,typename Base=detail::base::queue_empty_base<T>>
+// (messages are separated by '\n' or framed by a length header - see Framing)
+// (bytes are read in chunks - bytes read past the end of a message are buffered and used for the next message)
+// (if corking is configured messages are buffered and written in batches - see cork_options - flush() writes buffered messages)
+// (the server name is resolved with getaddrinfo() and cached - connecting is non-blocking and bounded by the timeout of
+//  timed_* calls and by reconnect_options - after a failed connect, calls fail immediately until the backoff has expired)
+// (a queue constructed from a unix_endpoint connects to a unix domain socket server queue on the same host)
+// (a deq call waits for data without holding the lock of the queue so one thread can enq while another thread is waiting
+//  in deq - for example when replies are read by a separate thread, see rpc_client - other than that, the class is meant
+//  to be used in singele threaded mode)
+template<typename T,typename DESER,typename SERIAL,typename Base=detail::base::queue_empty_base<T>,typename Framing=sep_framing>
 class sockclient_queue:public Base{
 public:
   // default message separaor
   constexpr static char NEWLINE='\n';
 
   // ctor
-  sockclient_queue(std::string const&serverName,int port,DESER deser,SERIAL serial,char sep=NEWLINE):
-      serverName_(serverName),port_(port),deser_(deser),serial_(serial),sep_{sep},closeOnExit_(true),mtx_{std::make_unique<std::mutex>()}{
-    // create socket
-    createSocket();
+  sockclient_queue(std::string const&serverName,int port,DESER deser,SERIAL serial,char sep=NEWLINE,cork_options const&cork=cork_options{},
+                   reconnect_options const&reconnect=reconnect_options{},socket_options const&sockopts=socket_options{}):
+      sockclient_queue(serverName,port,deser,serial,detail::queue_support::makeFraming<Framing>(sep),cork,reconnect,sockopts){
+  }
+  sockclient_queue(std::string const&serverName,int port,DESER deser,SERIAL serial,Framing const&framing,cork_options const&cork=cork_options{},
+                   reconnect_options const&reconnect=reconnect_options{},socket_options const&sockopts=socket_options{}):
+      sockclient_queue(serverName,port,nullptr,deser,serial,framing,cork,reconnect,sockopts){
+  }
+  sockclient_queue(unix_endpoint const&ep,DESER deser,SERIAL serial,char sep=NEWLINE,cork_options const&cork=cork_options{},
+                   reconnect_options const&reconnect=reconnect_options{},socket_options const&sockopts=socket_options{}):
+      sockclient_queue(ep,deser,serial,detail::queue_support::makeFraming<Framing>(sep),cork,reconnect,sockopts){
+  }
+  sockclient_queue(unix_endpoint const&ep,DESER deser,SERIAL serial,Framing const&framing,cork_options const&cork=cork_options{},
+                   reconnect_options const&reconnect=reconnect_options{},socket_options const&sockopts=socket_options{}):
+      sockclient_queue(ep.path,0,&ep,deser,serial,framing,cork,reconnect,sockopts){
   }
   // copy ctor
   sockclient_queue(sockclient_queue const&)=delete;
 
   // move ctor
   sockclient_queue(sockclient_queue&&other):
-      serverName_(other.serverName_),port_(other.port_),deser_(std::move(other.deser_)),serial_(std::move(other.serial_)),sep_(other.sep_),
-      clientsocket_(other.clientsocket_),yes_(other.yes_),closeOnExit_(other.closeOnExit_),server_(other.server_),
-      mtx_(std::move(other.mtx_)),deq_enabled_(other.deq_enabled_),enq_enabled_(other.enq_enabled_)
+      state_(other.state_),serverName_(other.serverName_),port_(other.port_),local_(other.local_),localaddr_(other.localaddr_),deser_(std::move(other.deser_)),
+      serial_(std::move(other.serial_)),framing_(other.framing_),sockopts_(other.sockopts_),clientsocket_(other.clientsocket_),conn_(other.conn_),closeOnExit_(other.closeOnExit_),
+      reconnect_(other.reconnect_),backoff_ms_(other.backoff_ms_),retry_at_(other.retry_at_),last_err_(other.last_err_),
+      mtx_(std::move(other.mtx_)),deq_enabled_(other.deq_enabled_),enq_enabled_(other.enq_enabled_),rbuf_(std::move(other.rbuf_)),
+      cork_(std::move(other.cork_))
   {
     other.closeOnExit_=false; // make sure we don't close twice
-    memcpy(static_cast<void*>(&servaddr_),static_cast<void*>(&other.servaddr_),sizeof(servaddr_));
   }
   // assign
   sockclient_queue&operator=(sockclient_queue const&)=delete;
@@ -70,28 +104,36 @@ public:
   sockclient_queue&operator=(sockclient_queue&&other){
     serverName_=other.serverName_;
     port_=other.port_;
+    local_=other.local_;
+    localaddr_=other.localaddr_;
     deser_=std::move(other.deser_);
     serial_=std::move(other.serial_);
-    sep_=other.sep_;
+    framing_=other.framing_;
+    sockopts_=other.sockopts_;
+    state_=other.state_;
     clientsocket_=other.clientsocket_;
-    yes_=other.yes_;
+    conn_=other.conn_;
     closeOnExit_=other.closeOnExit_;
-    server_=other.server_;
     other.closeOnExit_=false; // make sure we don't close twice
-    memcpy(static_cast<void*>(&servaddr_),static_cast<void*>(&other.servaddr_),sizeof(servaddr_));
+    reconnect_=other.reconnect_;
+    backoff_ms_=other.backoff_ms_;
+    retry_at_=other.retry_at_;
+    last_err_=other.last_err_;
     mtx_=std::move(other.mtx_);
     deq_enabled_=other.deq_enabled_;
     enq_enabled_=other.enq_enabled_;
+    rbuf_=std::move(other.rbuf_);
+    cork_=std::move(other.cork_);
     return*this;
   }
   // dtor
   ~sockclient_queue(){
-    if(closeOnExit_){
-      if(state_!=IDLE){
-        if(state_==CONNECTED)detail::queue_support::eclose(clientsocket_,false);
-        detail::queue_support::eclose(clientsocket_,false);
-      }
+    // write buffered messages before closing socket
+    if(cork_&&state_==CONNECTED){
+      boost::system::error_code ec;
+      cork_->flush(ec);
     }
+    if(closeOnExit_&&clientsocket_>=0)detail::queue_support::eclose(clientsocket_,false);
   }
   // dequeue a message (return.first == false if deq() was disabled)
   std::pair<bool,T>deq(boost::system::error_code&ec){
@@ -101,7 +143,7 @@ public:
       ec=boost::asio::error::operation_aborted;
       return std::make_pair(false,T{});
     }
-    return deqAux(0,ec,true);
+    return deqAux(lock,0,ec,true);
   }
   // dequeue a message (return.first == false if deq() was disabled) - timeout if waiting too long
   std::pair<bool,T>timed_deq(std::size_t ms,boost::system::error_code&ec){
@@ -111,7 +153,7 @@ public:
       ec=boost::asio::error::operation_aborted;
       return std::make_pair(false,T{});
     }
-    return deqAux(ms,ec,true);
+    return deqAux(lock,ms,ec,true);
   }
   // wait until we can retrieve a message from queue
   bool wait_deq(boost::system::error_code&ec){
@@ -121,7 +163,7 @@ public:
       ec=boost::asio::error::operation_aborted;
       return false;
     }
-    deqAux(0,ec,false);
+    deqAux(lock,0,ec,false);
     if(ec.value()!=0)return false;
     return true;
   }
@@ -133,7 +175,7 @@ public:
       ec=boost::asio::error::operation_aborted;
       return false;
     }
-    deqAux(ms,ec,false);
+    deqAux(lock,ms,ec,false);
     if(ec==boost::asio::error::timed_out)return false;
     if(ec.value()!=0)return false;
     return true;
@@ -174,6 +216,15 @@ public:
     }
     return enqAux(nullptr,ms,ec,false);
   }
+  // write buffered messages (no-op if corking is not configured)
+  bool flush(boost::system::error_code&ec){
+    std::unique_lock<std::mutex>lock(*mtx_);
+    ec=boost::system::error_code();
+    if(!cork_||state_!=CONNECTED)return true;
+    if(cork_->flush(ec))return true;
+    disconnect();
+    return false;
+  }
   // cancel deq operations
   void disable_deq(bool disable){
     std::unique_lock<std::mutex>lock(*mtx_);
@@ -188,27 +239,44 @@ private:
   // --------------------------------- state management functions
   // (all state is managed here)
   // dequeue a message (return.first == false if deq() was disabled)
-  std::pair<bool,T>deqAux(std::size_t ms,boost::system::error_code&ec,bool getMsg){
+  // (the lock is released while waiting for data if there are no buffered bytes)
+  std::pair<bool,T>deqAux(std::unique_lock<std::mutex>&lock,std::size_t ms,boost::system::error_code&ec,bool getMsg){
     boost::system::error_code ec1;
 
     // if we are in IDLE state it means we are disconnected
     if(state_==IDLE){
-      connect2server(ec1);
+      connect2server(ms,ec1);
       if(ec1!=boost::system::error_code()){
-        if(ec1!=boost::asio::error::timed_out)detail::queue_support::eclose(clientsocket_,false);
         ec=ec1;
         return std::make_pair(false,T{});
       }
       state_=CONNECTED;
     }
+    // client connected - wait for data without holding lock
+    // (if the connection was dropped by another thread while we were waiting, we fail)
+    if(state_==CONNECTED&&rbuf_.size()==0){
+      int fd{clientsocket_};
+      std::uint64_t conn{conn_};
+      lock.unlock();
+      bool ready{detail::queue_support::waitReady(fd,POLLIN,ms,ec1)};
+      lock.lock();
+      if(conn!=conn_||state_!=CONNECTED){
+        ec=boost::asio::error::connection_reset;
+        return std::make_pair(false,T{});
+      }
+      if(!ready){
+        if(ec1!=boost::asio::error::timed_out)disconnect();
+        ec=ec1;
+        return std::make_pair(false,T{});
+      }
+    }
     // client connected - read message
     if(state_==CONNECTED){
       state_=READING;
-      T ret{detail::queue_support::recvwait<T,DESER>(clientsocket_,ms,ec1,getMsg,sep_,deser_)};
+      T ret{detail::queue_support::recvwait<T,DESER>(clientsocket_,rbuf_,ms,ec1,getMsg,framing_,deser_)};
       if(ec1!=boost::system::error_code()){
         if(ec1!=boost::asio::error::timed_out){
-          detail::queue_support::eclose(clientsocket_,false);
-          state_=IDLE;
+          disconnect();
         }else{
           state_=CONNECTED;
         }
@@ -216,7 +284,7 @@ private:
         return std::make_pair(false,T{});
       }
       state_=CONNECTED;
-      return make_pair(true,ret);
+      return std::make_pair(true,ret);
     }
     // dummy return - will never reach here
     return std::make_pair(false,T{});
@@ -225,11 +293,16 @@ private:
   bool enqAux(T const*t,std::size_t ms,boost::system::error_code&ec,bool sendMsg){
     boost::system::error_code ec1;
 
+    // serialise message up front so a message too large for the framing is rejected without touching the connection
+    std::string msg;
+    if(sendMsg){
+      msg=detail::queue_support::serialise(*t,framing_,serial_,ec);
+      if(ec!=boost::system::error_code())return false;
+    }
     // wait for client connection if needed
     if(state_==IDLE){
-      connect2server(ec1);
+      connect2server(ms,ec1);
       if(ec1!=boost::system::error_code()){
-        if(ec1!=boost::asio::error::timed_out)detail::queue_support::eclose(clientsocket_,false);
         ec=ec1;
         return false;
       }
@@ -237,12 +310,16 @@ private:
     }
     // client connected - write message
     if(state_==CONNECTED){
-      detail::queue_support::sendwait<T,SERIAL>(clientsocket_,t,0,ec1,sendMsg,sep_,serial_);
+      if(!sendMsg)detail::queue_support::waitWritable(clientsocket_,0,ec1);
+      else if(cork_)cork_->enq(clientsocket_,std::move(msg),0,ec1);
+      else{
+        std::vector<struct iovec>iov{{const_cast<char*>(msg.data()),msg.size()}};
+        detail::queue_support::writeBuffers(clientsocket_,iov,0,ec1,true,maxrec());
+      }
       state_=WRITING;
       if(ec1!=boost::system::error_code()&&ec1!=boost::asio::error::timed_out){
         if(ec1!=boost::asio::error::timed_out){
-          detail::queue_support::eclose(clientsocket_,false);
-          state_=IDLE;
+          disconnect();
         }else{
           state_=CONNECTED;
         }
@@ -255,41 +332,77 @@ private:
     // dummy return - will never reach here
     return false;
   }
+  // close connection to server
+  // (buffered messages are dropped - a new socket is created when we reconnect)
+  void disconnect(){
+    if(cork_)cork_->reset();
+    closeSocket();
+    state_=IDLE;
+    rbuf_.clear();
+  }
   // --------------------------------- helper functions
   // (no state is managed here)
-  // create socket to connect to server with (throws exception if failure)
-  void createSocket(){
-    // we must be in state IDLE to be here
-    assert(state_==IDLE);
-
-    // get socket 
-    if((clientsocket_=socket(AF_INET,SOCK_STREAM,0))==-1){
-      throw std::runtime_error(std::string("sockclient_queue::connect2Server: failed creating socket, errno: ")+boost::lexical_cast<std::string>(errno));
-    }
-    // set socket options 
-    if(setsockopt(clientsocket_,SOL_SOCKET,SO_REUSEADDR,&yes_,sizeof(int))==-1){
-      throw std::runtime_error(std::string("sockclient_queue::connect2Server: failed setting socket options, errno: ")+boost::lexical_cast<std::string>(errno));
+  // ctor (ep != nullptr if connecting to a unix domain socket)
+  sockclient_queue(std::string const&serverName,int port,unix_endpoint const*ep,DESER deser,SERIAL serial,Framing const&framing,cork_options const&cork,
+                   reconnect_options const&reconnect,socket_options const&sockopts):
+      serverName_(serverName),port_(port),local_(ep!=nullptr),deser_(deser),serial_(serial),framing_(framing),sockopts_(sockopts),closeOnExit_(true),
+      reconnect_(reconnect),backoff_ms_(reconnect.backoff_min_ms),mtx_{std::make_unique<std::mutex>()}{
+    // get unix domain address or check that we can resolve server name
+    if(local_){
+      localaddr_=detail::sockqueue_support::unixAddress(*ep);
+      rbuf_.records(localaddr_.type==SOCK_SEQPACKET);
+    }else{
+      resolve();
     }
-    // get server host
-    server_=gethostbyname(serverName_.c_str());
-    if (server_==NULL) {
-      throw std::runtime_error(std::string("sockclient_queue::connect2Server: failed converting ")+
-                               serverName_+" to hostname, errno: "+boost::lexical_cast<std::string>(errno));
+    if(cork.max_bytes>0||cork.max_delay_us>0)cork_=std::make_unique<detail::queue_support::fdcork>(cork,true,maxrec());
+  }
+  // resolve server name (throws exception if failure)
+  void resolve(){
+    boost::system::error_code ec;
+    detail::sockqueue_support::resolver_cache::instance().resolve(serverName_,port_,ec);
+    if(ec!=boost::system::error_code()){
+      throw std::runtime_error(std::string("sockclient_queue::resolve: failed converting ")+serverName_+" to address: "+ec.message());
     }
-    // setup addresses so we can connect later
-    bzero((char *)&servaddr_,sizeof(servaddr_));
-    servaddr_.sin_family=AF_INET;
-    bcopy((char *)server_->h_addr,(char*)&servaddr_.sin_addr.s_addr,server_->h_length);
-    servaddr_.sin_port=htons(port_);
   }
-  // connect to server
-  void connect2server(boost::system::error_code&ec){
-    // connect to server
-    ec=boost::system::error_code();
-    if(connect(clientsocket_,(const struct sockaddr*)&servaddr_,sizeof(servaddr_))<0) {
-      ec=boost::system::error_code(errno,boost::system::get_posix_category());
+  // get max #of bytes in one write (only limited for record based sockets)
+  std::size_t maxrec()const{
+    return localaddr_.type==SOCK_SEQPACKET?static_cast<std::size_t>(detail::queue_support::fdreadbuf::CHUNK):0;
+  }
+  // close socket
+  void closeSocket(){
+    if(clientsocket_>=0)detail::queue_support::eclose(clientsocket_,false);
+    clientsocket_=-1;
+  }
+  // connect to server - timeout after 'ms' ms (if ms == 0 only the connect timeout in reconnect_options is used)
+  // (a new non-blocking socket is created for each attempt and each resolved address is tried in turn)
+  // (if we are backing off after a failed attempt we fail immediately with the error from the failed attempt)
+  void connect2server(std::size_t ms,boost::system::error_code&ec){
+    auto now=std::chrono::steady_clock::now();
+    if(now<retry_at_){
+      ec=last_err_;
+      return;
     }
-    state_=CONNECTED;
+    std::size_t tmo{reconnect_.connect_tmo_ms};
+    if(ms>0&&(tmo==0||ms<tmo))tmo=ms;
+    auto&resolver(detail::sockqueue_support::resolver_cache::instance());
+    std::vector<detail::sockqueue_support::sockaddr_entry>addrs;
+    if(local_)addrs.push_back(localaddr_);
+    else addrs=resolver.resolve(serverName_,port_,ec);
+    for(auto const&addr:addrs){
+      clientsocket_=detail::sockqueue_support::connectSocket(addr,sockopts_,tmo,ec);
+      if(clientsocket_>=0){
+        backoff_ms_=reconnect_.backoff_min_ms;
+        retry_at_=std::chrono::steady_clock::time_point();
+        state_=CONNECTED;
+        ++conn_;
+        return;
+      }
+    }
+    // connect failed - resolve name again on next attempt and back off
+    if(!local_)resolver.invalidate(serverName_,port_);
+    last_err_=ec;
+    retry_at_=std::chrono::steady_clock::now()+std::chrono::milliseconds(static_cast<long long>(backoff_ms_));
+    backoff_ms_=std::min(2*backoff_ms_,std::max(reconnect_.backoff_max_ms,reconnect_.backoff_min_ms));
   }
   // --------------------------------- private attributes
   // state object is in
@@ -299,18 +412,27 @@ private:
   // server socket stuff
   std::string serverName_;               // server to connect to as a name
   int port_;                             // port to listen on
+  bool local_;                           // connect to a unix domain socket
+  detail::sockqueue_support::sockaddr_entry localaddr_{}; // address of unix domain socket
   DESER deser_;                          // de-serialiser
   SERIAL serial_;                        // serialiser
-  char sep_;                             // message separator
-  int clientsocket_=-1;                    // socket used by client
-  struct sockaddr_in servaddr_;          // server address
-  int yes_=1;                            // used for setting socket options
+  Framing framing_;                      // message framing
+  socket_options sockopts_;              // options set on socket
+  int clientsocket_=-1;                  // socket used by client
+  std::uint64_t conn_=0;                 // incremented each time we connect
   bool closeOnExit_;                     // close fd on exit (if we have been moved we don;t close)
-  struct hostent*server_;                // server when converting name to host
+
+  // reconnect stuff
+  reconnect_options reconnect_;                          // how to connect
+  std::size_t backoff_ms_;                               // time to wait after next failed connect
+  std::chrono::steady_clock::time_point retry_at_;       // no connect attempts before this time
+  boost::system::error_code last_err_;                   // error from last failed connect
 
   mutable std::unique_ptr<std::mutex>mtx_;                  // must be pointer since not movable
   bool deq_enabled_=true;
   bool enq_enabled_=true;
+  detail::queue_support::fdreadbuf rbuf_;                   // bytes read from client socket but not yet dequeued
+  std::unique_ptr<detail::queue_support::fdcork>cork_;      // buffers messages if corking is configured
 };
 }
 }
@@ -14,6 +14,8 @@
 #include <mutex>
 #include <algorithm>
 #include <atomic>
+#include <vector>
+#include <queue>
 #include <string.h>
 
 // socket stuff
@@ -32,22 +34,43 @@ namespace asio{
   Ones constructed the server queue runs a separate thread accepting and reading data from clients.
   The thread terminates when the destructor is executed.
   Currently there are no methods for stopping/starting the queue - even though it should not be difficult to implement
+  Messages are separated by a separator character or framed by a length header - see Framing.
+  With nthreads > 1 the queue runs nthreads reactor threads, each with its own listening socket bound to the same port
+  using SO_REUSEPORT (the kernel spreads connections across the listeners), its own epoll set and its own de-serialisation.
+  Messages read from one client in one go are de-serialised outside the lock and pushed to the shared queue in one batch.
+  With nthreads > 1 the de-serialiser is called concurrently from several threads.
+  The de-serialiser is either stream or buffer based - see detail/serial_support.hpp.
+  A queue constructed from a unix_endpoint listens on a unix domain socket and always runs a single reactor thread.
+  Reactor threads read with epoll or, if sockopts.engine is io_engine::uring and the kernel supports it, with io_uring.
+  The queue is unbounded unless a max size is set with set_maxsize. When the queue is full a reactor thread waits for deq
+  to free space before queuing more messages - while it waits it does not read from its client sockets, so the socket
+  buffers fill up and TCP flow control pushes back on the senders. Reading resumes when space is freed.
 
   The queue is not designed/implemented in a very clever way - it's more of a brute firce implementation
   Possibly the design and implementation should be re-thought.
 */
-template<typename T,typename DESER,typename Base=detail::base::queue_empty_base<T>,typename Container=std::queue<T>>
+template<typename T,typename DESER,typename Base=detail::base::queue_empty_base<T>,typename Container=std::queue<T>,typename Framing=sep_framing>
 class sockdeq_serv_queue:public Base{
 public:
   // default message separaor
   constexpr static char NEWLINE='\n';
 
   // ctor
-  sockdeq_serv_queue(int port,DESER deser,std::size_t maxclients,std::size_t tmo_poll_ms,char sep=NEWLINE):
-      port_(port),deser_(deser),maxclients_(maxclients),tmo_poll_ms_(tmo_poll_ms),sep_{sep},
-      mtx_{std::make_unique<std::mutex>()},cond_{std::make_unique<std::condition_variable>()},stop_server_(false){
-    // spawn thread running socket io stuff
-    serv_thr_=std::move(std::thread([&](){run_sock_serv();}));
+  sockdeq_serv_queue(int port,DESER deser,std::size_t maxclients,std::size_t tmo_poll_ms,char sep=NEWLINE,std::size_t nthreads=1,
+                     socket_options const&sockopts=socket_options{}):
+      sockdeq_serv_queue(port,deser,maxclients,tmo_poll_ms,detail::queue_support::makeFraming<Framing>(sep),nthreads,sockopts){
+  }
+  sockdeq_serv_queue(int port,DESER deser,std::size_t maxclients,std::size_t tmo_poll_ms,Framing const&framing,std::size_t nthreads=1,
+                     socket_options const&sockopts=socket_options{}):
+      sockdeq_serv_queue(port,nullptr,deser,maxclients,tmo_poll_ms,framing,nthreads,sockopts){
+  }
+  sockdeq_serv_queue(unix_endpoint const&ep,DESER deser,std::size_t maxclients,std::size_t tmo_poll_ms,char sep=NEWLINE,
+                     socket_options const&sockopts=socket_options{}):
+      sockdeq_serv_queue(ep,deser,maxclients,tmo_poll_ms,detail::queue_support::makeFraming<Framing>(sep),sockopts){
+  }
+  sockdeq_serv_queue(unix_endpoint const&ep,DESER deser,std::size_t maxclients,std::size_t tmo_poll_ms,Framing const&framing,
+                     socket_options const&sockopts=socket_options{}):
+      sockdeq_serv_queue(0,&ep,deser,maxclients,tmo_poll_ms,framing,1,sockopts){
   }
   // copy/move/assign - for simplicity, delete them
   sockdeq_serv_queue(sockdeq_serv_queue const&)=delete;
@@ -57,10 +80,15 @@ public:
 
   // ctor
   ~sockdeq_serv_queue(){
-    // flag to stop server loop and wait for server to stop, then close server socket
-    stop_server_.store(true);
-    if(serv_thr_.joinable())serv_thr_.join();
-    detail::queue_support::eclose(servsocket_,false);
+    // flag to stop server loops and wait for servers to stop, then close server sockets
+    {
+      std::unique_lock<std::mutex>lock(*mtx_);
+      stop_server_.store(true);
+      cond_->notify_all();
+    }
+    for(auto&thr:serv_thrs_)if(thr.joinable())thr.join();
+    for(int fd:servsockets_)detail::queue_support::eclose(fd,false);
+    if(!path_.empty())::unlink(path_.c_str());
   }
   // dequeue a message
   std::pair<bool,T>deq(boost::system::error_code&ec){
@@ -134,41 +162,97 @@ public:
     deq_enabled_=!disable;
     cond_->notify_all();
   }
+  // set max size of queue (0: no max size)
+  void set_maxsize(std::size_t maxsize){
+    std::unique_lock<std::mutex>lock(*mtx_);
+    maxsize_=maxsize;
+    cond_->notify_all();
+  }
+  // get max size of queue (0: no max size)
+  std::size_t maxsize()const{
+    std::unique_lock<std::mutex>lock(*mtx_);
+    return maxsize_;
+  }
+  // get #of items in queue
+  std::size_t size()const{
+    std::unique_lock<std::mutex>lock(*mtx_);
+    return q_.size();
+  }
 private:
   // --------------------------------- private helper functions
 
-  // callback function creating an object from an istream
-  void createItem(std::istream&is){
+  // ctor (ep != nullptr if listening on a unix domain socket)
+  sockdeq_serv_queue(int port,unix_endpoint const*ep,DESER deser,std::size_t maxclients,std::size_t tmo_poll_ms,Framing const&framing,
+                     std::size_t nthreads,socket_options const&sockopts):
+      port_(port),deser_(deser),maxclients_(maxclients),tmo_poll_ms_(tmo_poll_ms),framing_(framing),sockopts_(sockopts),
+      mtx_{std::make_unique<std::mutex>()},cond_{std::make_unique<std::condition_variable>()},stop_server_(false){
+    // create listening sockets (server sockets) - one per reactor thread
+    // (all sockets are created before any thread starts so that a failure is reported from the ctor)
+    nthreads=std::max<std::size_t>(nthreads,1);
+    if(ep!=nullptr){
+      servsockets_.push_back(detail::sockqueue_support::createUnixListenSocket(*ep,maxclients_,sockopts_));
+      path_=ep->path;
+    }else{
+      try{
+        for(std::size_t i=0;i<nthreads;++i){
+          servsockets_.push_back(detail::sockqueue_support::createListenSocket(port_,serveraddr_,maxclients_,sockopts_,nthreads>1));
+        }
+      }
+      catch(...){
+        for(int fd:servsockets_)detail::queue_support::eclose(fd,false);
+        throw;
+      }
+    }
+    // spawn threads running socket io stuff
+    for(int fd:servsockets_)serv_thrs_.emplace_back([this,fd](){run_sock_serv(fd);});
+  }
+
+  // callback function creating objects from a batch of messages
+  // (objects are de-serialised without holding the lock and queued in one go)
+  // (if the queue is full we wait for space - the reactor does not read from its clients while waiting)
+  // (messages not yet queued when the server is stopped are dropped)
+  void createItems(std::vector<std::pair<char const*,std::size_t>>const&msgs,std::vector<T>&items){
+    items.clear();
+    for(auto const&m:msgs)items.push_back(detail::queue_support::deserialiseBuffer<T>(m.first,m.second,deser_));
     std::unique_lock<std::mutex>lock(*mtx_);
-    q_.push(deser_(is));
+    for(auto&item:items){
+      if(maxsize_>0&&q_.size()>=maxsize_){
+        // wake up dequeuers for what we have queued so far before waiting for space
+        cond_->notify_all();
+        cond_->wait(lock,[&](){return stop_server_.load()||maxsize_==0||q_.size()<maxsize_;});
+        if(stop_server_.load())return;
+      }
+      q_.push(std::move(item));
+    }
     cond_->notify_all();
   }
-  // function running select loop
-  void run_sock_serv(){
-    // create listening socket (server socket)
-    servsocket_=detail::sockqueue_support::createListenSocket(port_,serveraddr_,maxclients_,&yes_);
-
+  // function running event loop of one reactor thread
+  void run_sock_serv(int servsocket){
     // accept client connections and dequeue messages
-    detail::sockqueue_support::acceptClientsAndDequeue(servsocket_,sep_,tmo_poll_ms_,stop_server_,[&](std::istream&is){createItem(is);});
+    std::vector<T>items;
+    detail::sockqueue_support::acceptClientsAndDequeue(servsocket,framing_,sockopts_,tmo_poll_ms_,stop_server_,
+      [&](std::vector<std::pair<char const*,std::size_t>>const&msgs){createItems(msgs,items);});
   }
   // --------------------------------- private data
   // user specified state for queue
   int port_;                             // port to listen on
+  std::string path_;                     // path of unix domain socket (empty if listening on a port)
   DESER const deser_;                    // de-serialiser
   std::size_t const maxclients_;         // max clients that can connect to this queue
   std::size_t const tmo_poll_ms_;        // ms poll intervall for checking if queue should be stopped
-  char const sep_;                       // message separator
+  Framing const framing_;                // message framing
+  socket_options const sockopts_;        // options set on sockets
 
   // state of interface to queue
   bool deq_enabled_=true;                // is dequing enabled
+  std::size_t maxsize_=0;                // max #of items in queue (0: no max size)
 
   // server socket stuff
-  std::thread serv_thr_;                 // thread handling dequeing messages
-  int servsocket_;                       // socket on which we are listening
+  std::vector<std::thread>serv_thrs_;    // reactor threads handling dequeing messages
+  std::vector<int>servsockets_;          // sockets on which we are listening (one per reactor thread)
   struct sockaddr_in serveraddr_;        // server address
-  int yes_=1;                            // used for setting socket options
 
-  // variables shared across select loop and interface
+  // variables shared across event loop and interface
   Container q_;                                          // queues waiting to be de-queued
   mutable std::unique_ptr<std::mutex>mtx_;               // protects queue where messages are stored
   mutable std::unique_ptr<std::condition_variable>cond_; // ...
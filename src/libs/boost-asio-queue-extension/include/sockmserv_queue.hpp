@@ -0,0 +1,480 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0.
+
+#ifndef __SOCK_MSERV_QUEUE_H__
+#define __SOCK_MSERV_QUEUE_H__
+#include "detail/queue_empty_base.hpp"
+#include "detail/queue_support.hpp"
+#include "detail/fdqueue_support.hpp"
+#include "detail/sockqueue_support.hpp"
+#include "detail/reactor_support.hpp"
+#include <boost/asio/error.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+#include <deque>
+#include <queue>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <string.h>
+
+// socket stuff
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+
+namespace boost{
+namespace asio{
+
+// routing of messages enqueued with enq() in a sockmserv_queue
+// (last_sender: message is sent to the client which sent the last message returned by deq)
+// (broadcast:   message is sent to all connected clients)
+enum class sockmserv_route:int{last_sender=0,broadcast=1};
+
+/*
+  The class implements a full duplex socket server queue which any number of clients can connect to.
+  Ones constructed the queue runs a separate thread accepting clients, reading messages and writing replies.
+  The thread drives the listening socket and all client sockets from a single epoll reactor.
+
+  Messages from all clients are merged into one stream returned by deq - deq_client also returns the id of the sending client.
+  Messages enqueued with enq are routed to the last sender or broadcast to all clients (see sockmserv_route) -
+  enq_client sends a message to a specific client and broadcast sends a message to all clients.
+  Enqueued messages are serialised by the calling thread and handed to the reactor thread (woken up through an eventfd)
+  which keeps an output buffer per client and writes buffered messages when the client socket is writable - enq never blocks.
+  Sending to a client which is not connected fails with asio::error::not_connected.
+  Messages are separated by a separator character or framed by a length header - see Framing.
+  Serialisers/de-serialisers are either stream or buffer based - see detail/serial_support.hpp.
+  A queue constructed from a unix_endpoint listens on a unix domain socket instead of a TCP port.
+  The queue is thread safe.
+*/
+template<typename T,typename DESER,typename SERIAL,typename Base=detail::base::queue_empty_base<T>,typename Framing=sep_framing>
+class sockmserv_queue:public Base{
+public:
+  // id of a client (ids are never reused while the queue exists)
+  using client_id=std::uint64_t;
+
+  // default message separaor
+  constexpr static char NEWLINE='\n';
+
+  // ctor
+  sockmserv_queue(int port,DESER deser,SERIAL serial,std::size_t maxclients,sockmserv_route route=sockmserv_route::last_sender,char sep=NEWLINE,
+                  socket_options const&sockopts=socket_options{}):
+      sockmserv_queue(port,deser,serial,maxclients,detail::queue_support::makeFraming<Framing>(sep),route,sockopts){
+  }
+  sockmserv_queue(int port,DESER deser,SERIAL serial,std::size_t maxclients,Framing const&framing,sockmserv_route route=sockmserv_route::last_sender,
+                  socket_options const&sockopts=socket_options{}):
+      sockmserv_queue(port,nullptr,deser,serial,maxclients,framing,route,sockopts){
+  }
+  sockmserv_queue(unix_endpoint const&ep,DESER deser,SERIAL serial,std::size_t maxclients,sockmserv_route route=sockmserv_route::last_sender,
+                  char sep=NEWLINE,socket_options const&sockopts=socket_options{}):
+      sockmserv_queue(ep,deser,serial,maxclients,detail::queue_support::makeFraming<Framing>(sep),route,sockopts){
+  }
+  sockmserv_queue(unix_endpoint const&ep,DESER deser,SERIAL serial,std::size_t maxclients,Framing const&framing,
+                  sockmserv_route route=sockmserv_route::last_sender,socket_options const&sockopts=socket_options{}):
+      sockmserv_queue(0,&ep,deser,serial,maxclients,framing,route,sockopts){
+  }
+  // copy/move/assign - for simplicity, delete them
+  sockmserv_queue(sockmserv_queue const&)=delete;
+  sockmserv_queue(sockmserv_queue&&other)=delete;
+  sockmserv_queue&operator=(sockmserv_queue const&)=delete;
+  sockmserv_queue&operator=(sockmserv_queue&&other)=delete;
+
+  // dtor
+  ~sockmserv_queue(){
+    // flag to stop server loop, wake up server and wait for server to stop, then close server socket
+    stop_server_.store(true);
+    wakeup();
+    if(serv_thr_.joinable())serv_thr_.join();
+    detail::queue_support::eclose(servsocket_,false);
+    detail::queue_support::eclose(evfd_,false);
+    if(!path_.empty())::unlink(path_.c_str());
+  }
+  // dequeue a message
+  std::pair<bool,T>deq(boost::system::error_code&ec){
+    return packClient(deqAux(0,ec));
+  }
+  // dequeue a message (return.first == false if deq() was disabled) - timeout if waiting too long
+  std::pair<bool,T>timed_deq(std::size_t ms,boost::system::error_code&ec){
+    return packClient(deqAux(ms,ec));
+  }
+  // dequeue a message together with the id of the client which sent it
+  std::pair<bool,std::pair<client_id,T>>deq_client(boost::system::error_code&ec){
+    return deqAux(0,ec);
+  }
+  // dequeue a message together with the id of the client which sent it - timeout if waiting too long
+  std::pair<bool,std::pair<client_id,T>>timed_deq_client(std::size_t ms,boost::system::error_code&ec){
+    return deqAux(ms,ec);
+  }
+  // wait until we can retrieve a message from queue
+  bool wait_deq(boost::system::error_code&ec){
+    return waitDeqAux(0,ec);
+  }
+  // wait until we can retrieve a message from queue -  timeout if waiting too long
+  bool timed_wait_deq(std::size_t ms,boost::system::error_code&ec){
+    return waitDeqAux(ms,ec);
+  }
+  // send a message routed according to the routing of the queue
+  bool enq(T t,boost::system::error_code&ec){
+    return enqAux(t,route_==sockmserv_route::broadcast,0,true,ec);
+  }
+  // send a message routed according to the routing of the queue
+  // (enq never blocks so the timeout is never used)
+  bool timed_enq(T t,std::size_t,boost::system::error_code&ec){
+    return enq(std::move(t),ec);
+  }
+  // send a message to a specific client
+  bool enq_client(client_id id,T const&t,boost::system::error_code&ec){
+    return enqAux(t,false,id,false,ec);
+  }
+  // send a message to all connected clients
+  bool broadcast(T const&t,boost::system::error_code&ec){
+    return enqAux(t,true,0,false,ec);
+  }
+  // wait until we can put a message in queue
+  // (enq never blocks so we only check if enq is enabled)
+  bool wait_enq(boost::system::error_code&ec){
+    std::unique_lock<std::mutex>lock(*mtx_);
+    return checkEnqEnabled(ec);
+  }
+  // wait until we can put a message in queue - timeout if waiting too long
+  bool timed_wait_enq(std::size_t,boost::system::error_code&ec){
+    return wait_enq(ec);
+  }
+  // cancel deq operations (will also release blocking threads)
+  void disable_deq(bool disable){
+    std::unique_lock<std::mutex>lock(*mtx_);
+    deq_enabled_=!disable;
+    cond_->notify_all();
+  }
+  // cancel enq operations
+  void disable_enq(bool disable){
+    std::unique_lock<std::mutex>lock(*mtx_);
+    enq_enabled_=!disable;
+  }
+  // get #of connected clients
+  std::size_t nclients()const{
+    std::unique_lock<std::mutex>lock(*mtx_);
+    return connected_.size();
+  }
+private:
+  // ctor (ep != nullptr if listening on a unix domain socket)
+  sockmserv_queue(int port,unix_endpoint const*ep,DESER deser,SERIAL serial,std::size_t maxclients,Framing const&framing,sockmserv_route route,
+                  socket_options const&sockopts):
+      port_(port),deser_(deser),serial_(serial),maxclients_(maxclients),framing_(framing),route_(route),sockopts_(sockopts),
+      mtx_{std::make_unique<std::mutex>()},cond_{std::make_unique<std::condition_variable>()},stop_server_(false){
+    // create listening socket and eventfd used for waking up reactor
+    if(ep!=nullptr){
+      servsocket_=detail::sockqueue_support::createUnixListenSocket(*ep,maxclients_,sockopts_);
+      path_=ep->path;
+      if(ep->seqpacket)maxrec_=detail::queue_support::fdreadbuf::CHUNK;
+    }else{
+      servsocket_=detail::sockqueue_support::createListenSocket(port_,serveraddr_,maxclients_,sockopts_);
+    }
+    if(detail::queue_support::setFdNonblock(servsocket_)!=0||(evfd_=::eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC))<0){
+      detail::queue_support::eclose(servsocket_,false);
+      throw std::runtime_error(std::string("sockmserv_queue::sockmserv_queue: failed setting up server, errno: ")+strerror(errno));
+    }
+    // spawn thread running socket io stuff
+    serv_thr_=std::thread([&](){run_sock_serv();});
+  }
+  // --------------------------------- private helper types
+  // message waiting to be sent to a client
+  // (a broadcast message is shared between the output buffers of all clients)
+  using outmsg_t=std::shared_ptr<std::string const>;
+
+  // state of a connected client (only accessed by the reactor thread)
+  struct client{
+    explicit client(client_id i):id(i){}
+    client_id id;                        // id of client
+    detail::queue_support::fdreadbuf rbuf;// bytes read but not yet part of a complete message
+    std::deque<outmsg_t>out;             // messages waiting to be written
+    std::size_t outoff=0;                // #of bytes already written of first message in 'out'
+    bool wantout=false;                  // true if client fd is registered for EPOLLOUT
+  };
+  // message handed from enq to the reactor thread
+  struct command{
+    bool bcast;                          // send message to all clients
+    client_id id;                        // client to send to if not broadcast
+    outmsg_t msg;                        // serialised message
+  };
+  // --------------------------------- private helper functions
+
+  // dequeue a message and the id of the client which sent it
+  std::pair<bool,std::pair<client_id,T>>deqAux(std::size_t ms,boost::system::error_code&ec){
+    std::unique_lock<std::mutex>lock(*mtx_);
+    if(!waitNolock(lock,ms,ec))return std::make_pair(false,std::make_pair(client_id{0},T{}));
+    std::pair<bool,std::pair<client_id,T>>ret{true,std::move(q_.front())};
+    q_.pop();
+    last_=ret.second.first;
+    cond_->notify_all();
+    ec=boost::system::error_code();
+    return ret;
+  }
+  // wait until there is a message in queue
+  bool waitDeqAux(std::size_t ms,boost::system::error_code&ec){
+    std::unique_lock<std::mutex>lock(*mtx_);
+    if(!waitNolock(lock,ms,ec))return false;
+    ec=boost::system::error_code();
+    return true;
+  }
+  // wait until there is a message in queue or deq is disabled (ms == 0 means no timeout)
+  // (lock must be held when calling this function)
+  bool waitNolock(std::unique_lock<std::mutex>&lock,std::size_t ms,boost::system::error_code&ec){
+    auto pred=[&](){return !deq_enabled_||!q_.empty();};
+    if(ms==0)cond_->wait(lock,pred);
+    else if(!cond_->wait_for(lock,std::chrono::milliseconds(ms),pred)){
+      ec=boost::asio::error::timed_out;
+      return false;
+    }
+    if(!deq_enabled_){
+      ec=boost::asio::error::operation_aborted;
+      return false;
+    }
+    return true;
+  }
+  // drop client id from a dequeued message
+  static std::pair<bool,T>packClient(std::pair<bool,std::pair<client_id,T>>&&p){
+    return std::make_pair(p.first,std::move(p.second.second));
+  }
+  // check if enq is enabled
+  // (lock must be held when calling this function)
+  bool checkEnqEnabled(boost::system::error_code&ec)const{
+    if(!enq_enabled_){
+      ec=boost::asio::error::operation_aborted;
+      return false;
+    }
+    ec=boost::system::error_code();
+    return true;
+  }
+  // serialise a message and hand it to the reactor thread
+  // (if 'toLast' is true the message is sent to the client which sent the last dequeued message)
+  bool enqAux(T const&t,bool bcast,client_id id,bool toLast,boost::system::error_code&ec){
+    // serialise outside lock
+    std::string str{detail::queue_support::serialise(t,framing_,serial_,ec)};
+    if(ec!=boost::system::error_code())return false;
+    outmsg_t msg{std::make_shared<std::string const>(std::move(str))};
+    bool wake{false};
+    {
+      std::unique_lock<std::mutex>lock(*mtx_);
+      if(!checkEnqEnabled(ec))return false;
+      if(toLast)id=last_;
+      if(!bcast&&connected_.count(id)==0){
+        ec=boost::asio::error::not_connected;
+        return false;
+      }
+      wake=cmds_.empty();
+      cmds_.push_back(command{bcast,id,std::move(msg)});
+    }
+    // only wake up reactor if it has not already been woken up
+    if(wake)wakeup();
+    ec=boost::system::error_code();
+    return true;
+  }
+  // wake up reactor thread
+  void wakeup(){
+    std::uint64_t one{1};
+    while(::write(evfd_,&one,sizeof(one))<0&&errno==EINTR);
+  }
+  // function running event loop
+  void run_sock_serv(){
+    detail::queue_support::epoll_reactor reactor;
+    boost::system::error_code ec;
+    if(!reactor.add(servsocket_,EPOLLIN,ec)||!reactor.add(evfd_,EPOLLIN,ec)){
+      throw std::runtime_error(std::string("sockmserv_queue::run_sock_serv: ")+ec.message());
+    }
+    std::unordered_map<int,client>clients;   // fd --> client
+    std::unordered_map<client_id,int>fds;    // client id --> fd
+
+    // close a client connection
+    auto disconnect=[&](int fd){
+      auto it=clients.find(fd);
+      if(it==clients.end())return;
+      {
+        std::unique_lock<std::mutex>lock(*mtx_);
+        connected_.erase(it->second.id);
+      }
+      fds.erase(it->second.id);
+      reactor.remove(fd);
+      detail::queue_support::eclose(fd,false);
+      clients.erase(it);
+    };
+    // write as much as we can of the output buffer of a client
+    // (returns false if client was disconnected)
+    auto flush=[&](int fd,client&c){
+      while(!c.out.empty()){
+        std::vector<struct iovec>iov;
+        iov.reserve(std::min<std::size_t>(c.out.size(),IOV_MAX));
+        std::size_t nbytes{0};
+        for(std::size_t i=0;i<c.out.size()&&i<IOV_MAX&&(maxrec_==0||nbytes<maxrec_);++i){
+          std::size_t off{i==0?c.outoff:0};
+          std::size_t len{c.out[i]->size()-off};
+          if(maxrec_>0)len=std::min(len,maxrec_-nbytes);
+          iov.push_back({const_cast<char*>(c.out[i]->data())+off,len});
+          nbytes+=len;
+        }
+        // (MSG_NOSIGNAL: a client which has gone away gives EPIPE instead of SIGPIPE)
+        struct msghdr mh{};
+        mh.msg_iov=iov.data();
+        mh.msg_iovlen=iov.size();
+        ssize_t stat;
+        while((stat=::sendmsg(fd,&mh,MSG_NOSIGNAL))<0&&errno==EINTR){}
+        if(stat<0){
+          if(errno==EWOULDBLOCK||errno==EAGAIN)break;
+          disconnect(fd);
+          return false;
+        }
+        // drop what was written
+        std::size_t nwritten{static_cast<std::size_t>(stat)};
+        while(!c.out.empty()&&nwritten>=c.out.front()->size()-c.outoff){
+          nwritten-=c.out.front()->size()-c.outoff;
+          c.outoff=0;
+          c.out.pop_front();
+        }
+        c.outoff+=nwritten;
+      }
+      // only listen for writability while there is something to write
+      bool wantout{!c.out.empty()};
+      if(wantout!=c.wantout){
+        c.wantout=wantout;
+        if(!reactor.modify(fd,wantout?EPOLLIN|EPOLLOUT:EPOLLIN,ec)){
+          disconnect(fd);
+          return false;
+        }
+      }
+      return true;
+    };
+    // read from a client and queue all complete messages
+    auto receive=[&](int fd,client&c){
+      ssize_t stat{c.rbuf.fill(fd)};
+      if(stat==0||(stat<0&&errno!=EWOULDBLOCK&&errno!=EAGAIN)){
+        disconnect(fd);
+        return;
+      }
+      char const*msg;
+      std::size_t len;
+      std::vector<std::pair<client_id,T>>items;
+      while(framing_.next(c.rbuf,msg,len,ec))items.emplace_back(c.id,detail::queue_support::deserialise<T>(msg,len,deser_));
+      if(!items.empty()){
+        std::unique_lock<std::mutex>lock(*mtx_);
+        for(auto&item:items)q_.push(std::move(item));
+        cond_->notify_all();
+      }
+      if(ec!=boost::system::error_code())disconnect(fd);
+    };
+    // move messages from enq into client output buffers
+    auto drainCommands=[&](){
+      std::uint64_t cnt;
+      while(::read(evfd_,&cnt,sizeof(cnt))<0&&errno==EINTR);
+      std::vector<command>cmds;
+      {
+        std::unique_lock<std::mutex>lock(*mtx_);
+        cmds.swap(cmds_);
+      }
+      std::unordered_set<int>touched;
+      for(auto&cmd:cmds){
+        if(cmd.bcast){
+          for(auto&p:clients){
+            p.second.out.push_back(cmd.msg);
+            touched.insert(p.first);
+          }
+          continue;
+        }
+        // client may have disconnected after message was enqueued
+        auto it=fds.find(cmd.id);
+        if(it==fds.end())continue;
+        clients.find(it->second)->second.out.push_back(std::move(cmd.msg));
+        touched.insert(it->second);
+      }
+      for(int fd:touched){
+        auto it=clients.find(fd);
+        if(it!=clients.end()&&!it->second.wantout)flush(fd,it->second);
+      }
+    };
+    // loop until server 'stop_server' flag is set
+    while(!stop_server_.load()){
+      int n=reactor.wait(0,ec);
+      if(n<0){
+        throw std::runtime_error(std::string("sockmserv_queue::run_sock_serv: ")+ec.message());
+      }
+      for(int i=0;i<n;++i){
+        int fd{reactor.fd(i)};
+
+        // messages to send
+        if(fd==evfd_){
+          drainCommands();
+          continue;
+        }
+        // accept all pending client connections
+        if(fd==servsocket_){
+          while(true){
+            int client_fd{::accept4(servsocket_,nullptr,nullptr,SOCK_NONBLOCK|SOCK_CLOEXEC)};
+            if(client_fd<0)break;
+            if(!detail::sockqueue_support::applySocketOptions(client_fd,sockopts_,ec)||!reactor.add(client_fd,EPOLLIN,ec)){
+              detail::queue_support::eclose(client_fd,false);
+              continue;
+            }
+            client_id id{++nextid_};
+            clients.insert(std::make_pair(client_fd,client(id))).first->second.rbuf.records(maxrec_>0);
+            fds.insert(std::make_pair(id,client_fd));
+            std::unique_lock<std::mutex>lock(*mtx_);
+            connected_.insert(id);
+          }
+          continue;
+        }
+        // event on a client connection
+        auto it=clients.find(fd);
+        if(it==clients.end())continue;
+        std::uint32_t events{reactor.events(i)};
+        if((events&EPOLLOUT)&&!flush(fd,it->second))continue;
+        if(events&(EPOLLIN|EPOLLHUP|EPOLLERR))receive(fd,it->second);
+      }
+    }
+    // close all client fds
+    for(auto const&p:clients)detail::queue_support::eclose(p.first,false);
+    std::unique_lock<std::mutex>lock(*mtx_);
+    connected_.clear();
+  }
+  // --------------------------------- private data
+  // user specified state for queue
+  int port_;                             // port to listen on
+  std::string path_;                     // path of unix domain socket (empty if listening on a port)
+  std::size_t maxrec_=0;                 // max #of bytes in one write (only limited for record based sockets)
+  DESER const deser_;                    // de-serialiser
+  SERIAL const serial_;                  // serialiser
+  std::size_t const maxclients_;         // max clients that can be waiting to be accepted
+  Framing const framing_;                // message framing
+  sockmserv_route const route_;          // routing of messages sent with enq()
+  socket_options const sockopts_;        // options set on sockets
+
+  // state of interface to queue
+  bool deq_enabled_=true;                // is dequing enabled
+  bool enq_enabled_=true;                // is enquing enabled
+  client_id last_=0;                     // client which sent last dequeued message
+
+  // server socket stuff
+  std::thread serv_thr_;                 // thread running reactor
+  int servsocket_=-1;                    // socket on which we are listening
+  int evfd_=-1;                          // eventfd used for waking up reactor
+  struct sockaddr_in serveraddr_;        // server address
+  client_id nextid_=0;                   // last client id handed out (only used by reactor thread)
+
+  // variables shared across event loop and interface
+  std::queue<std::pair<client_id,T>>q_;                  // messages waiting to be de-queued
+  std::vector<command>cmds_;                             // messages waiting to be handed to clients
+  std::unordered_set<client_id>connected_;               // connected clients
+  mutable std::unique_ptr<std::mutex>mtx_;               // protects shared state
+  mutable std::unique_ptr<std::condition_variable>cond_; // signalled when messages arrive or deq is disabled
+  std::atomic<bool>stop_server_;                         // when set to true, then server will stop
+};
+}
+}
+#endif
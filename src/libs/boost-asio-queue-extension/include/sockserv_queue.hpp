@@ -4,7 +4,6 @@
 /* TODO
 IMPROVEMENTS:
 	- we should have two timeouts, message timeout, byte timeout
-	- read/write more than one character at a time ... must then buffer what we have read
 
 TESTING:
 	- test with serializing real object and base64 encode them
@@ -33,30 +32,42 @@ namespace boost{
 namespace asio{
 
 // a socket based server queue listening on clients - full duplex queue - only 1 client can connect
-// (if sending objects first serialise the object, the base64 encode it in the serialiser)
+// (see sockmserv_queue for a full duplex server queue which many clients can connect to)
+// (if sending binary objects with separator framing, base64 encode them in the serialiser - or use varint_framing/fixed_framing)
+// (serialisers/de-serialisers are either stream or buffer based - see detail/serial_support.hpp)
 // (the tmo in ms is based on message timeout - if no message starts arriving within timeout, the function times out)
 // (ones we have started to read a message, the message will never timeout)
+// (messages are separated by '\n' or framed by a length header - see Framing)
+// (bytes are read in chunks - bytes read past the end of a message are buffered and used for the next message)
+// (a queue constructed from a unix_endpoint listens on a unix domain socket instead of a TCP port)
 // (the class is meant to be used in singele threaded mode and is not thread safe)
-template<typename T,typename DESER,typename SERIAL,typename Base=detail::base::queue_empty_base<T>>
+template<typename T,typename DESER,typename SERIAL,typename Base=detail::base::queue_empty_base<T>,typename Framing=sep_framing>
 class sockserv_queue:public Base{
 public:
   // default message separaor
   constexpr static char NEWLINE='\n';
 
   // ctor
-  sockserv_queue(int port,DESER deser,SERIAL serial,char sep=NEWLINE):
-      port_(port),deser_(deser),serial_(serial),sep_{sep},closeOnExit_(true),mtx_{std::make_unique<std::mutex>()}{
-    // start listening on socket
-    servsocket_=detail::sockqueue_support::createListenSocket(port_,serveraddr_,maxclients_,&yes_);
+  sockserv_queue(int port,DESER deser,SERIAL serial,char sep=NEWLINE,socket_options const&sockopts=socket_options{}):
+      sockserv_queue(port,deser,serial,detail::queue_support::makeFraming<Framing>(sep),sockopts){
+  }
+  sockserv_queue(int port,DESER deser,SERIAL serial,Framing const&framing,socket_options const&sockopts=socket_options{}):
+      sockserv_queue(port,nullptr,deser,serial,framing,sockopts){
+  }
+  sockserv_queue(unix_endpoint const&ep,DESER deser,SERIAL serial,char sep=NEWLINE,socket_options const&sockopts=socket_options{}):
+      sockserv_queue(ep,deser,serial,detail::queue_support::makeFraming<Framing>(sep),sockopts){
+  }
+  sockserv_queue(unix_endpoint const&ep,DESER deser,SERIAL serial,Framing const&framing,socket_options const&sockopts=socket_options{}):
+      sockserv_queue(0,&ep,deser,serial,framing,sockopts){
   }
   // copy ctor
   sockserv_queue(sockserv_queue const&)=delete;
 
   // move ctor
   sockserv_queue(sockserv_queue&&other):
-      port_(other.port_), deser_(std::move(other.deser_)),serial_(std::move(other.serial_)),sep_(other.sep_),closeOnExit_(other.closeOnExit_),
-      servsocket_(other.servsocket_),yes_(other.yes_),
-      mtx_(std::move(other.mtx_)),deq_enabled_(other.deq_enabled_),enq_enabled_(other.enq_enabled_)
+      port_(other.port_),path_(other.path_),maxrec_(other.maxrec_),deser_(std::move(other.deser_)),serial_(std::move(other.serial_)),framing_(other.framing_),sockopts_(other.sockopts_),
+      closeOnExit_(other.closeOnExit_),servsocket_(other.servsocket_),
+      mtx_(std::move(other.mtx_)),deq_enabled_(other.deq_enabled_),enq_enabled_(other.enq_enabled_),rbuf_(std::move(other.rbuf_))
   {
     other.closeOnExit_=false; // make sure we don't close twice
     memcpy(static_cast<void*>(&serveraddr_),static_cast<void*>(&other.serveraddr_),sizeof(serveraddr_));
@@ -68,21 +79,24 @@ public:
   // move assign
   sockserv_queue&operator=(sockserv_queue&&other){
     port_=other.port_;
+    path_=other.path_;
+    maxrec_=other.maxrec_;
     deser_=std::move(other.deser_);
     serial_=std::move(other.serial_);
-    sep_=other.sep_;
+    framing_=other.framing_;
+    sockopts_=other.sockopts_;
     closeOnExit_=other.closeOnExit_;
     other.closeOnExit_=false; // make sure we don't close twice
 
     // server socket stuff
     servsocket_=other.servsocket_;
-    yes_=other.yes_;
     memcpy(static_cast<void*>(&serveraddr_),static_cast<void*>(&other.serveraddr_),sizeof(serveraddr_));
     memcpy(static_cast<void*>(&clientaddr_),static_cast<void*>(&other.clientaddr_),sizeof(clientaddr_));
 
     mtx_=std::move(other.mtx_);
     deq_enabled_=other.deq_enabled_;
     enq_enabled_=other.enq_enabled_;
+    rbuf_=std::move(other.rbuf_);
     return*this;
   }
   // ctor
@@ -92,6 +106,7 @@ public:
         if(state_==CONNECTED)detail::queue_support::eclose(clientsocket_,false);
         detail::queue_support::eclose(servsocket_,false);
       }
+      if(!path_.empty())::unlink(path_.c_str());
     }
   }
   // dequeue a message (return.first == false if deq() was disabled)
@@ -186,6 +201,19 @@ public:
     enq_enabled_=!disable;
   }
 private:
+  // ctor (ep != nullptr if listening on a unix domain socket)
+  sockserv_queue(int port,unix_endpoint const*ep,DESER deser,SERIAL serial,Framing const&framing,socket_options const&sockopts):
+      port_(port),deser_(deser),serial_(serial),framing_(framing),sockopts_(sockopts),closeOnExit_(true),mtx_{std::make_unique<std::mutex>()}{
+    // start listening on socket
+    if(ep!=nullptr){
+      servsocket_=detail::sockqueue_support::createUnixListenSocket(*ep,maxclients_,sockopts_);
+      path_=ep->path;
+      rbuf_.records(ep->seqpacket);
+      if(ep->seqpacket)maxrec_=detail::queue_support::fdreadbuf::CHUNK;
+    }else{
+      servsocket_=detail::sockqueue_support::createListenSocket(port_,serveraddr_,maxclients_,sockopts_);
+    }
+  }
   // --------------------------------- state management functions
   // (all state is managed here)
 
@@ -195,7 +223,7 @@ private:
 
     // wait for client connection if needed
     if(state_==IDLE){
-      clientsocket_=detail::sockqueue_support::waitForClientConnect(servsocket_,serveraddr_,clientaddr_,ms,ec1);
+      clientsocket_=detail::sockqueue_support::waitForClientConnect(servsocket_,serveraddr_,clientaddr_,sockopts_,ms,ec1);
       if(ec1!=boost::system::error_code()){
         if(ec1!=boost::asio::error::timed_out)detail::queue_support::eclose(servsocket_,false);
         ec=ec1;
@@ -206,11 +234,12 @@ private:
     // client connected - read message
     if(state_==CONNECTED){
       state_=READING;
-      T ret{detail::queue_support::recvwait<T,DESER>(clientsocket_,ms,ec1,getMsg,sep_,deser_)};
+      T ret{detail::queue_support::recvwait<T,DESER>(clientsocket_,rbuf_,ms,ec1,getMsg,framing_,deser_)};
       if(ec1!=boost::system::error_code()){
         if(ec1!=boost::asio::error::timed_out){
           detail::queue_support::eclose(servsocket_,false);
           state_=IDLE;
+          rbuf_.clear();
         }else{
           state_=CONNECTED;
         }
@@ -218,7 +247,7 @@ private:
         return std::make_pair(false,T{});
       }
       state_=CONNECTED;
-      return make_pair(true,ret);
+      return std::make_pair(true,ret);
     }
     // dummy return - will never reach
     return  std::make_pair(false,T{});
@@ -227,9 +256,15 @@ private:
   bool enqAux(T const*t,std::size_t ms,boost::system::error_code&ec,bool sendMsg){
     boost::system::error_code ec1;
 
+    // serialise message up front so a message too large for the framing is rejected without touching the connection
+    std::string msg;
+    if(sendMsg){
+      msg=detail::queue_support::serialise(*t,framing_,serial_,ec);
+      if(ec!=boost::system::error_code())return false;
+    }
     // wait for client connection if needed
     if(state_==IDLE){
-      clientsocket_=detail::sockqueue_support::waitForClientConnect(servsocket_,serveraddr_,clientaddr_,ms,ec1);
+      clientsocket_=detail::sockqueue_support::waitForClientConnect(servsocket_,serveraddr_,clientaddr_,sockopts_,ms,ec1);
       if(ec1!=boost::system::error_code()){
         if(ec1!=boost::asio::error::timed_out)detail::queue_support::eclose(servsocket_,false);
         ec=ec1;
@@ -240,11 +275,16 @@ private:
     // client connected - write message
     if(state_==CONNECTED){
       state_=WRITING;
-      detail::queue_support::sendwait<T,SERIAL>(clientsocket_,t,0,ec1,sendMsg,sep_,serial_);
+      if(!sendMsg)detail::queue_support::waitWritable(clientsocket_,0,ec1);
+      else{
+        std::vector<struct iovec>iov{{const_cast<char*>(msg.data()),msg.size()}};
+        detail::queue_support::writeBuffers(clientsocket_,iov,0,ec1,true,maxrec_);
+      }
       if(ec1!=boost::system::error_code()&&ec1!=boost::asio::error::timed_out){
         if(ec1!=boost::asio::error::timed_out){
           detail::queue_support::eclose(servsocket_,false);
           state_=IDLE;
+          rbuf_.clear();
         }else{
           state_=CONNECTED;
         }
@@ -264,24 +304,27 @@ private:
 
   // state of queue
   int port_;                             // port to listen on
+  std::string path_;                     // path of unix domain socket (empty if listening on a port)
+  std::size_t maxrec_=0;                 // max #of bytes in one write (only limited for record based sockets)
   DESER deser_;                          // de-serialiser
   SERIAL serial_;                        // serialiser
   std::size_t maxclients_=1;             // max clients that can connect to this queue - always equal to 1
-  char sep_;                             // message separator
+  Framing framing_;                      // message framing
+  socket_options sockopts_;              // options set on sockets
   bool closeOnExit_;                     // close fd on exit (if we have been moved we don;t close)
 
   // server socket stuff
   int servsocket_;                       // socket on which we are listening
   struct sockaddr_in serveraddr_;        // server address
-  int yes_=1;                            // used for setting socket options
 
   // client stuff
   int clientsocket_=-1;                  // socket for client
-  struct sockaddr_in clientaddr_;        // client address
+  struct sockaddr_storage clientaddr_;   // client address
 
   mutable std::unique_ptr<std::mutex>mtx_;                  // must be pointer since not movable
   bool deq_enabled_=true;
   bool enq_enabled_=true;
+  detail::queue_support::fdreadbuf rbuf_;                   // bytes read from client socket but not yet dequeued
 };
 }
 }
@@ -0,0 +1,422 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0.
+
+#ifndef __UDP_QUEUE_H__
+#define __UDP_QUEUE_H__
+#include "detail/queue_empty_base.hpp"
+#include "detail/queue_support.hpp"
+#include "detail/fdqueue_support.hpp"
+#include "detail/sockqueue_support.hpp"
+#include <boost/asio/error.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+
+// socket stuff
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// boost stuff
+#include <boost/lexical_cast.hpp>
+
+namespace boost{
+namespace asio{
+
+// options for a udp_queue
+// (max_datagram: max payload in bytes of a datagram - messages are packed into a datagram up to this size - a message
+//  which is larger is sent in a datagram of its own - datagrams larger than max_datagram are dropped by the receiver)
+// (max_batch: max #of datagrams sent with one sendmmsg() or received with one recvmmsg())
+// (max_delay_us: max time in us an enqueued message is buffered for packing - buffered messages are also sent when
+//  max_batch datagrams are full or when flush() is called - 0 means each message is sent by the enq call)
+// (group: IPv4 multicast group joined for receiving - several queues on a host can receive from the same group and port)
+// (iface: IPv4 address of interface used for sending to and receiving from a multicast group - empty for default interface)
+// (ttl/loop: multicast TTL and whether multicast datagrams are delivered to receivers on the sending host)
+struct udp_options{
+  std::size_t max_datagram=1472;         // max bytes in a datagram (ethernet MTU - IP/UDP headers)
+  std::size_t max_batch=64;              // max #of datagrams in one system call
+  std::size_t max_delay_us=0;            // max time a message is buffered for packing
+  std::string group;                     // multicast group to join
+  std::string iface;                     // multicast interface
+  int ttl=1;                             // multicast ttl
+  bool loop=true;                        // deliver multicast datagrams locally
+};
+
+// a datagram (UDP) based queue - messages may be lost, duplicated or re-ordered
+// (the queue receives datagrams sent to 'port' (0: an ephemeral port) and sends messages to 'host:hostport' - if the host
+//  is empty the queue can only receive, if the host is a multicast group messages are sent to all members of the group)
+// (each datagram carries one or more messages, each preceded by its length as a varint - see varint_framing)
+// (datagrams which are truncated or do not hold valid frames are dropped and counted - see dropped())
+// (the send side is protected by its own lock so one thread can enq while another thread waits in deq)
+// (serialisers/de-serialisers are either stream or buffer based - see detail/serial_support.hpp)
+// (the tmo in ms is based on message timeout - 0 means no timeout)
+template<typename T,typename DESER,typename SERIAL,typename Base=detail::base::queue_empty_base<T>>
+class udp_queue:public Base{
+public:
+  // ctor
+  udp_queue(int port,std::string const&host,int hostport,DESER deser,SERIAL serial,udp_options const&opts=udp_options{},
+            socket_options const&sockopts=socket_options{}):
+      deser_(deser),serial_(serial),opts_(opts){
+    opts_.max_datagram=std::max<std::size_t>(opts_.max_datagram,1);
+    opts_.max_batch=std::max<std::size_t>(opts_.max_batch,1);
+    createSocket(port,host,hostport,sockopts);
+
+    // setup receive buffers - one per datagram
+    rbuf_.resize(opts_.max_batch*opts_.max_datagram);
+    riov_.resize(opts_.max_batch);
+    rmsgs_.resize(opts_.max_batch);
+    for(std::size_t i=0;i<opts_.max_batch;++i){
+      riov_[i].iov_base=rbuf_.data()+i*opts_.max_datagram;
+      riov_[i].iov_len=opts_.max_datagram;
+      rmsgs_[i].msg_hdr.msg_iov=&riov_[i];
+      rmsgs_[i].msg_hdr.msg_iovlen=1;
+    }
+    if(opts_.max_delay_us>0)thr_=std::thread([this](){run();});
+  }
+  // copy/move/assign - for simplicity, delete them
+  udp_queue(udp_queue const&)=delete;
+  udp_queue(udp_queue&&)=delete;
+  udp_queue&operator=(udp_queue const&)=delete;
+  udp_queue&operator=(udp_queue&&)=delete;
+
+  // dtor
+  // (buffered messages are sent before the socket is closed)
+  ~udp_queue(){
+    {
+      std::unique_lock<std::mutex>lock(smtx_);
+      stop_=true;
+      scond_.notify_all();
+    }
+    if(thr_.joinable())thr_.join();
+    boost::system::error_code ec;
+    flushNolock(0,ec);
+    detail::queue_support::eclose(fd_,false);
+  }
+  // dequeue a message (return.first == false if deq() was disabled)
+  std::pair<bool,T>deq(boost::system::error_code&ec){
+    return deqAux(0,ec);
+  }
+  // dequeue a message (return.first == false if deq() was disabled) - timeout if waiting too long
+  std::pair<bool,T>timed_deq(std::size_t ms,boost::system::error_code&ec){
+    return deqAux(ms,ec);
+  }
+  // wait until we can retrieve a message from queue
+  bool wait_deq(boost::system::error_code&ec){
+    return waitDeqAux(0,ec);
+  }
+  // wait until we can retrieve a message from queue -  timeout if waiting too long
+  bool timed_wait_deq(std::size_t ms,boost::system::error_code&ec){
+    return waitDeqAux(ms,ec);
+  }
+  // put a message into queue
+  bool enq(T t,boost::system::error_code&ec){
+    return enqAux(t,0,ec);
+  }
+  // put a message into queue - timeout if waiting too long
+  bool timed_enq(T t,std::size_t ms,boost::system::error_code&ec){
+    return enqAux(t,ms,ec);
+  }
+  // wait until we can put a message in queue
+  bool wait_enq(boost::system::error_code&ec){
+    return waitEnqAux(0,ec);
+  }
+  // wait until we can put a message in queue - timeout if waiting too long
+  bool timed_wait_enq(std::size_t ms,boost::system::error_code&ec){
+    return waitEnqAux(ms,ec);
+  }
+  // send buffered messages
+  bool flush(boost::system::error_code&ec){
+    std::unique_lock<std::mutex>lock(smtx_);
+    if(takeError(ec))return false;
+    return flushNolock(0,ec);
+  }
+  // cancel deq operations
+  void disable_deq(bool disable){
+    std::unique_lock<std::mutex>lock(rmtx_);
+    deq_enabled_=!disable;
+  }
+  // cancel enq operations
+  void disable_enq(bool disable){
+    std::unique_lock<std::mutex>lock(smtx_);
+    enq_enabled_=!disable;
+  }
+  // get #of received datagrams which were dropped since they were truncated or did not hold valid frames
+  std::size_t dropped()const{return dropped_.load();}
+private:
+  // --------------------------------- socket setup
+  // create socket, bind it, join multicast group and setup destination (throws exception if failure)
+  void createSocket(int port,std::string const&host,int hostport,socket_options const&sockopts){
+    // resolve destination (prefer IPv4 since multicast is IPv4 only)
+    int family{AF_INET};
+    if(!host.empty()){
+      boost::system::error_code ec;
+      auto addrs=detail::sockqueue_support::resolver_cache::instance().resolve(host,hostport,ec);
+      if(ec!=boost::system::error_code()){
+        throw std::runtime_error(std::string("udp_queue::createSocket: failed converting ")+host+" to address: "+ec.message());
+      }
+      auto it=std::find_if(addrs.begin(),addrs.end(),[](detail::sockqueue_support::sockaddr_entry const&e){return e.family==AF_INET;});
+      dest_=it!=addrs.end()?*it:addrs.front();
+      family=dest_.family;
+      hasDest_=true;
+    }
+    if((fd_=::socket(family,SOCK_DGRAM|SOCK_NONBLOCK|SOCK_CLOEXEC,0))<0){
+      throw std::runtime_error(std::string("udp_queue::createSocket: failed creating socket, errno: ")+boost::lexical_cast<std::string>(errno));
+    }
+    // close socket and throw exception
+    auto fail=[&](std::string const&what){
+      int err{errno};
+      detail::queue_support::eclose(fd_,false);
+      throw std::runtime_error(std::string("udp_queue::createSocket: ")+what+", errno: "+boost::lexical_cast<std::string>(err));
+    };
+    boost::system::error_code ec;
+    if(!detail::sockqueue_support::applySocketOptions(fd_,sockopts,ec))fail("failed setting socket options");
+
+    // multicast setup is IPv4 only
+    bool mcastdest{hasDest_&&family==AF_INET&&
+                   IN_MULTICAST(ntohl(reinterpret_cast<struct sockaddr_in const*>(&dest_.addr)->sin_addr.s_addr))};
+    if((!opts_.group.empty()||mcastdest)&&family!=AF_INET){
+      errno=EAFNOSUPPORT;
+      fail("multicast is only supported for IPv4");
+    }
+    struct in_addr iface;
+    iface.s_addr=htonl(INADDR_ANY);
+    if(!opts_.iface.empty()&&::inet_pton(AF_INET,opts_.iface.c_str(),&iface)!=1){
+      errno=EINVAL;
+      fail("invalid multicast interface "+opts_.iface);
+    }
+    // bind to local port (several receivers can bind to the same port when receiving from a multicast group)
+    if(!opts_.group.empty()){
+      int yes{1};
+      if(::setsockopt(fd_,SOL_SOCKET,SO_REUSEADDR,&yes,sizeof(yes))<0)fail("failed setting SO_REUSEADDR");
+    }
+    struct sockaddr_storage local{};
+    socklen_t locallen;
+    if(family==AF_INET){
+      struct sockaddr_in*addr{reinterpret_cast<struct sockaddr_in*>(&local)};
+      addr->sin_family=AF_INET;
+      addr->sin_addr.s_addr=htonl(INADDR_ANY);
+      addr->sin_port=htons(port);
+      locallen=sizeof(struct sockaddr_in);
+    }else{
+      struct sockaddr_in6*addr{reinterpret_cast<struct sockaddr_in6*>(&local)};
+      addr->sin6_family=AF_INET6;
+      addr->sin6_addr=in6addr_any;
+      addr->sin6_port=htons(port);
+      locallen=sizeof(struct sockaddr_in6);
+    }
+    if(::bind(fd_,reinterpret_cast<struct sockaddr*>(&local),locallen)<0)fail("failed binding socket to port");
+
+    // join multicast group
+    if(!opts_.group.empty()){
+      struct ip_mreq mreq;
+      if(::inet_pton(AF_INET,opts_.group.c_str(),&mreq.imr_multiaddr)!=1){
+        errno=EINVAL;
+        fail("invalid multicast group "+opts_.group);
+      }
+      mreq.imr_interface=iface;
+      if(::setsockopt(fd_,IPPROTO_IP,IP_ADD_MEMBERSHIP,&mreq,sizeof(mreq))<0)fail("failed joining multicast group "+opts_.group);
+    }
+    // setup sending to multicast group
+    if(mcastdest){
+      unsigned char ttl{static_cast<unsigned char>(opts_.ttl)};
+      unsigned char loop{static_cast<unsigned char>(opts_.loop?1:0)};
+      if(::setsockopt(fd_,IPPROTO_IP,IP_MULTICAST_TTL,&ttl,sizeof(ttl))<0)fail("failed setting IP_MULTICAST_TTL");
+      if(::setsockopt(fd_,IPPROTO_IP,IP_MULTICAST_LOOP,&loop,sizeof(loop))<0)fail("failed setting IP_MULTICAST_LOOP");
+      if(!opts_.iface.empty()&&::setsockopt(fd_,IPPROTO_IP,IP_MULTICAST_IF,&iface,sizeof(iface))<0)fail("failed setting IP_MULTICAST_IF");
+    }
+  }
+  // --------------------------------- receive side
+  // dequeue a message
+  std::pair<bool,T>deqAux(std::size_t ms,boost::system::error_code&ec){
+    std::unique_lock<std::mutex>lock(rmtx_);
+    if(!deq_enabled_){
+      ec=boost::asio::error::operation_aborted;
+      return std::make_pair(false,T{});
+    }
+    if(!fillNolock(ms,ec))return std::make_pair(false,T{});
+    std::pair<bool,T>ret{std::make_pair(true,std::move(rq_.front()))};
+    rq_.pop_front();
+    return ret;
+  }
+  // wait until we have a message
+  bool waitDeqAux(std::size_t ms,boost::system::error_code&ec){
+    std::unique_lock<std::mutex>lock(rmtx_);
+    if(!deq_enabled_){
+      ec=boost::asio::error::operation_aborted;
+      return false;
+    }
+    return fillNolock(ms,ec);
+  }
+  // receive datagrams until we have at least one message
+  // (lock must be held when calling this function)
+  bool fillNolock(std::size_t ms,boost::system::error_code&ec){
+    ec=boost::system::error_code();
+    while(rq_.empty()){
+      if(!detail::queue_support::waitReady(fd_,POLLIN,ms,ec))return false;
+      int n;
+      while((n=::recvmmsg(fd_,rmsgs_.data(),rmsgs_.size(),MSG_DONTWAIT,nullptr))<0&&errno==EINTR){}
+      if(n<0){
+        if(errno==EWOULDBLOCK||errno==EAGAIN)continue;
+        ec=boost::system::error_code(errno,boost::system::get_posix_category());
+        return false;
+      }
+      for(int i=0;i<n;++i){
+        if(rmsgs_[i].msg_hdr.msg_flags&MSG_TRUNC)++dropped_;
+        else unpack(static_cast<char const*>(riov_[i].iov_base),rmsgs_[i].msg_len);
+      }
+    }
+    return true;
+  }
+  // unpack messages from a datagram
+  // (a datagram with an invalid frame is dropped from the invalid frame onwards)
+  void unpack(char const*p,std::size_t n){
+    varint_framing const framing;
+    while(n>0){
+      boost::system::error_code ec;
+      std::size_t hdrlen,len;
+      if(!framing.length(p,n,hdrlen,len,ec)||n-hdrlen<len){
+        ++dropped_;
+        return;
+      }
+      rq_.push_back(detail::queue_support::deserialise<T,DESER>(p+hdrlen,len,deser_));
+      p+=hdrlen+len;
+      n-=hdrlen+len;
+    }
+  }
+  // --------------------------------- send side
+  // pack a message into a datagram and send datagrams if needed
+  bool enqAux(T const&t,std::size_t ms,boost::system::error_code&ec){
+    std::unique_lock<std::mutex>lock(smtx_);
+    if(!enq_enabled_){
+      ec=boost::asio::error::operation_aborted;
+      return false;
+    }
+    if(!hasDest_){
+      ec=boost::asio::error::operation_not_supported;
+      return false;
+    }
+    if(takeError(ec))return false;
+    std::string msg{detail::queue_support::serialise(t,varint_framing{},serial_,ec)};
+    if(ec!=boost::system::error_code())return false;
+    if(dgrams_.empty())deadline_=std::chrono::steady_clock::now()+std::chrono::microseconds(opts_.max_delay_us);
+    if(dgrams_.empty()||dgrams_.back().size()+msg.size()>opts_.max_datagram)dgrams_.emplace_back();
+    dgrams_.back().append(msg);
+
+    // send now if we are not buffering or if we have a full batch (the last datagram may still be filled)
+    if(opts_.max_delay_us==0||dgrams_.size()>opts_.max_batch)return flushNolock(ms,ec);
+    scond_.notify_all();
+    ec=boost::system::error_code();
+    return true;
+  }
+  // wait until we can send
+  bool waitEnqAux(std::size_t ms,boost::system::error_code&ec){
+    std::unique_lock<std::mutex>lock(smtx_);
+    if(!enq_enabled_){
+      ec=boost::asio::error::operation_aborted;
+      return false;
+    }
+    return detail::queue_support::waitReady(fd_,POLLOUT,ms,ec);
+  }
+  // send buffered datagrams with sendmmsg()
+  // (we only timeout before the first datagram is sent - datagrams which fail to be sent are dropped)
+  // (lock must be held when calling this function)
+  bool flushNolock(std::size_t ms,boost::system::error_code&ec){
+    ec=boost::system::error_code();
+    std::size_t first{0};
+    std::vector<struct mmsghdr>msgs;
+    std::vector<struct iovec>iov;
+    while(first<dgrams_.size()){
+      // setup next batch
+      std::size_t cnt{std::min(dgrams_.size()-first,opts_.max_batch)};
+      msgs.assign(cnt,mmsghdr{});
+      iov.resize(cnt);
+      for(std::size_t i=0;i<cnt;++i){
+        iov[i].iov_base=const_cast<char*>(dgrams_[first+i].data());
+        iov[i].iov_len=dgrams_[first+i].size();
+        msgs[i].msg_hdr.msg_name=&dest_.addr;
+        msgs[i].msg_hdr.msg_namelen=dest_.len;
+        msgs[i].msg_hdr.msg_iov=&iov[i];
+        msgs[i].msg_hdr.msg_iovlen=1;
+      }
+      int n;
+      while((n=::sendmmsg(fd_,msgs.data(),cnt,0))<0&&errno==EINTR){}
+      if(n<0){
+        if(errno==EWOULDBLOCK||errno==EAGAIN){
+          if(!detail::queue_support::waitReady(fd_,POLLOUT,ms,ec)){
+            if(ec==boost::asio::error::timed_out&&first==0)return false;
+            break;
+          }
+          continue;
+        }
+        ec=boost::system::error_code(errno,boost::system::get_posix_category());
+        break;
+      }
+      first+=n;
+      ms=0;
+    }
+    dgrams_.clear();
+    return ec==boost::system::error_code();
+  }
+  // get error from background flush (clears the error)
+  // (lock must be held when calling this function)
+  bool takeError(boost::system::error_code&ec){
+    if(err_==boost::system::error_code{})return false;
+    ec=err_;
+    err_=boost::system::error_code{};
+    return true;
+  }
+  // background thread sending messages which have been buffered too long
+  void run(){
+    std::unique_lock<std::mutex>lock(smtx_);
+    while(!stop_){
+      if(dgrams_.empty()){
+        scond_.wait(lock);
+        continue;
+      }
+      if(scond_.wait_until(lock,deadline_)==std::cv_status::timeout&&!dgrams_.empty()&&std::chrono::steady_clock::now()>=deadline_){
+        boost::system::error_code ec;
+        if(!flushNolock(0,ec))err_=ec;
+      }
+    }
+  }
+  // --------------------------------- private data
+  DESER deser_;                          // de-serialiser
+  SERIAL serial_;                        // serialiser
+  udp_options opts_;                     // options
+  int fd_=-1;                            // socket
+  detail::sockqueue_support::sockaddr_entry dest_{}; // destination of messages
+  bool hasDest_=false;                   // true if we can send messages
+
+  // receive side
+  std::mutex rmtx_;                                      // protects receive side
+  bool deq_enabled_=true;                                // is dequing enabled
+  std::deque<T>rq_;                                      // messages received but not yet dequeued
+  std::vector<char>rbuf_;                                // receive buffers
+  std::vector<struct iovec>riov_;                        // one receive buffer per datagram
+  std::vector<struct mmsghdr>rmsgs_;                     // headers for recvmmsg()
+  std::atomic<std::size_t>dropped_{0};                   // #of dropped datagrams
+
+  // send side
+  std::mutex smtx_;                                      // protects send side
+  std::condition_variable scond_;                        // wakes up background thread
+  bool enq_enabled_=true;                                // is enquing enabled
+  std::vector<std::string>dgrams_;                       // packed datagrams not yet sent
+  std::chrono::steady_clock::time_point deadline_;       // when buffered messages must be sent
+  boost::system::error_code err_;                        // error from background send
+  bool stop_=false;                                      // stop background thread
+  std::thread thr_;                                      // background thread (only if max_delay_us > 0)
+};
+}
+}
+#endif
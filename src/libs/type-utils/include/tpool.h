@@ -11,32 +11,67 @@
 #include <tuple>
 #include <mutex>
 #include <future>
+#include <condition_variable>
 #include <chrono>
 #include <type_traits>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <new>
 
 namespace utils{
 
 // ------------------- tpool --------------
+// (each worker has its own work stealing deque - a task submitted from a worker is pushed on the deque of the worker
+//  and tasks submitted from other threads go through a shared injection queue)
+// (a worker takes tasks from its own deque first (newest first), then from the injection queue and then steals from
+//  the deques of other workers (oldest first) starting at a random victim)
+// (a worker finding no task retries a few times and then parks on a condition variable - submitting a task wakes
+//  one parked worker, so an idle pool does not use any cpu)
+// (small callables are stored inside the task - a task pushed on a deque is held by a node taken from a free list of
+//  the worker, so a task does not allocate memory once the free lists are warm - submit() still allocates the shared
+//  state of the future, submit_detached() does not)
+// (tasks not yet started when the pool is destroyed are dropped - their futures report a broken promise)
 class tpool{
 private:
   // forward decl.
   template<typename F,typename R=typename std::result_of<F()>::type>struct fret_type;
   class task;
+  class wsdeque;
 public:
   // return type for functions returning void
   struct void_t{};
 
+  // #of times an idle worker looks for a task before parking
+  constexpr static int SPINS=64;
+
+  // max #of free task nodes kept by a worker
+  constexpr static std::size_t FREEMAX=1024;
+
   // ctor
   tpool(std::size_t nthreads):nthreads_(nthreads),done_(false){
+    // all deques must exist before any worker starts stealing
+    for(std::size_t i=0;i<nthreads_;++i)deques_.emplace_back(new wsdeque);
+    free_.resize(nthreads_);
     for(std::size_t i=0;i<nthreads_;++i){
-      std::thread thr(&tpool::thread_func,this);
+      std::thread thr([this,i](){thread_func(i);});
       threads_.push_back(std::move(thr));
     }
   }
   // dtor
   ~tpool(){
-    done_=true;
+    {
+      std::unique_lock<std::mutex>lock(pmtx_);
+      done_=true;
+      pcond_.notify_all();
+    }
     for(auto&t:threads_)t.join();
+    for(auto&d:deques_){
+      while(task*tsk=d->pop())delete tsk;
+    }
+    for(auto&f:free_){
+      for(task*tsk:f)delete tsk;
+    }
   }
   // get #of threads
   std::size_t nthreads()const{return nthreads_;}
@@ -49,6 +84,31 @@ public:
     add_task(task(std::move(pt)));
     return ret;
   }
+  // submit task without a future (fire and forget)
+  // (an exception thrown by the task is ignored)
+  template<typename F>
+  void submit_detached(F f){
+    add_task(task([f=std::move(f)]()mutable{
+      try{
+        f();
+      }
+      catch(...){
+      }
+    }));
+  }
+  // run one queued task in the calling thread (returns false if there was no task to run)
+  // (lets a thread waiting for tasks it has submitted help with the work instead of blocking - from a worker the
+  //  worker's own deque is tried first, from other threads the injection queue)
+  bool run_one(){
+    worker_id&id(current());
+    task tsk;
+    if(!try_get(id.pool==this?id.index:nthreads_,id.seed,tsk))return false;
+    tsk();
+    return true;
+  }
+  // check if the calling thread is a worker of this pool
+  bool in_pool()const{return current().pool==this;}
+
   // submit tuple of tasks and return a tuple containing results of tasks
   template<typename...F,typename RET=std::tuple<typename fret_type<F>::type...>>
   RET submitTaskTupleAndWait(std::tuple<F...>ftu){
@@ -101,31 +161,127 @@ private:
     fu.get();
     return void_t();
   }
+  // worker running in the current thread (pool is nullptr if the thread is not a worker)
+  // (seed is the state of the random generator used when picking victims to steal from)
+  struct worker_id{
+    tpool const*pool=nullptr;
+    std::size_t index=0;
+    std::uint64_t seed=0x9e3779b97f4a7c15ULL;
+  };
+  static worker_id&current(){
+    static thread_local worker_id id;
+    return id;
+  }
   // thread function
-  void thread_func(){
+  void thread_func(std::size_t i){
+    current()=worker_id{this,i,0x9e3779b97f4a7c15ULL*(i+1)};
+    std::uint64_t&seed(current().seed);
+    int idle{0};
     while(!done_){
       try{
         task tsk;
-        if(try_get(tsk))tsk();
-        else std::this_thread::yield();
+        bool found{try_get(i,seed,tsk)};
+        if(!found&&++idle>=SPINS){
+          found=park(i,seed,tsk);
+          idle=0;
+        }
+        if(found){
+          idle=0;
+          tsk();
+        }else{
+          std::this_thread::yield();
+        }
       }
       catch(...){
         done_=true;
       }
     }
   }
-  // get next task
-  bool try_get(task&tsk){
-    std::unique_lock<std::mutex>lock(qmtx_);
-    if(taskq_.empty())return false;
-    tsk=std::move(taskq_.front());
-    taskq_.pop();
+  // park worker until a task is submitted or the pool is destroyed
+  // (returns true if a task was found when checking for tasks after having registered as parked)
+  // (the worker registers as parked before it checks for tasks a last time and a submitter checks for parked workers
+  //  after having queued its task - with both being sequentially consistent, either the worker finds the task or the
+  //  submitter finds the parked worker, so a wakeup is never lost)
+  bool park(std::size_t i,std::uint64_t&seed,task&tsk){
+    std::unique_lock<std::mutex>lock(pmtx_);
+    nparked_.fetch_add(1,std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool ret{try_get(i,seed,tsk)};
+    if(!ret){
+      pcond_.wait(lock,[&](){return wakeups_>0||done_;});
+      if(wakeups_>0)--wakeups_;
+    }
+    nparked_.fetch_sub(1,std::memory_order_seq_cst);
+    return ret;
+  }
+  // wake up one parked worker (if any)
+  void wakeup(){
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(nparked_.load(std::memory_order_seq_cst)==0)return;
+    std::unique_lock<std::mutex>lock(pmtx_);
+    if(wakeups_<nparked_.load(std::memory_order_relaxed)){
+      ++wakeups_;
+      pcond_.notify_one();
+    }
+  }
+  // get next task (returns false if there is no task)
+  // (i is the index of the worker calling us, nthreads_ if we are called from a thread which is not a worker)
+  bool try_get(std::size_t i,std::uint64_t&seed,task&tsk){
+    // own deque
+    if(i<nthreads_){
+      if(task*node=deques_[i]->pop())return release_node(i,node,tsk);
+    }
+    // injection queue (check size first so idle workers don't hammer the lock)
+    if(injsize_.load(std::memory_order_acquire)>0){
+      std::unique_lock<std::mutex>lock(qmtx_);
+      if(!taskq_.empty()){
+        tsk=std::move(taskq_.front());
+        taskq_.pop();
+        injsize_.store(taskq_.size(),std::memory_order_release);
+        return true;
+      }
+    }
+    // steal from other workers starting at a random victim (xorshift)
+    if(nthreads_==0)return false;
+    seed^=seed<<13;
+    seed^=seed>>7;
+    seed^=seed<<17;
+    std::size_t start{static_cast<std::size_t>(seed%nthreads_)};
+    for(std::size_t k=0;k<nthreads_;++k){
+      std::size_t victim{(start+k)%nthreads_};
+      if(victim==i)continue;
+      if(task*node=deques_[victim]->steal())return release_node(i,node,tsk);
+    }
+    return false;
+  }
+  // move task out of node and put node on free list of worker 'i' (node is deleted if we are not a worker)
+  bool release_node(std::size_t i,task*node,task&tsk){
+    tsk=std::move(*node);
+    if(i<nthreads_&&free_[i].size()<FREEMAX)free_[i].push_back(node);
+    else delete node;
     return true;
   }
-  // add task to queue
+  // add task to deque of current worker, or to injection queue if we are not a worker of this pool
+  // (a task pushed on a deque is held by a node from the free list of the worker)
   void add_task(task&&tsk){
-    std::unique_lock<std::mutex>lock(qmtx_);
-    taskq_.push(std::move(tsk));
+    worker_id const&id(current());
+    if(id.pool==this){
+      std::vector<task*>&f(free_[id.index]);
+      task*node;
+      if(f.empty()){
+        node=new task(std::move(tsk));
+      }else{
+        node=f.back();
+        f.pop_back();
+        *node=std::move(tsk);
+      }
+      deques_[id.index]->push(node);
+    }else{
+      std::unique_lock<std::mutex>lock(qmtx_);
+      taskq_.push(std::move(tsk));
+      injsize_.store(taskq_.size(),std::memory_order_release);
+    }
+    wakeup();
   }
   // meta function returning 'void_t' as return type if F returns void, else as std::result_of<F>::type
   template<typename F,typename R>
@@ -133,33 +289,178 @@ private:
     using type=typename std::conditional<std::is_same<R,void>::value,void_t,R>::type;
   };
   // task class (hides actual type of function to be executed)
+  // (move only - callables of at most INLINE bytes with a non-throwing move ctor are stored inside the task,
+  //  larger callables are stored on the heap)
   class task{
-      struct base{
-        virtual void call()=0;
+      constexpr static std::size_t INLINE=48;
+      using storage_t=typename std::aligned_storage<INLINE,alignof(std::max_align_t)>::type;
+
+      // operations on a stored callable
+      struct ops_t{
+        void(*call)(void*);
+        void(*move)(void*,void*);                // move construct at 'dst' from 'src' and destroy 'src'
+        void(*destroy)(void*);
       };
+      // callable stored inside the task
+      template<typename F,bool INPLACE=(sizeof(F)<=INLINE&&alignof(F)<=alignof(std::max_align_t)&&
+                                         std::is_nothrow_move_constructible<F>::value)>
+      struct manager{
+        static F*get(void*p){return static_cast<F*>(p);}
+        static void create(void*p,F&&f){new(p)F(std::move(f));}
+        static void call(void*p){(*get(p))();}
+        static void move(void*dst,void*src){
+          new(dst)F(std::move(*get(src)));
+          get(src)->~F();
+        }
+        static void destroy(void*p){get(p)->~F();}
+        static ops_t const*ops(){
+          static ops_t const ret{call,move,destroy};
+          return&ret;
+        }
+      };
+      // callable stored on the heap
       template<typename F>
-      struct derived:base{
-        derived(F&&f):f_(std::move(f)){}
-        void call(){f_();}
-        F f_;
+      struct manager<F,false>{
+        static F*&get(void*p){return*static_cast<F**>(p);}
+        static void create(void*p,F&&f){new(p)F*(new F(std::move(f)));}
+        static void call(void*p){(*get(p))();}
+        static void move(void*dst,void*src){new(dst)F*(get(src));}
+        static void destroy(void*p){delete get(p);}
+        static ops_t const*ops(){
+          static ops_t const ret{call,move,destroy};
+          return&ret;
+        }
       };
-      std::unique_ptr<base>impl_;
+      storage_t buf_;
+      ops_t const*ops_=nullptr;
   public:
       // ctor, assign, dtor
       task()=default;
-      template<typename F>task(F&&f):impl_(new derived<F>(std::move(f))){}
-      task(task&&other):impl_(std::move(other.impl_)){}
-      task&operator=(task&&tsk){impl_=std::move(tsk.impl_);return*this;}
+      template<typename F,typename FD=typename std::decay<F>::type,
+               typename=typename std::enable_if<!std::is_same<FD,task>::value>::type>
+      task(F&&f){
+        FD fd(std::forward<F>(f));
+        manager<FD>::create(&buf_,std::move(fd));
+        ops_=manager<FD>::ops();
+      }
+      task(task&&other){take(other);}
+      task&operator=(task&&other){
+        if(this!=&other){
+          reset();
+          take(other);
+        }
+        return*this;
+      }
+      ~task(){reset();}
 
       // call
-      void operator()(){impl_->call();}
+      void operator()(){ops_->call(&buf_);}
+  private:
+      // move callable from other task
+      void take(task&other){
+        if(other.ops_==nullptr)return;
+        other.ops_->move(&buf_,&other.buf_);
+        ops_=other.ops_;
+        other.ops_=nullptr;
+      }
+      // destroy callable
+      void reset(){
+        if(ops_==nullptr)return;
+        ops_->destroy(&buf_);
+        ops_=nullptr;
+      }
+  };
+  // Chase-Lev work stealing deque of tasks
+  // (the owning worker pushes and pops at the bottom, other workers steal from the top)
+  // (the ring of slots grows when full - replaced rings are kept until the deque is destroyed since a thief may
+  //  still be reading from them)
+  // (memory orders follow Le, Pop, Cohen and Zappa Nardelli, 'Correct and efficient work-stealing for weak memory models')
+  class wsdeque{
+    struct ring{
+      explicit ring(std::int64_t cap):cap_(cap),slots_(new std::atomic<task*>[cap]){}
+      task*get(std::int64_t i)const{return slots_[i&(cap_-1)].load(std::memory_order_relaxed);}
+      void put(std::int64_t i,task*tsk){slots_[i&(cap_-1)].store(tsk,std::memory_order_relaxed);}
+      std::int64_t const cap_;
+      std::unique_ptr<std::atomic<task*>[]>slots_;
+    };
+  public:
+    // initial #of slots (must be a power of 2)
+    constexpr static std::int64_t CAPACITY=256;
+
+    // ctor
+    wsdeque():top_(0),bottom_(0){
+      rings_.emplace_back(new ring(CAPACITY));
+      ring_.store(rings_.back().get(),std::memory_order_relaxed);
+    }
+    wsdeque(wsdeque const&)=delete;
+    wsdeque&operator=(wsdeque const&)=delete;
+
+    // push task at bottom (owner only)
+    void push(task*tsk){
+      std::int64_t b{bottom_.load(std::memory_order_relaxed)};
+      std::int64_t t{top_.load(std::memory_order_acquire)};
+      ring*r{ring_.load(std::memory_order_relaxed)};
+      if(b-t>r->cap_-1)r=grow(r,t,b);
+      r->put(b,tsk);
+      std::atomic_thread_fence(std::memory_order_release);
+      bottom_.store(b+1,std::memory_order_relaxed);
+    }
+    // pop task from bottom (owner only - returns nullptr if empty)
+    task*pop(){
+      std::int64_t b{bottom_.load(std::memory_order_relaxed)-1};
+      ring*r{ring_.load(std::memory_order_relaxed)};
+      bottom_.store(b,std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      std::int64_t t{top_.load(std::memory_order_relaxed)};
+      if(t>b){
+        bottom_.store(b+1,std::memory_order_relaxed);
+        return nullptr;
+      }
+      task*ret{r->get(b)};
+      if(t==b){
+        // last task - race against thieves
+        if(!top_.compare_exchange_strong(t,t+1,std::memory_order_seq_cst,std::memory_order_relaxed))ret=nullptr;
+        bottom_.store(b+1,std::memory_order_relaxed);
+      }
+      return ret;
+    }
+    // steal task from top (any thread - returns nullptr if empty or if we lost a race)
+    task*steal(){
+      std::int64_t t{top_.load(std::memory_order_acquire)};
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      std::int64_t b{bottom_.load(std::memory_order_acquire)};
+      if(t>=b)return nullptr;
+      task*ret{ring_.load(std::memory_order_acquire)->get(t)};
+      if(!top_.compare_exchange_strong(t,t+1,std::memory_order_seq_cst,std::memory_order_relaxed))return nullptr;
+      return ret;
+    }
+  private:
+    // replace ring by one twice the size (owner only)
+    ring*grow(ring*r,std::int64_t t,std::int64_t b){
+      rings_.emplace_back(new ring(2*r->cap_));
+      ring*ret{rings_.back().get()};
+      for(std::int64_t i=t;i<b;++i)ret->put(i,r->get(i));
+      ring_.store(ret,std::memory_order_release);
+      return ret;
+    }
+    std::atomic<std::int64_t>top_;
+    std::atomic<std::int64_t>bottom_;
+    std::atomic<ring*>ring_;
+    std::vector<std::unique_ptr<ring>>rings_;
   };
   // state
   std::size_t nthreads_;
   std::vector<std::thread>threads_;
   std::atomic_bool done_;
+  std::vector<std::unique_ptr<wsdeque>>deques_;
+  std::vector<std::vector<task*>>free_;
   std::queue<task>taskq_;
+  std::atomic<std::size_t>injsize_{0};
   std::mutex qmtx_;
+  std::atomic<std::size_t>nparked_{0};
+  std::size_t wakeups_=0;
+  std::mutex pmtx_;
+  std::condition_variable pcond_;
 };
 // print operator for tpool::void_t;
 std::ostream&operator<<(std::ostream&os,tpool::void_t const&){return os<<'.';}
@@ -0,0 +1,157 @@
+// (C) Copyright Hans Ewetz 2010,2011,2012,2013,2014,2015. All rights reserved.
+
+#ifndef __TPOOL_ALGO_H__
+#define __TPOOL_ALGO_H__
+#include "type-utils/tpool.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <functional>
+#include <exception>
+
+// parallel algorithms running on a tpool
+// (a range is split in halves until a piece is at most 'grain' items - the upper half is queued on the pool, where idle
+//  workers steal it and split it further, and the lower half is processed by the splitting thread)
+// (the calling thread takes part in the work - it processes the first piece and then runs queued tasks until the
+//  whole range is done, so an algorithm may also be called from a task running in the pool)
+// (a grain of 0 selects a grain giving about 8 pieces per thread)
+// (the first exception thrown by a user function is rethrown once all pieces are done)
+namespace utils{
+namespace tpool_detail{
+
+// completion state shared by the tasks of one call to an algorithm
+// (pending is the #of items not yet processed - a task must not touch the state after calling done())
+class join_state{
+public:
+  explicit join_state(std::size_t n):pending_(n){}
+  join_state(join_state const&)=delete;
+  join_state&operator=(join_state const&)=delete;
+
+  // mark 'n' items as processed
+  void done(std::size_t n){pending_.fetch_sub(n,std::memory_order_acq_rel);}
+
+  // record exception (only the first one is kept)
+  void fail(std::exception_ptr e){
+    std::unique_lock<std::mutex>lock(mtx_);
+    if(!exc_)exc_=e;
+  }
+  // run queued tasks until all items are processed, then rethrow the first exception (if any)
+  void wait(tpool&tp){
+    while(pending_.load(std::memory_order_acquire)>0){
+      if(!tp.run_one())std::this_thread::yield();
+    }
+    if(exc_)std::rethrow_exception(exc_);
+  }
+private:
+  std::atomic<std::size_t>pending_;
+  std::mutex mtx_;
+  std::exception_ptr exc_;
+};
+// get grain size for 'n' items (never less than 'mingrain')
+inline std::size_t grainsize(tpool const&tp,std::size_t n,std::size_t mingrain=1){
+  return std::max(mingrain,n/(8*(tp.nthreads()+1)));
+}
+// process [first,last) in pieces of at most 'grain' items calling f(b,e) for each piece
+template<typename Index,typename F>
+void split_for(tpool&tp,Index first,Index last,std::size_t grain,F const&f,join_state&st){
+  try{
+    while(static_cast<std::size_t>(last-first)>grain){
+      Index mid{first+(last-first)/2};
+      tp.submit_detached([&tp,mid,last,grain,&f,&st](){split_for(tp,mid,last,grain,f,st);});
+      last=mid;
+    }
+    f(first,last);
+  }
+  catch(...){
+    st.fail(std::current_exception());
+  }
+  st.done(static_cast<std::size_t>(last-first));
+}
+// sort [first,last) - partition around a median of three pivot until a piece is at most 'grain' items, then sort it
+// (items equal to the pivot are in their final place once partitioned)
+template<typename It,typename Comp>
+void split_sort(tpool&tp,It first,It last,std::size_t grain,Comp const&comp,join_state&st){
+  using value_type=typename std::iterator_traits<It>::value_type;
+  try{
+    while(static_cast<std::size_t>(last-first)>grain){
+      value_type const&a(*first);
+      value_type const&b(*(first+(last-first)/2));
+      value_type const&c(*(last-1));
+      value_type pivot(comp(a,b)?(comp(b,c)?b:(comp(a,c)?c:a)):(comp(a,c)?a:(comp(b,c)?c:b)));
+      It m1{std::partition(first,last,[&](value_type const&x){return comp(x,pivot);})};
+      It m2{std::partition(m1,last,[&](value_type const&x){return !comp(pivot,x);})};
+      if(m2!=last)tp.submit_detached([&tp,m2,last,grain,&comp,&st](){split_sort(tp,m2,last,grain,comp,st);});
+      st.done(static_cast<std::size_t>(m2-m1));
+      last=m1;
+    }
+    std::sort(first,last,comp);
+  }
+  catch(...){
+    st.fail(std::current_exception());
+  }
+  st.done(static_cast<std::size_t>(last-first));
+}
+}
+// call f(b,e) for consecutive pieces [b,e) covering [first,last)
+// (Index is an integral type or a random access iterator)
+template<typename Index,typename F>
+void parallel_for_range(tpool&tp,Index first,Index last,F f,std::size_t grain=0){
+  if(!(first<last))return;
+  std::size_t n(last-first);
+  tpool_detail::join_state st(n);
+  tpool_detail::split_for(tp,first,last,grain>0?grain:tpool_detail::grainsize(tp,n),f,st);
+  st.wait(tp);
+}
+// call f(i) for each i in [first,last)
+// (Index is an integral type or a random access iterator)
+template<typename Index,typename F>
+void parallel_for(tpool&tp,Index first,Index last,F f,std::size_t grain=0){
+  parallel_for_range(tp,first,last,[&f](Index b,Index e){for(;b!=e;++b)f(b);},grain);
+}
+// store f(x) for each x in [first,last) in [out,out+(last-first)) (returns end of output range)
+// (iterators must be random access iterators)
+template<typename InIt,typename OutIt,typename F>
+OutIt parallel_transform(tpool&tp,InIt first,InIt last,OutIt out,F f,std::size_t grain=0){
+  parallel_for_range(tp,first,last,[&](InIt b,InIt e){std::transform(b,e,out+(b-first),f);},grain);
+  return out+(last-first);
+}
+// reduce [first,last) with 'op' starting with 'init'
+// (op must be associative but need not be commutative - pieces of 'grain' items are reduced in parallel and the
+//  results are combined in order by the calling thread)
+template<typename It,typename T,typename Op>
+T parallel_reduce(tpool&tp,It first,It last,T init,Op op,std::size_t grain=0){
+  if(!(first<last))return init;
+  std::size_t n(last-first);
+  std::size_t g{grain>0?grain:tpool_detail::grainsize(tp,n)};
+  std::size_t npieces{(n+g-1)/g};
+  struct piece{T value;};
+  std::vector<piece>res(npieces,piece{init});
+  parallel_for(tp,std::size_t{0},npieces,[&](std::size_t k){
+    It b{first+k*g};
+    It e{first+std::min(n,(k+1)*g)};
+    T acc(*b);
+    for(++b;b!=e;++b)acc=op(acc,*b);
+    res[k].value=std::move(acc);
+  },1);
+  for(auto&r:res)init=op(init,r.value);
+  return init;
+}
+// sort [first,last) using 'comp' (not stable)
+// (iterators must be random access iterators)
+template<typename It,typename Comp>
+void parallel_sort(tpool&tp,It first,It last,Comp comp,std::size_t grain=0){
+  if(!(first<last))return;
+  std::size_t n(last-first);
+  tpool_detail::join_state st(n);
+  tpool_detail::split_sort(tp,first,last,grain>0?grain:tpool_detail::grainsize(tp,n,1024),comp,st);
+  st.wait(tp);
+}
+template<typename It>
+void parallel_sort(tpool&tp,It first,It last){
+  parallel_sort(tp,first,last,std::less<typename std::iterator_traits<It>::value_type>());
+}
+}
+#endif
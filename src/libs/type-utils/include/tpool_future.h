@@ -0,0 +1,372 @@
+// (C) Copyright Hans Ewetz 2010,2011,2012,2013,2014,2015. All rights reserved.
+
+#ifndef __TPOOL_FUTURE_H__
+#define __TPOOL_FUTURE_H__
+#include "type-utils/tpool.h"
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <memory>
+#include <functional>
+#include <vector>
+#include <tuple>
+#include <utility>
+#include <exception>
+#include <stdexcept>
+#include <type_traits>
+
+// futures with continuations for tasks running on a tpool
+// (a tpool_future is a shared handle to a result - it can be copied and the result can be read any number of times)
+// (then() schedules a function on the pool once the result is ready - nothing waits for the result in the meantime)
+// (when_all()/when_any() combine futures and task_graph runs tasks as soon as the tasks they depend on are done)
+// (get() from a worker of the pool runs other queued tasks until the result is ready instead of blocking the worker)
+// (functions returning void produce a tpool::void_t result)
+namespace utils{
+template<typename T>class tpool_future;
+
+namespace tpool_detail{
+
+// result type of a function (void is mapped to tpool::void_t)
+template<typename R>
+using fut_type=typename std::conditional<std::is_void<R>::value,tpool::void_t,R>::type;
+
+// shared state of a tpool_future
+// (callbacks registered with on_ready() are called by the thread making the state ready, or directly by on_ready()
+//  if the state is already ready - callbacks must therefore be short and must not block)
+template<typename T>
+class fstate{
+public:
+  explicit fstate(tpool*tp):tp_(tp){}
+  fstate(fstate const&)=delete;
+  fstate&operator=(fstate const&)=delete;
+  ~fstate(){if(has_value_)value_ptr()->~T();}
+
+  // get pool (nullptr if no pool)
+  tpool*pool()const{return tp_;}
+
+  // make state ready with a value or an exception
+  void set_value(T v){
+    new(&buf_)T(std::move(v));
+    has_value_=true;
+    make_ready();
+  }
+  void set_exception(std::exception_ptr e){
+    exc_=e;
+    make_ready();
+  }
+  // check if ready
+  bool ready()const{return ready_.load(std::memory_order_acquire);}
+
+  // get value/exception (state must be ready)
+  T const&value()const{return*value_ptr();}
+  std::exception_ptr exception()const{return exc_;}
+
+  // call 'f' when state is ready
+  void on_ready(std::function<void()>f){
+    {
+      std::unique_lock<std::mutex>lock(mtx_);
+      if(!ready_.load(std::memory_order_relaxed)){
+        callbacks_.push_back(std::move(f));
+        return;
+      }
+    }
+    f();
+  }
+  // wait until state is ready
+  // (the waiting thread runs queued tasks - when there are none, a worker of the pool (or any thread if the pool has
+  //  no workers) keeps polling while other threads block until the state is ready)
+  void wait(){
+    if(tp_!=nullptr){
+      bool poll{tp_->in_pool()||tp_->nthreads()==0};
+      while(!ready()){
+        if(tp_->run_one())continue;
+        if(!poll)break;
+        std::this_thread::yield();
+      }
+    }
+    std::unique_lock<std::mutex>lock(mtx_);
+    cond_.wait(lock,[&](){return ready_.load(std::memory_order_relaxed);});
+  }
+  // run 'f' on the pool (or directly if there is no pool)
+  void schedule(std::function<void()>f){
+    if(tp_!=nullptr)tp_->submit_detached(std::move(f));
+    else f();
+  }
+private:
+  // mark state as ready and call callbacks
+  void make_ready(){
+    std::vector<std::function<void()>>callbacks;
+    {
+      std::unique_lock<std::mutex>lock(mtx_);
+      ready_.store(true,std::memory_order_release);
+      callbacks.swap(callbacks_);
+      cond_.notify_all();
+    }
+    for(auto&f:callbacks)f();
+  }
+  T const*value_ptr()const{return reinterpret_cast<T const*>(&buf_);}
+  T*value_ptr(){return reinterpret_cast<T*>(&buf_);}
+
+  tpool*const tp_;
+  typename std::aligned_storage<sizeof(T),alignof(T)>::type buf_;
+  bool has_value_=false;
+  std::exception_ptr exc_;
+  std::atomic<bool>ready_{false};
+  std::vector<std::function<void()>>callbacks_;
+  std::mutex mtx_;
+  std::condition_variable cond_;
+};
+// call 'f' with 'args' and store result (or exception) in 'st'
+template<typename R,typename F,typename...A>
+void fulfil(std::true_type,fstate<R>&st,F&f,A const&...args){
+  f(args...);
+  st.set_value(tpool::void_t{});
+}
+template<typename R,typename F,typename...A>
+void fulfil(std::false_type,fstate<R>&st,F&f,A const&...args){
+  st.set_value(f(args...));
+}
+template<typename R,typename F,typename...A>
+void fulfil(fstate<fut_type<R>>&st,F&f,A const&...args){
+  try{
+    fulfil<fut_type<R>>(std::is_void<R>(),st,f,args...);
+  }
+  catch(...){
+    st.set_exception(std::current_exception());
+  }
+}
+// make tuple of values of ready futures
+// (braced init gets the values left to right so the first failed future in argument order throws)
+template<typename...T,std::size_t...I>
+std::tuple<T...>get_values(std::tuple<tpool_future<T>...>const&futs,std::index_sequence<I...>){
+  return std::tuple<T...>{std::get<I>(futs).get()...};
+}
+}
+
+// ------------------- tpool_future --------------
+template<typename T>
+class tpool_future{
+  template<typename U>friend class tpool_future;
+public:
+  using value_type=T;
+
+  // ctors
+  tpool_future()=default;
+  explicit tpool_future(std::shared_ptr<tpool_detail::fstate<T>>st):st_(std::move(st)){}
+
+  // check if future refers to a result
+  bool valid()const{return st_!=nullptr;}
+
+  // check if result is ready
+  bool ready()const{return st_->ready();}
+
+  // wait for result
+  void wait()const{st_->wait();}
+
+  // wait for and get result (rethrows exception thrown by task)
+  T const&get()const{
+    st_->wait();
+    if(st_->exception())std::rethrow_exception(st_->exception());
+    return st_->value();
+  }
+  // run f(result) on the pool once the result is ready
+  // (if the task failed, f is not called and the returned future holds the exception of the task)
+  template<typename F,typename R=typename std::result_of<F(T const&)>::type>
+  tpool_future<tpool_detail::fut_type<R>>then(F f)const{
+    using RT=tpool_detail::fut_type<R>;
+    auto next=std::make_shared<tpool_detail::fstate<RT>>(st_->pool());
+    auto self=st_;
+    self->on_ready([self,next,f]()mutable{
+      if(self->exception()){
+        next->set_exception(self->exception());
+        return;
+      }
+      self->schedule([self,next,f]()mutable{tpool_detail::fulfil<R>(*next,f,self->value());});
+    });
+    return tpool_future<RT>(next);
+  }
+  // get shared state (internal use)
+  std::shared_ptr<tpool_detail::fstate<T>>const&state()const{return st_;}
+private:
+  std::shared_ptr<tpool_detail::fstate<T>>st_;
+};
+// run f() on pool and return a future for the result
+template<typename F,typename R=typename std::result_of<F()>::type>
+tpool_future<tpool_detail::fut_type<R>>spawn(tpool&tp,F f){
+  auto st=std::make_shared<tpool_detail::fstate<tpool_detail::fut_type<R>>>(&tp);
+  tp.submit_detached([st,f]()mutable{tpool_detail::fulfil<R>(*st,f);});
+  return tpool_future<tpool_detail::fut_type<R>>(st);
+}
+// make a future which is ready with 'v' (continuations run directly in the thread calling then())
+template<typename T>
+tpool_future<T>make_ready_future(T v){
+  auto st=std::make_shared<tpool_detail::fstate<T>>(nullptr);
+  st->set_value(std::move(v));
+  return tpool_future<T>(st);
+}
+// future ready when all futures are ready - holds a tuple of the results
+// (if some task failed, the future holds the exception of the first failed future in argument order)
+template<typename T,typename...U>
+tpool_future<std::tuple<T,U...>>when_all(tpool_future<T>const&f,tpool_future<U>const&...fs){
+  using R=std::tuple<T,U...>;
+  auto st=std::make_shared<tpool_detail::fstate<R>>(f.state()->pool());
+  auto futs=std::make_shared<std::tuple<tpool_future<T>,tpool_future<U>...>>(f,fs...);
+  auto pending=std::make_shared<std::atomic<std::size_t>>(1+sizeof...(U));
+  auto done=[st,futs,pending](){
+    if(pending->fetch_sub(1,std::memory_order_acq_rel)!=1)return;
+    try{
+      st->set_value(tpool_detail::get_values(*futs,std::index_sequence_for<T,U...>()));
+    }
+    catch(...){
+      st->set_exception(std::current_exception());
+    }
+  };
+  f.state()->on_ready(done);
+  int dummy[]{0,(fs.state()->on_ready(done),0)...};
+  (void)dummy;
+  return tpool_future<R>(st);
+}
+// future ready when all futures in a vector are ready - holds a vector of the results
+// (if some task failed, the future holds the exception of the first failed future in the vector)
+template<typename T>
+tpool_future<std::vector<T>>when_all(std::vector<tpool_future<T>>const&fs){
+  if(fs.empty())return make_ready_future(std::vector<T>());
+  auto st=std::make_shared<tpool_detail::fstate<std::vector<T>>>(fs.front().state()->pool());
+  auto futs=std::make_shared<std::vector<tpool_future<T>>>(fs);
+  auto pending=std::make_shared<std::atomic<std::size_t>>(fs.size());
+  auto done=[st,futs,pending](){
+    if(pending->fetch_sub(1,std::memory_order_acq_rel)!=1)return;
+    try{
+      std::vector<T>ret;
+      ret.reserve(futs->size());
+      for(auto const&f:*futs)ret.push_back(f.get());
+      st->set_value(std::move(ret));
+    }
+    catch(...){
+      st->set_exception(std::current_exception());
+    }
+  };
+  for(auto const&f:fs)f.state()->on_ready(done);
+  return tpool_future<std::vector<T>>(st);
+}
+// future ready when the first future in a vector is ready - holds the index and the result of that future
+// (if the first future to be ready failed, the future holds its exception)
+// (throws std::invalid_argument if the vector is empty)
+template<typename T>
+tpool_future<std::pair<std::size_t,T>>when_any(std::vector<tpool_future<T>>const&fs){
+  using R=std::pair<std::size_t,T>;
+  if(fs.empty())throw std::invalid_argument("when_any: no futures");
+  auto st=std::make_shared<tpool_detail::fstate<R>>(fs.front().state()->pool());
+  auto first=std::make_shared<std::atomic<bool>>(false);
+  for(std::size_t i=0;i<fs.size();++i){
+    tpool_future<T>f(fs[i]);
+    f.state()->on_ready([st,first,f,i](){
+      if(first->exchange(true,std::memory_order_acq_rel))return;
+      if(f.state()->exception())st->set_exception(f.state()->exception());
+      else st->set_value(R(i,f.state()->value()));
+    });
+  }
+  return tpool_future<R>(st);
+}
+
+// ------------------- task_graph --------------
+// graph of tasks where a task runs once all tasks it depends on are done
+// (dependencies of a task must be added before the task, so the graph cannot have cycles)
+// (a task whose dependency failed is skipped - the future returned by run() holds the exception of the first failed task)
+// (the graph can be run once - the graph object may be destroyed while the graph is running)
+class task_graph{
+public:
+  // id of a task in the graph
+  using node_id=std::size_t;
+
+  // ctor
+  explicit task_graph(tpool&tp):st_(std::make_shared<state>(tp)){}
+
+  // add task running f() after the tasks in 'deps'
+  // (throws std::invalid_argument if a dependency is not in the graph and std::logic_error if the graph has been run)
+  template<typename F>
+  node_id add(F f,std::vector<node_id>const&deps=std::vector<node_id>()){
+    if(st_->started)throw std::logic_error("task_graph::add: graph has already been run");
+    node_id id{st_->nodes.size()};
+    for(node_id d:deps){
+      if(d>=id)throw std::invalid_argument("task_graph::add: unknown dependency");
+    }
+    st_->nodes.emplace_back(new node(std::function<void()>(std::move(f)),deps.size()));
+    for(node_id d:deps)st_->nodes[d]->succ.push_back(id);
+    return id;
+  }
+  // get #of tasks
+  std::size_t size()const{return st_->nodes.size();}
+
+  // start tasks without dependencies - others are started when their dependencies are done
+  // (the returned future is ready when all tasks are done)
+  // (throws std::logic_error if the graph has already been run)
+  tpool_future<tpool::void_t>run(){
+    if(st_->started)throw std::logic_error("task_graph::run: graph has already been run");
+    st_->started=true;
+    auto ret=tpool_future<tpool::void_t>(st_->done);
+    st_->remaining.store(st_->nodes.size(),std::memory_order_relaxed);
+    if(st_->nodes.empty()){
+      st_->done->set_value(tpool::void_t{});
+      return ret;
+    }
+    std::shared_ptr<state>st(st_);
+    for(node_id i=0;i<st->nodes.size();++i){
+      if(st->nodes[i]->ndeps==0)st->tp.submit_detached([st,i](){run_node(st,i);});
+    }
+    return ret;
+  }
+private:
+  // a task in the graph
+  struct node{
+    node(std::function<void()>f,std::size_t n):f(std::move(f)),ndeps(n),pending(n){}
+    std::function<void()>f;                    // function to run
+    std::size_t const ndeps;                   // #of dependencies
+    std::atomic<std::size_t>pending;           // #of dependencies not yet done
+    std::atomic<bool>skip{false};              // set if some dependency failed or was skipped
+    std::vector<node_id>succ;                  // tasks depending on this task
+  };
+  // state shared with running tasks
+  struct state{
+    explicit state(tpool&tp):tp(tp),done(std::make_shared<tpool_detail::fstate<tpool::void_t>>(&tp)){}
+    tpool&tp;
+    std::vector<std::unique_ptr<node>>nodes;
+    bool started=false;
+    std::atomic<std::size_t>remaining{0};      // #of tasks not yet done
+    std::shared_ptr<tpool_detail::fstate<tpool::void_t>>done;
+    std::mutex mtx;
+    std::exception_ptr exc;                    // exception of first failed task
+  };
+  // run task and start tasks which are no longer waiting for dependencies
+  static void run_node(std::shared_ptr<state>const&st,node_id i){
+    node&n(*st->nodes[i]);
+    bool failed{n.skip.load(std::memory_order_relaxed)};
+    if(!failed){
+      try{
+        n.f();
+      }
+      catch(...){
+        std::unique_lock<std::mutex>lock(st->mtx);
+        if(!st->exc)st->exc=std::current_exception();
+        failed=true;
+      }
+    }
+    for(node_id s:n.succ){
+      node&sn(*st->nodes[s]);
+      if(failed)sn.skip.store(true,std::memory_order_relaxed);
+      if(sn.pending.fetch_sub(1,std::memory_order_acq_rel)==1)st->tp.submit_detached([st,s](){run_node(st,s);});
+    }
+    if(st->remaining.fetch_sub(1,std::memory_order_acq_rel)!=1)return;
+    std::exception_ptr exc;
+    {
+      std::unique_lock<std::mutex>lock(st->mtx);
+      exc=st->exc;
+    }
+    if(exc)st->done->set_exception(exc);
+    else st->done->set_value(tpool::void_t{});
+  }
+  std::shared_ptr<state>st_;
+};
+}
+#endif
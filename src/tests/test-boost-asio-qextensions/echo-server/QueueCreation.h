@@ -60,4 +60,20 @@ queue_struct createSymetricIpQueues(){
   ret.qclientReceive=std::make_shared<SockClientQueue>(server,serverListenPortSend,msgDeserializer,msgSerializer,sep);
   return ret;
 }
+// create unix domain socket queues with Service being the server on both queues (same host only)
+queue_struct createSymetricUnixQueues(){
+  queue_struct ret;
+
+  // socket paths
+  boost::asio::unix_endpoint const serverReceive{"/tmp/echo-server-receive.sock"};
+  boost::asio::unix_endpoint const serverSend{"/tmp/echo-server-send.sock"};
+
+  // create 4 queues
+  ret.qserviceReceive=std::make_shared<SockServQueue>(serverReceive,msgDeserializer,msgSerializer,sep);
+  ret.qserviceReply=std::make_shared<SockServQueue>(serverSend,msgDeserializer,msgSerializer,sep);
+
+  ret.qclientRequest=std::make_shared<SockClientQueue>(serverReceive,msgDeserializer,msgSerializer,sep);
+  ret.qclientReceive=std::make_shared<SockClientQueue>(serverSend,msgDeserializer,msgSerializer,sep);
+  return ret;
+}
 #endif
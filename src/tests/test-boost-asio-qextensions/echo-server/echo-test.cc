@@ -41,6 +41,7 @@ int main(){
 //  queue_struct queues=createMemQueues();
 //  queue_struct queues=createAsymetricIpQueues();
   queue_struct queues=createSymetricIpQueues();
+//  queue_struct queues=createSymetricUnixQueues();
 
   // --- create service
   Service serv(::ios,queues.qserviceReceive,queues.qserviceReply);
@@ -0,0 +1,39 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0. 
+
+#ifndef __QTEST_SUPPORT_H__
+#define __QTEST_SUPPORT_H__
+#include <string>
+#include <iostream>
+
+// helpers shared by the queue extension test programs
+namespace qtest{
+
+// report result of a check
+inline bool check(bool stat,std::string const&what){
+  if(!stat)std::cerr<<"FAILED: "<<what<<std::endl;
+  return stat;
+}
+// collect results of the tests run by a test program
+class results{
+public:
+  // record result of a test
+  results&operator+=(bool stat){
+    ok_=ok_&&stat;
+    return*this;
+  }
+  // record and print result of a named test
+  void add(std::string const&name,bool stat){
+    std::cout<<name<<": "<<(stat?"ok":"FAILED")<<std::endl;
+    *this+=stat;
+  }
+  // print overall result and return exit status of the test program
+  int report()const{
+    std::cout<<(ok_?"ok":"FAILED")<<std::endl;
+    return ok_?0:1;
+  }
+private:
+  bool ok_=true;
+};
+}
+#endif
@@ -0,0 +1,82 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0. 
+
+/*
+startup benchmark for a polldir_queue holding a large backlog (default 1M messages)
+the program fills a queue directory, closes the queue and measures the time it takes to re-open the queue,
+check if it is empty and dequeue the first message
+for comparison the time to list, stat and sort the directory (which is what a directory scan based queue does on startup) is also measured
+
+usage: test12 [#messages] [queue directory]
+*/
+
+#include <boost/polldir_queue.hpp>
+#include "general-tools/stopwatch.h"
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <string>
+#include <map>
+#include <iostream>
+using namespace std;
+using namespace utils;
+
+namespace asio= boost::asio;
+namespace fs=boost::filesystem;
+
+// serialization functions
+function<string(istream&)>deserialiser=[](istream&is){
+  string line;
+  getline(is,line);
+  return line;
+};
+function<void(ostream&,string const&)>serialiser=[](ostream&os,string const&s){ 
+  os<<s<<endl;
+};
+using queue_t=asio::polldir_queue<string,decltype(deserialiser),decltype(serialiser)>;
+
+// test program
+int main(int argc,char*argv[]){
+  size_t nmsg{argc>1?boost::lexical_cast<size_t>(argv[1]):1000000};
+  fs::path qdir{argc>2?argv[2]:"./q12"};
+  string qname{"q12"};
+
+  // start with an empty queue
+  fs::remove_all(qdir);
+  fs::create_directory(qdir);
+  queue_t::removeLockVariables(qname);
+
+  // fill queue
+  steady_stopwatch sw;
+  sw.click();
+  {
+    queue_t q{qname,0,qdir,deserialiser,serialiser,false};
+    for(size_t i=0;i<nmsg;++i){
+      boost::system::error_code ec;
+      q.enq(boost::lexical_cast<string>(i),ec);
+    }
+  }
+  sw.click();
+  cerr<<"enqueued "<<nmsg<<" messages in "<<sw.getElapsedTimeSec()<<" sec"<<endl;
+
+  // re-open queue, check if empty and dequeue first message
+  sw.reset();
+  sw.click();
+  {
+    queue_t q{qname,0,qdir,deserialiser,serialiser,true};
+    bool empty{q.empty()};
+    boost::system::error_code ec;
+    pair<bool,string>msg{q.deq(ec)};
+    sw.click();
+    cerr<<"re-open + empty() + deq(): "<<sw.getElapsedTimeMs()<<" ms (empty: "<<empty<<", first message: "<<msg.second<<")"<<endl;
+  }
+  // for comparison: list, stat and sort the queue directory
+  sw.reset();
+  sw.click();
+  multimap<time_t,fs::path>files;
+  for(fs::directory_iterator it(qdir);it!=fs::directory_iterator();++it){
+    if(is_regular_file(*it))files.insert(make_pair(last_write_time(*it),it->path()));
+  }
+  sw.click();
+  cerr<<"directory scan of "<<files.size()<<" files: "<<sw.getElapsedTimeMs()<<" ms"<<endl;
+  fs::remove_all(qdir);
+}
@@ -0,0 +1,99 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0. 
+
+/*
+throughput benchmark for a sockdeq_serv_queue with many concurrent producer connections
+the program starts a server queue with 1, 2, 4 and 8 reactor threads, connects 64 producers (default) each sending
+a number of messages and measures the time it takes until all messages have been dequeued
+each message carries the producer id and a sequence number - the program fails if a producer's messages are not
+all dequeued exactly once and in order
+
+usage: test13 [#producers] [#messages per producer] [port]
+*/
+
+#include <boost/sockdeq_serv_queue.hpp>
+#include <boost/sockclient_queue.hpp>
+#include "general-tools/stopwatch.h"
+#include <boost/lexical_cast.hpp>
+#include <string>
+#include <vector>
+#include <thread>
+#include <memory>
+#include <iostream>
+#include <cstdlib>
+using namespace std;
+using namespace utils;
+
+namespace asio= boost::asio;
+
+// serialization functions
+auto deserialiser=[](char const*msg,size_t len){return string(msg,len);};
+auto serialiser=[](string&out,string const&s){out.append(s);};
+using base_t=asio::detail::base::queue_empty_base<string>;
+using server_t=asio::sockdeq_serv_queue<string,decltype(deserialiser),base_t,std::queue<string>,asio::varint_framing>;
+using client_t=asio::sockclient_queue<string,decltype(deserialiser),decltype(serialiser),base_t,asio::varint_framing>;
+
+// test program
+int main(int argc,char*argv[]){
+  size_t nprod{argc>1?boost::lexical_cast<size_t>(argv[1]):64};
+  size_t nmsg{argc>2?boost::lexical_cast<size_t>(argv[2]):20000};
+  int port{argc>3?boost::lexical_cast<int>(argv[3]):7790};
+  string const padding(48,'x');
+
+  for(size_t nthreads:{1,2,4,8}){
+    server_t qserv{port,deserialiser,nprod,50,asio::varint_framing{},nthreads};
+
+    // create producer queues up front (client queues resolve the server name when created)
+    vector<unique_ptr<client_t>>clients;
+    for(size_t i=0;i<nprod;++i){
+      clients.push_back(make_unique<client_t>("localhost",port,deserialiser,serialiser,asio::varint_framing{},asio::cork_options{64*1024,1000}));
+    }
+    // start producers - each producer batches messages so the server side is the bottleneck
+    steady_stopwatch sw;
+    sw.click();
+    vector<thread>producers;
+    for(size_t i=0;i<nprod;++i){
+      producers.emplace_back([&,i](){
+        client_t&qclient(*clients[i]);
+        boost::system::error_code ec;
+        for(size_t j=0;j<nmsg;++j)qclient.enq(to_string(i)+":"+to_string(j)+":"+padding,ec);
+        qclient.flush(ec);
+        if(ec)cerr<<"producer failed: "<<ec.message()<<endl;
+      });
+    }
+    // dequeue all messages and check that messages from a producer arrive in order
+    size_t ndeq{0};
+    bool ok{true};
+    vector<size_t>next(nprod,0);
+    for(;ndeq<nprod*nmsg;++ndeq){
+      boost::system::error_code ec;
+      pair<bool,string>msg{qserv.timed_deq(5000,ec)};
+      if(!msg.first){
+        cerr<<"deq failed after "<<ndeq<<" messages: "<<ec.message()<<endl;
+        ok=false;
+        break;
+      }
+      size_t sep{msg.second.find(':')};
+      size_t prod{stoul(msg.second.substr(0,sep))};
+      size_t seq{stoul(msg.second.substr(sep+1))};
+      if(prod>=nprod||seq!=next[prod]){
+        cerr<<"unexpected message: "<<msg.second.substr(0,msg.second.rfind(':'))<<endl;
+        ok=false;
+        break;
+      }
+      ++next[prod];
+    }
+    sw.click();
+    for(auto&p:producers)p.join();
+    for(size_t i=0;i<nprod&&ok;++i){
+      if(next[i]!=nmsg){
+        cerr<<"producer "<<i<<": dequeued "<<next[i]<<" of "<<nmsg<<" messages"<<endl;
+        ok=false;
+      }
+    }
+    if(!ok)return 1;
+    double sec{sw.getElapsedTimeSec()};
+    cerr<<"reactor threads: "<<nthreads<<", producers: "<<nprod<<", messages: "<<ndeq<<", "<<sec<<" sec, "<<static_cast<size_t>(ndeq/sec)<<" msg/sec"<<endl;
+    ++port;
+  }
+}
@@ -0,0 +1,105 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0. 
+
+/*
+test program for the durability policies of polldir_queue
+for each policy (none, fsync, group_commit) the program runs a number of producer threads enqueuing messages while a
+consumer dequeues them concurrently from a separate queue object - the program fails if an enq reports an error or if
+the consumer does not get every message exactly once and in the order each producer enqueued them
+
+usage: test14 [#producers] [#messages per producer] [queue directory]
+*/
+
+#include <boost/polldir_queue.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <iostream>
+#include "../qtest-support.h"
+using namespace std;
+
+namespace asio= boost::asio;
+namespace fs=boost::filesystem;
+
+// serialization functions
+function<string(istream&)>deserialiser=[](istream&is){
+  string line;
+  getline(is,line);
+  return line;
+};
+function<void(ostream&,string const&)>serialiser=[](ostream&os,string const&s){ 
+  os<<s<<endl;
+};
+using queue_t=asio::polldir_queue<string,decltype(deserialiser),decltype(serialiser)>;
+
+// run producers and a consumer on a queue with a durability policy
+// (returns true if all messages were enqueued and dequeued correctly)
+bool run(asio::queue_durability durability,size_t nprod,size_t nmsg,fs::path const&qdir){
+  string const qname{"q14"};
+  fs::remove_all(qdir);
+  fs::create_directory(qdir);
+  queue_t::removeLockVariables(qname);
+  queue_t qprod{qname,0,qdir,deserialiser,serialiser,false,durability,200};
+  queue_t qcons{qname,0,qdir,deserialiser,serialiser,true};
+
+  // producers - each message is '<producer>:<sequence number>'
+  atomic<size_t>nfailed{0};
+  vector<thread>producers;
+  for(size_t i=0;i<nprod;++i){
+    producers.emplace_back([&,i](){
+      for(size_t j=0;j<nmsg;++j){
+        boost::system::error_code ec;
+        if(!qprod.enq(to_string(i)+":"+to_string(j),ec)){
+          if(nfailed++==0)cerr<<"enq failed: "<<ec.message()<<endl;
+        }
+      }
+    });
+  }
+  // consumer
+  bool ok{true};
+  vector<size_t>next(nprod,0);
+  for(size_t n=0;n<nprod*nmsg;++n){
+    boost::system::error_code ec;
+    pair<bool,string>msg{qcons.timed_deq(5000,ec)};
+    if(!msg.first){
+      cerr<<"deq failed after "<<n<<" messages: "<<ec.message()<<endl;
+      ok=false;
+      break;
+    }
+    size_t sep{msg.second.find(':')};
+    size_t prod{stoul(msg.second.substr(0,sep))};
+    size_t seq{stoul(msg.second.substr(sep+1))};
+    if(prod>=nprod||seq!=next[prod]){
+      cerr<<"unexpected message: "<<msg.second<<endl;
+      ok=false;
+      break;
+    }
+    ++next[prod];
+  }
+  for(auto&p:producers)p.join();
+  if(nfailed>0){
+    cerr<<nfailed<<" enqs failed"<<endl;
+    ok=false;
+  }
+  if(ok&&!qcons.empty()){
+    cerr<<"queue not empty after all messages were dequeued"<<endl;
+    ok=false;
+  }
+  return ok;
+}
+// test program
+int main(int argc,char*argv[]){
+  size_t nprod{argc>1?boost::lexical_cast<size_t>(argv[1]):4};
+  size_t nmsg{argc>2?boost::lexical_cast<size_t>(argv[2]):500};
+  fs::path qdir{argc>3?argv[3]:"./q14"};
+
+  qtest::results res;
+  for(auto durability:{asio::queue_durability::none,asio::queue_durability::fsync,asio::queue_durability::group_commit}){
+    res.add("durability: "+to_string(static_cast<int>(durability)),run(durability,nprod,nmsg,qdir));
+  }
+  fs::remove_all(qdir);
+  return res.report();
+}
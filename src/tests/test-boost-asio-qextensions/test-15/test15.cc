@@ -0,0 +1,146 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0. 
+
+/*
+test program for polldir_queue consumers reading ahead
+the program runs a producer and several consumers, each consumer having its own queue object with a read-ahead
+buffer, and checks that every message is dequeued exactly once
+it then checks that a read-ahead consumer stops cleanly: the consumer is moved while its read-ahead thread runs and
+is destroyed holding messages it has read ahead but not dequeued - those messages must be put back into the queue
+
+usage: test15 [#consumers] [#messages] [queue directory]
+*/
+
+#include <boost/polldir_queue.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include "../qtest-support.h"
+using namespace std;
+
+namespace asio= boost::asio;
+namespace fs=boost::filesystem;
+
+// serialization functions
+function<size_t(istream&)>deserialiser=[](istream&is){
+  size_t ret;
+  is>>ret;
+  return ret;
+};
+function<void(ostream&,size_t)>serialiser=[](ostream&os,size_t i){ 
+  os<<i;
+};
+using queue_t=asio::polldir_queue<size_t,decltype(deserialiser),decltype(serialiser)>;
+string const qname{"q15"};
+size_t const READAHEAD{16};
+
+// dequeue messages with several read-ahead consumers while a producer enqueues messages
+bool testConsumers(size_t ncons,size_t nmsg,fs::path const&qdir){
+  queue_t qprod{qname,0,qdir,deserialiser,serialiser,false};
+  vector<atomic<int>>seen(nmsg);
+  for(auto&s:seen)s.store(0);
+  atomic<size_t>ndeq{0};
+  thread producer([&](){
+    for(size_t i=0;i<nmsg;++i){
+      boost::system::error_code ec;
+      qprod.enq(i,ec);
+    }
+  });
+  vector<thread>consumers;
+  for(size_t i=0;i<ncons;++i){
+    consumers.emplace_back([&](){
+      queue_t qcons{qname,0,qdir,deserialiser,serialiser,false,asio::queue_durability::none,0,READAHEAD};
+      auto tmo=chrono::steady_clock::now()+chrono::seconds(30);
+      while(ndeq.load()<nmsg&&chrono::steady_clock::now()<tmo){
+        boost::system::error_code ec;
+        pair<bool,size_t>msg{qcons.timed_deq(100,ec)};
+        if(!msg.first)continue;
+        if(msg.second<nmsg)++seen[msg.second];
+        ++ndeq;
+      }
+    });
+  }
+  producer.join();
+  for(auto&c:consumers)c.join();
+  bool ok{ndeq.load()==nmsg};
+  for(size_t i=0;i<nmsg;++i){
+    if(seen[i].load()!=1){
+      cerr<<"message "<<i<<" dequeued "<<seen[i].load()<<" times"<<endl;
+      ok=false;
+    }
+  }
+  if(ndeq.load()!=nmsg)cerr<<"dequeued "<<ndeq.load()<<" of "<<nmsg<<" messages"<<endl;
+  return ok;
+}
+// check that a read-ahead consumer can be moved and destroyed while holding read-ahead messages
+bool testStop(size_t nmsg,fs::path const&qdir){
+  queue_t qprod{qname,0,qdir,deserialiser,serialiser,false};
+  for(size_t i=0;i<nmsg;++i){
+    boost::system::error_code ec;
+    qprod.enq(i,ec);
+  }
+  size_t const ntake{nmsg/4};
+  vector<int>seen(nmsg,0);
+  auto t0=chrono::steady_clock::now();
+  {
+    queue_t q1{qname,0,qdir,deserialiser,serialiser,false,asio::queue_durability::none,0,READAHEAD};
+    unique_ptr<queue_t>q2{new queue_t(std::move(q1))};
+    for(size_t i=0;i<ntake;++i){
+      boost::system::error_code ec;
+      pair<bool,size_t>msg{q2->timed_deq(5000,ec)};
+      if(!msg.first||msg.second>=nmsg){
+        cerr<<"read-ahead deq failed: "<<ec.message()<<endl;
+        return false;
+      }
+      ++seen[msg.second];
+    }
+  }
+  double ms{chrono::duration<double,milli>(chrono::steady_clock::now()-t0).count()};
+  if(ms>2000){
+    cerr<<"stopping read-ahead consumer took "<<ms<<" ms"<<endl;
+    return false;
+  }
+  // remaining messages (including those read ahead) must still be in the queue
+  if(qprod.size()!=nmsg-ntake){
+    cerr<<"queue holds "<<qprod.size()<<" messages, expected "<<nmsg-ntake<<endl;
+    return false;
+  }
+  for(size_t i=ntake;i<nmsg;++i){
+    boost::system::error_code ec;
+    pair<bool,size_t>msg{qprod.timed_deq(1000,ec)};
+    if(!msg.first||msg.second>=nmsg){
+      cerr<<"deq failed: "<<ec.message()<<endl;
+      return false;
+    }
+    ++seen[msg.second];
+  }
+  for(size_t i=0;i<nmsg;++i){
+    if(seen[i]!=1){
+      cerr<<"message "<<i<<" dequeued "<<seen[i]<<" times"<<endl;
+      return false;
+    }
+  }
+  return qprod.empty();
+}
+// test program
+int main(int argc,char*argv[]){
+  size_t ncons{argc>1?boost::lexical_cast<size_t>(argv[1]):3};
+  size_t nmsg{argc>2?boost::lexical_cast<size_t>(argv[2]):2000};
+  fs::path qdir{argc>3?argv[3]:"./q15"};
+
+  fs::remove_all(qdir);
+  fs::create_directory(qdir);
+  queue_t::removeLockVariables(qname);
+  qtest::results res;
+  res.add("read-ahead consumers",testConsumers(ncons,nmsg,qdir));
+  res.add("read-ahead stop",testStop(100,qdir));
+  queue_t::removeLockVariables(qname);
+  fs::remove_all(qdir);
+  return res.report();
+}
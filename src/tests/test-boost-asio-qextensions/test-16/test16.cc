@@ -0,0 +1,203 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0. 
+
+/*
+test program for polldir_queue consumers claiming messages without the queue lock
+- several producers with a durable policy (fsync, group_commit) and several consumers, each consumer having its own
+  queue object, run concurrently - every enq must succeed and every message must be dequeued exactly once
+- two threads race to claim the same file - exactly one must win
+- a child process claims messages (through a read-ahead consumer) and leaves a partially written file, then dies -
+  opening the queue must put the claimed messages back, remove the partially written file and leave files owned by
+  live processes alone
+
+usage: test16 [#producers] [#consumers] [#messages per producer] [queue directory]
+*/
+
+#include <boost/polldir_queue.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../qtest-support.h"
+using namespace std;
+
+namespace asio= boost::asio;
+namespace fs=boost::filesystem;
+namespace qs=boost::asio::detail::queue_support;
+
+// serialization functions
+function<size_t(istream&)>deserialiser=[](istream&is){
+  size_t ret;
+  is>>ret;
+  return ret;
+};
+function<void(ostream&,size_t)>serialiser=[](ostream&os,size_t i){ 
+  os<<i;
+};
+using queue_t=asio::polldir_queue<size_t,decltype(deserialiser),decltype(serialiser)>;
+string const qname{"q16"};
+
+// start with an empty queue directory
+void resetQueue(fs::path const&qdir){
+  fs::remove_all(qdir);
+  fs::create_directory(qdir);
+  queue_t::removeLockVariables(qname);
+}
+// count files in a directory
+size_t nfiles(fs::path const&dir){
+  return std::distance(fs::directory_iterator(dir),fs::directory_iterator());
+}
+// dequeue messages [0,nmsg) - each message must be dequeued exactly once
+bool deqAll(queue_t&q,size_t nmsg){
+  vector<int>seen(nmsg,0);
+  for(size_t i=0;i<nmsg;++i){
+    boost::system::error_code ec;
+    pair<bool,size_t>msg{q.timed_deq(1000,ec)};
+    if(!msg.first||msg.second>=nmsg||seen[msg.second]++>0){
+      cerr<<"deq failed after "<<i<<" messages: "<<ec.message()<<endl;
+      return false;
+    }
+  }
+  return q.empty();
+}
+// several durable producers and several consumers
+bool testConcurrent(asio::queue_durability durability,size_t nprod,size_t ncons,size_t nmsg,fs::path const&qdir){
+  resetQueue(qdir);
+  queue_t qprod{qname,0,qdir,deserialiser,serialiser,false,durability,200};
+  size_t const total{nprod*nmsg};
+  vector<atomic<int>>seen(total);
+  for(auto&s:seen)s.store(0);
+  atomic<size_t>nfailed{0},ndeq{0};
+  vector<thread>threads;
+  for(size_t i=0;i<nprod;++i){
+    threads.emplace_back([&,i](){
+      for(size_t j=0;j<nmsg;++j){
+        boost::system::error_code ec;
+        if(!qprod.enq(i*nmsg+j,ec)&&nfailed++==0)cerr<<"enq failed: "<<ec.message()<<endl;
+      }
+    });
+  }
+  for(size_t i=0;i<ncons;++i){
+    threads.emplace_back([&](){
+      queue_t qcons{qname,0,qdir,deserialiser,serialiser,false};
+      auto tmo=chrono::steady_clock::now()+chrono::seconds(30);
+      while(ndeq.load()<total&&chrono::steady_clock::now()<tmo){
+        boost::system::error_code ec;
+        pair<bool,size_t>msg{qcons.timed_deq(100,ec)};
+        if(!msg.first)continue;
+        if(msg.second<total)++seen[msg.second];
+        ++ndeq;
+      }
+    });
+  }
+  for(auto&t:threads)t.join();
+  bool ok{nfailed.load()==0&&ndeq.load()==total};
+  for(size_t i=0;i<total;++i){
+    if(seen[i].load()!=1){
+      cerr<<"message "<<i<<" dequeued "<<seen[i].load()<<" times"<<endl;
+      ok=false;
+      break;
+    }
+  }
+  if(nfailed.load()>0)cerr<<nfailed.load()<<" enqs failed"<<endl;
+  return ok;
+}
+// two threads racing to claim the same file
+bool testClaimRace(fs::path const&qdir){
+  resetQueue(qdir);
+  fs::path const claimdir{qdir/".claimed"};
+  fs::create_directory(claimdir);
+  for(int i=0;i<200;++i){
+    fs::path file{qdir/"msg"};
+    ofstream{file.string()}<<i;
+    fs::path c1,c2;
+    thread t1([&](){c1=qs::claim(file,claimdir);});
+    thread t2([&](){c2=qs::claim(file,claimdir);});
+    t1.join();
+    t2.join();
+    if(c1.empty()==c2.empty()){
+      cerr<<"claim race: "<<(c1.empty()?"no thread":"both threads")<<" claimed the file"<<endl;
+      return false;
+    }
+    fs::path const&claimed{c1.empty()?c2:c1};
+    if(claimed.filename().string()!=to_string(::getpid())+".msg"||!fs::exists(claimed)||fs::exists(file)){
+      cerr<<"claim race: unexpected claimed file: "<<claimed<<endl;
+      return false;
+    }
+    fs::remove(claimed);
+  }
+  return true;
+}
+// recover after a consumer process which died holding claimed messages and a partially written file
+bool testRecovery(size_t nmsg,fs::path const&qdir){
+  size_t const READAHEAD{8};
+  resetQueue(qdir);
+  fs::path const claimdir{qdir/".claimed"};
+  fs::path const tmpdir{qdir/".tmp"};
+  {
+    queue_t qprod{qname,0,qdir,deserialiser,serialiser,false};
+    for(size_t i=0;i<nmsg;++i){
+      boost::system::error_code ec;
+      qprod.enq(i,ec);
+    }
+  }
+  // child claims messages through its read-ahead buffer and dies without cleaning up
+  pid_t pid{::fork()};
+  if(pid<0){
+    cerr<<"fork failed"<<endl;
+    return false;
+  }
+  if(pid==0){
+    queue_t qcons{qname,0,qdir,deserialiser,serialiser,false,asio::queue_durability::none,0,READAHEAD};
+    ofstream{(tmpdir/(to_string(::getpid())+".partial")).string()}<<"partial";
+    auto tmo=chrono::steady_clock::now()+chrono::seconds(5);
+    while(nfiles(claimdir)<READAHEAD&&chrono::steady_clock::now()<tmo)this_thread::sleep_for(chrono::milliseconds(10));
+    ::_exit(0);
+  }
+  int status;
+  ::waitpid(pid,&status,0);
+  size_t nclaimed{nfiles(claimdir)};
+  if(nclaimed!=READAHEAD||nfiles(tmpdir)!=1){
+    cerr<<"child left "<<nclaimed<<" claimed and "<<nfiles(tmpdir)<<" partial files"<<endl;
+    return false;
+  }
+  // files owned by a live process (us) must survive recovery
+  fs::path const liveClaim{claimdir/(to_string(::getpid())+".live")};
+  fs::path const liveTmp{tmpdir/(to_string(::getpid())+".live")};
+  ofstream{liveClaim.string()}<<"live";
+  ofstream{liveTmp.string()}<<"live";
+
+  // opening the queue recovers claims and removes orphans of dead processes
+  queue_t q{qname,0,qdir,deserialiser,serialiser,false};
+  if(nfiles(claimdir)!=1||!fs::exists(liveClaim)||nfiles(tmpdir)!=1||!fs::exists(liveTmp)){
+    cerr<<"recovery left "<<nfiles(claimdir)<<" claimed and "<<nfiles(tmpdir)<<" partial files"<<endl;
+    return false;
+  }
+  fs::remove(liveClaim);
+  fs::remove(liveTmp);
+  return deqAll(q,nmsg);
+}
+// test program
+int main(int argc,char*argv[]){
+  size_t nprod{argc>1?boost::lexical_cast<size_t>(argv[1]):4};
+  size_t ncons{argc>2?boost::lexical_cast<size_t>(argv[2]):3};
+  size_t nmsg{argc>3?boost::lexical_cast<size_t>(argv[3]):500};
+  fs::path qdir{argc>4?argv[4]:"./q16"};
+
+  qtest::results res;
+  res.add("claim recovery",testRecovery(100,qdir));
+  res.add("claim race",testClaimRace(qdir));
+  res.add("fsync producers/consumers",testConcurrent(asio::queue_durability::fsync,nprod,ncons,nmsg,qdir));
+  res.add("group_commit producers/consumers",testConcurrent(asio::queue_durability::group_commit,nprod,ncons,nmsg,qdir));
+  queue_t::removeLockVariables(qname);
+  fs::remove_all(qdir);
+  return res.report();
+}
@@ -0,0 +1,156 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0. 
+
+/*
+test program for message framings of fd queues (sep_framing, varint_framing, fixed_framing)
+for each framing the program sends messages through a pipe using an fdenq_queue and an fddeq_queue and checks that:
+- messages of sizes from 0 bytes up to several read chunks arrive intact and in order (with and without corking)
+- a frame arriving in small pieces is reassembled
+- a frame longer than the receiver accepts is reported as message_size
+- a message longer than the sender's framing accepts is rejected with message_size and nothing is written
+- a varint header which does not fit in 64 bits is reported as message_size
+*/
+
+#include <boost/fddeq_queue.hpp>
+#include <boost/fdenq_queue.hpp>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <cstdint>
+#include <unistd.h>
+#include <fcntl.h>
+#include "../qtest-support.h"
+using namespace std;
+using qtest::check;
+
+namespace asio= boost::asio;
+
+// serialization functions
+// (messages handed to the de-serialiser include the separator with sep_framing)
+auto serialiser=[](string&out,string const&s){out.append(s);};
+auto deserialiser=[](char const*msg,size_t len){return string(msg,len);};
+auto sepDeserialiser=[](char const*msg,size_t len){return string(msg,len-1);};
+
+// get de-serialiser for a framing
+template<typename Framing>struct deser{using type=decltype(deserialiser);static type get(){return deserialiser;}};
+template<>struct deser<asio::sep_framing>{using type=decltype(sepDeserialiser);static type get(){return sepDeserialiser;}};
+
+// create a test message ('x' is used as filler since the separator framing may not contain '\n')
+string makeMsg(size_t i,size_t len){
+  string ret(len,'x');
+  string const id{to_string(i)};
+  ret.replace(0,min(len,id.size()),id,0,min(len,id.size()));
+  return ret;
+}
+// test a framing
+// (small is a framing accepting at most 16 byte messages)
+template<typename Framing>
+bool testFraming(string const&name,Framing const&framing,Framing const&small,bool lengthPrefixed){
+  using deq_t=asio::fddeq_queue<string,typename deser<Framing>::type,asio::detail::base::queue_empty_base<string>,Framing>;
+  using enq_t=asio::fdenq_queue<string,decltype(serialiser),asio::detail::base::queue_empty_base<string>,Framing>;
+  bool ok{true};
+
+  // messages of increasing size, with and without corking
+  vector<size_t>sizes{1,2,100,4095,4096,65535,65536,65537,300000};
+  if(lengthPrefixed)sizes.insert(sizes.begin(),0);
+  for(asio::cork_options cork:{asio::cork_options{},asio::cork_options{64*1024,1000}}){
+    int fd[2];
+    if(::pipe(fd)!=0)return check(false,name+": pipe");
+    deq_t qdeq{fd[0],deser<Framing>::get(),true,framing};
+    enq_t qenq{fd[1],serialiser,true,framing,cork};
+    thread sender([&](){
+      for(size_t i=0;i<sizes.size();++i){
+        boost::system::error_code ec;
+        if(!qenq.enq(makeMsg(i,sizes[i]),ec))cerr<<name<<": enq failed: "<<ec.message()<<endl;
+      }
+      boost::system::error_code ec;
+      qenq.flush(ec);
+    });
+    for(size_t i=0;i<sizes.size()&&ok;++i){
+      boost::system::error_code ec;
+      pair<bool,string>msg{qdeq.timed_deq(5000,ec)};
+      ok=check(msg.first&&msg.second==makeMsg(i,sizes[i]),name+": message of size "+to_string(sizes[i])+(cork.max_bytes?" (corked)":"")+": "+ec.message());
+    }
+    sender.join();
+  }
+  // frame arriving in small pieces
+  {
+    int fd[2];
+    if(::pipe(fd)!=0)return check(false,name+": pipe");
+    deq_t qdeq{fd[0],deser<Framing>::get(),true,framing};
+    string const msg{makeMsg(7,1000)};
+    boost::system::error_code ec;
+    string frame{asio::detail::queue_support::serialise(msg,framing,serialiser,ec)};
+    thread sender([&](){
+      for(size_t i=0;i<frame.size();i+=97){
+        if(::write(fd[1],frame.data()+i,min<size_t>(97,frame.size()-i))<0)break;
+        this_thread::sleep_for(chrono::milliseconds(1));
+      }
+    });
+    pair<bool,string>ret{qdeq.timed_deq(5000,ec)};
+    sender.join();
+    ::close(fd[1]);
+    ok=check(ret.first&&ret.second==msg,name+": partial frames: "+ec.message())&&ok;
+  }
+  // frame too large for receiver
+  {
+    int fd[2];
+    if(::pipe(fd)!=0)return check(false,name+": pipe");
+    deq_t qdeq{fd[0],deser<Framing>::get(),true,small};
+    enq_t qenq{fd[1],serialiser,true,framing};
+    boost::system::error_code ec;
+    qenq.enq(string(100,'x'),ec);
+    pair<bool,string>ret{qdeq.timed_deq(1000,ec)};
+    if(lengthPrefixed)ok=check(!ret.first&&ec==asio::error::message_size,name+": oversized frame at receiver: "+ec.message())&&ok;
+  }
+  // message too large for sender
+  if(lengthPrefixed){
+    int fd[2];
+    if(::pipe(fd)!=0)return check(false,name+": pipe");
+    deq_t qdeq{fd[0],deser<Framing>::get(),true,framing};
+    enq_t qenq{fd[1],serialiser,true,small};
+    boost::system::error_code ec;
+    bool stat{qenq.enq(string(100,'x'),ec)};
+    ok=check(!stat&&ec==asio::error::message_size,name+": oversized message at sender: "+ec.message())&&ok;
+    pair<bool,string>ret{qdeq.timed_deq(100,ec)};
+    ok=check(!ret.first&&ec==asio::error::timed_out,name+": oversized message was written")&&ok;
+  }
+  return ok;
+}
+// a varint header which does not fit in 64 bits must be rejected (a 10th byte can only carry bit 63)
+bool testVarintHeader(){
+  bool ok{true};
+  {
+    int fd[2];
+    if(::pipe(fd)!=0)return check(false,"varint_framing: pipe");
+    asio::fddeq_queue<string,decltype(deserialiser),asio::detail::base::queue_empty_base<string>,asio::varint_framing>qdeq{fd[0],deserialiser,true};
+    string const hdr{string(9,'\x80')+"\x02"+"x"};
+    if(::write(fd[1],hdr.data(),hdr.size())<0)return check(false,"varint_framing: write");
+    boost::system::error_code ec;
+    pair<bool,string>ret{qdeq.timed_deq(1000,ec)};
+    ok=check(!ret.first&&ec==asio::error::message_size,"varint_framing: malformed header: "+ec.message())&&ok;
+    ::close(fd[1]);
+  }
+  {
+    string const hdr{string(9,'\xff')+"\x01"};
+    size_t hdrlen{0},len{0};
+    boost::system::error_code ec;
+    bool stat{asio::varint_framing{SIZE_MAX}.length(hdr.data(),hdr.size(),hdrlen,len,ec)};
+    ok=check(stat&&hdrlen==10&&len==SIZE_MAX,"varint_framing: largest header: "+ec.message())&&ok;
+  }
+  return ok;
+}
+// test program
+int main(){
+  qtest::results res;
+  res+=testFraming("sep_framing",asio::sep_framing{},asio::sep_framing{},false);
+  res+=testFraming("varint_framing",asio::varint_framing{},asio::varint_framing{16},true);
+  res+=testFraming("fixed_framing",asio::fixed_framing{},asio::fixed_framing{16},true);
+
+  // a length which does not fit in a 4 byte header must be rejected
+  res+=check(asio::fixed_framing{}.fits(0xffffffff)&&!asio::fixed_framing{}.fits(std::size_t(1)<<32),"fixed_framing: header overflow");
+  res+=testVarintHeader();
+  return res.report();
+}
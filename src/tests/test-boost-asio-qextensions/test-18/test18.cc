@@ -0,0 +1,113 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0. 
+
+/*
+test program for chunked reads of fd and socket queues
+the program checks that:
+- many messages written with a single write() are all dequeued in order by an fddeq_queue (stream de-serialiser)
+- a message spanning several read chunks is dequeued intact
+- end of file is reported as asio::error::eof once all buffered messages have been dequeued
+- a sockserv_queue and a sockclient_queue exchange small and large messages in both directions
+
+usage: test18 [port]
+*/
+
+#include <boost/fddeq_queue.hpp>
+#include <boost/sockserv_queue.hpp>
+#include <boost/sockclient_queue.hpp>
+#include <boost/lexical_cast.hpp>
+#include <string>
+#include <vector>
+#include <thread>
+#include <iostream>
+#include <unistd.h>
+#include "../qtest-support.h"
+using namespace std;
+using qtest::check;
+
+namespace asio= boost::asio;
+
+// serialization functions
+auto streamDeserialiser=[](istream&is){string ret;getline(is,ret);return ret;};
+auto deserialiser=[](char const*msg,size_t len){return string(msg,len-1);};
+auto serialiser=[](string&out,string const&s){out.append(s);};
+using base_t=asio::detail::base::queue_empty_base<string>;
+using server_t=asio::sockserv_queue<string,decltype(deserialiser),decltype(serialiser),base_t>;
+using client_t=asio::sockclient_queue<string,decltype(deserialiser),decltype(serialiser),base_t>;
+
+// messages sent in tests - the last message spans several read chunks
+vector<string>makeMsgs(size_t n){
+  vector<string>ret;
+  for(size_t i=0;i<n;++i)ret.push_back("msg-"+to_string(i));
+  ret.push_back(string(200000,'x'));
+  return ret;
+}
+// fd queue reading many messages written in one go
+bool testPipe(){
+  bool ok{true};
+  vector<string>msgs{makeMsgs(5000)};
+  string all;
+  for(auto const&m:msgs)all+=m+"\n";
+
+  int fd[2];
+  if(::pipe(fd)!=0)return check(false,"pipe");
+  asio::fddeq_queue<string,decltype(streamDeserialiser)>qdeq{fd[0],streamDeserialiser,true};
+  thread writer([&](){
+    for(size_t i=0;i<all.size();){
+      ssize_t stat{::write(fd[1],all.data()+i,all.size()-i)};
+      if(stat<=0)break;
+      i+=stat;
+    }
+    ::close(fd[1]);
+  });
+  for(size_t i=0;i<msgs.size()&&ok;++i){
+    boost::system::error_code ec;
+    pair<bool,string>msg{qdeq.timed_deq(5000,ec)};
+    ok=check(msg.first&&msg.second==msgs[i],"pipe: message "+to_string(i)+": "+ec.message());
+  }
+  writer.join();
+  boost::system::error_code ec;
+  pair<bool,string>msg{qdeq.timed_deq(1000,ec)};
+  ok=check(!msg.first&&ec==asio::error::eof,"pipe: expected eof, got: "+ec.message())&&ok;
+  return ok;
+}
+// socket queues exchanging messages in both directions
+bool testSocket(int port){
+  bool ok{true};
+  vector<string>msgs{makeMsgs(2000)};
+  server_t qserv{port,deserialiser,serialiser};
+  client_t qclient{"localhost",port,deserialiser,serialiser};
+
+  // client -> server
+  thread sender([&](){
+    boost::system::error_code ec;
+    for(auto const&m:msgs)if(!qclient.enq(m,ec))cerr<<"client enq failed: "<<ec.message()<<endl;
+  });
+  for(size_t i=0;i<msgs.size()&&ok;++i){
+    boost::system::error_code ec;
+    pair<bool,string>msg{qserv.timed_deq(5000,ec)};
+    ok=check(msg.first&&msg.second==msgs[i],"client->server: message "+to_string(i)+": "+ec.message());
+  }
+  sender.join();
+
+  // server -> client
+  thread replier([&](){
+    boost::system::error_code ec;
+    for(auto const&m:msgs)if(!qserv.enq(m,ec))cerr<<"server enq failed: "<<ec.message()<<endl;
+  });
+  for(size_t i=0;i<msgs.size()&&ok;++i){
+    boost::system::error_code ec;
+    pair<bool,string>msg{qclient.timed_deq(5000,ec)};
+    ok=check(msg.first&&msg.second==msgs[i],"server->client: message "+to_string(i)+": "+ec.message());
+  }
+  replier.join();
+  return ok;
+}
+// test program
+int main(int argc,char*argv[]){
+  int port{argc>1?boost::lexical_cast<int>(argv[1]):7791};
+  qtest::results res;
+  res+=testPipe();
+  res+=testSocket(port);
+  return res.report();
+}
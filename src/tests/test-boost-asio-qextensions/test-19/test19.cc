@@ -0,0 +1,144 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0. 
+
+/*
+test program for corking (write coalescing) in fdenq_queue and sockclient_queue
+the program checks that:
+- messages are held back until max_bytes bytes are buffered or flush() is called
+- messages are written by the background thread once max_delay_us has passed
+- an error from a background flush is reported by the next enq()
+- buffered messages are written when the queue is destroyed
+- a corked sockclient_queue delivers all messages in order to a sockserv_queue
+
+usage: test19 [port]
+*/
+
+#include <boost/fddeq_queue.hpp>
+#include <boost/fdenq_queue.hpp>
+#include <boost/sockserv_queue.hpp>
+#include <boost/sockclient_queue.hpp>
+#include <boost/lexical_cast.hpp>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include "../qtest-support.h"
+using namespace std;
+using qtest::check;
+
+namespace asio= boost::asio;
+
+// serialization functions
+auto deserialiser=[](char const*msg,size_t len){return string(msg,len-1);};
+auto serialiser=[](string&out,string const&s){out.append(s);};
+using base_t=asio::detail::base::queue_empty_base<string>;
+using deq_t=asio::fddeq_queue<string,decltype(deserialiser)>;
+using enq_t=asio::fdenq_queue<string,decltype(serialiser)>;
+using server_t=asio::sockserv_queue<string,decltype(deserialiser),decltype(serialiser),base_t>;
+using client_t=asio::sockclient_queue<string,decltype(deserialiser),decltype(serialiser),base_t>;
+
+// check if there is data to read on an fd
+bool readable(int fd,int ms=0){
+  struct pollfd pfd{fd,POLLIN,0};
+  return ::poll(&pfd,1,ms)==1;
+}
+// dequeue n messages and check them
+bool deqMsgs(deq_t&q,size_t first,size_t n,string const&what){
+  for(size_t i=first;i<first+n;++i){
+    boost::system::error_code ec;
+    pair<bool,string>msg{q.timed_deq(1000,ec)};
+    if(!check(msg.first&&msg.second==to_string(i),what+": message "+to_string(i)+": "+ec.message()))return false;
+  }
+  return true;
+}
+// messages are written when max_bytes is reached or when flush() is called
+bool testMaxBytes(){
+  bool ok{true};
+  int fd[2];
+  if(::pipe(fd)!=0)return check(false,"pipe");
+  deq_t qdeq{fd[0],deserialiser,true};
+  enq_t qenq{fd[1],serialiser,true,'\n',asio::cork_options{100,0}};
+  boost::system::error_code ec;
+  for(size_t i=0;i<10;++i)qenq.enq(to_string(i),ec);
+  ok=check(!readable(fd[0],50),"max_bytes: messages written before max_bytes was reached")&&ok;
+  for(size_t i=10;i<50;++i)qenq.enq(to_string(i),ec);
+  ok=check(readable(fd[0]),"max_bytes: messages not written when max_bytes was reached")&&ok;
+  qenq.flush(ec);
+  ok=deqMsgs(qdeq,0,50,"max_bytes")&&ok;
+  ok=check(!readable(fd[0]),"max_bytes: unexpected data after flush")&&ok;
+  return ok;
+}
+// messages are written by the background thread after max_delay_us
+bool testMaxDelay(){
+  bool ok{true};
+  int fd[2];
+  if(::pipe(fd)!=0)return check(false,"pipe");
+  deq_t qdeq{fd[0],deserialiser,true};
+  enq_t qenq{fd[1],serialiser,true,'\n',asio::cork_options{0,100000}};
+  boost::system::error_code ec;
+  auto start=chrono::steady_clock::now();
+  for(size_t i=0;i<5;++i)qenq.enq(to_string(i),ec);
+  ok=check(!readable(fd[0],20),"max_delay: messages written before max_delay_us")&&ok;
+  ok=check(readable(fd[0],2000),"max_delay: messages not written after max_delay_us")&&ok;
+  ok=check(chrono::steady_clock::now()-start>=chrono::milliseconds(90),"max_delay: messages written too early")&&ok;
+  ok=deqMsgs(qdeq,0,5,"max_delay")&&ok;
+  return ok;
+}
+// error from a background flush is reported by next enq()
+bool testBackgroundError(){
+  int fd[2];
+  if(::pipe(fd)!=0)return check(false,"pipe");
+  ::close(fd[0]);
+  enq_t qenq{fd[1],serialiser,true,'\n',asio::cork_options{0,1000}};
+  boost::system::error_code ec;
+  qenq.enq("0",ec);
+  this_thread::sleep_for(chrono::milliseconds(100));
+  bool stat{qenq.enq("1",ec)};
+  return check(!stat&&ec==boost::system::error_code(EPIPE,boost::system::get_posix_category()),"background error: "+ec.message());
+}
+// buffered messages are written when queue is destroyed
+bool testDestroy(){
+  int fd[2];
+  if(::pipe(fd)!=0)return check(false,"pipe");
+  deq_t qdeq{fd[0],deserialiser,true};
+  {
+    enq_t qenq{fd[1],serialiser,true,'\n',asio::cork_options{1000000,0}};
+    boost::system::error_code ec;
+    for(size_t i=0;i<20;++i)qenq.enq(to_string(i),ec);
+  }
+  return deqMsgs(qdeq,0,20,"destroy");
+}
+// corked socket client
+bool testSocket(int port){
+  bool ok{true};
+  size_t const nmsg{20000};
+  server_t qserv{port,deserialiser,serialiser};
+  client_t qclient{"localhost",port,deserialiser,serialiser,'\n',asio::cork_options{16*1024,1000}};
+  thread sender([&](){
+    boost::system::error_code ec;
+    for(size_t i=0;i<nmsg;++i)if(!qclient.enq(to_string(i),ec))cerr<<"client enq failed: "<<ec.message()<<endl;
+    qclient.flush(ec);
+  });
+  for(size_t i=0;i<nmsg&&ok;++i){
+    boost::system::error_code ec;
+    pair<bool,string>msg{qserv.timed_deq(5000,ec)};
+    ok=check(msg.first&&msg.second==to_string(i),"socket: message "+to_string(i)+": "+ec.message());
+  }
+  sender.join();
+  return ok;
+}
+// test program
+int main(int argc,char*argv[]){
+  int port{argc>1?boost::lexical_cast<int>(argv[1]):7792};
+  ::signal(SIGPIPE,SIG_IGN);
+  qtest::results res;
+  res+=testMaxBytes();
+  res+=testMaxDelay();
+  res+=testBackgroundError();
+  res+=testDestroy();
+  res+=testSocket(port);
+  return res.report();
+}
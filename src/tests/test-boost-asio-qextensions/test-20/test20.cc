@@ -0,0 +1,109 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0. 
+
+/*
+test program for waiting on fds >= FD_SETSIZE (poll()) and for the epoll reactor of sockdeq_serv_queue
+the program first opens enough fds that all fds created by the test are >= FD_SETSIZE and then checks that:
+- timed_deq on an fddeq_queue times out and then dequeues a message
+- a sockdeq_serv_queue dequeues all messages from several hundred concurrent clients exactly once and in order per client
+
+usage: test20 [#clients] [port]
+*/
+
+#include <boost/fddeq_queue.hpp>
+#include <boost/fdenq_queue.hpp>
+#include <boost/sockdeq_serv_queue.hpp>
+#include <boost/sockclient_queue.hpp>
+#include <boost/lexical_cast.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/select.h>
+#include <sys/resource.h>
+#include "../qtest-support.h"
+using namespace std;
+using qtest::check;
+
+namespace asio= boost::asio;
+
+// serialization functions
+auto deserialiser=[](char const*msg,size_t len){return string(msg,len-1);};
+auto serialiser=[](string&out,string const&s){out.append(s);};
+using base_t=asio::detail::base::queue_empty_base<string>;
+using server_t=asio::sockdeq_serv_queue<string,decltype(deserialiser),base_t>;
+using client_t=asio::sockclient_queue<string,decltype(deserialiser),decltype(serialiser),base_t>;
+
+// fd queues on fds >= FD_SETSIZE
+bool testPipe(){
+  bool ok{true};
+  int fd[2];
+  if(::pipe(fd)!=0)return check(false,"pipe");
+  ok=check(fd[0]>=FD_SETSIZE&&fd[1]>=FD_SETSIZE,"pipe: fds are below FD_SETSIZE")&&ok;
+  asio::fddeq_queue<string,decltype(deserialiser)>qdeq{fd[0],deserialiser,true};
+  asio::fdenq_queue<string,decltype(serialiser)>qenq{fd[1],serialiser,true};
+  boost::system::error_code ec;
+  auto start=chrono::steady_clock::now();
+  pair<bool,string>msg{qdeq.timed_deq(50,ec)};
+  ok=check(!msg.first&&ec==asio::error::timed_out&&chrono::steady_clock::now()-start>=chrono::milliseconds(40),"pipe: timeout: "+ec.message())&&ok;
+  qenq.enq("hello",ec);
+  msg=qdeq.timed_deq(1000,ec);
+  ok=check(msg.first&&msg.second=="hello","pipe: message: "+ec.message())&&ok;
+  return ok;
+}
+// many concurrent clients on a sockdeq_serv_queue
+bool testServer(size_t nclients,int port){
+  bool ok{true};
+  size_t const nmsg{100};
+  server_t qserv{port,deserialiser,nclients,50};
+  vector<unique_ptr<client_t>>clients;
+  for(size_t i=0;i<nclients;++i)clients.push_back(make_unique<client_t>("localhost",port,deserialiser,serialiser));
+  vector<thread>producers;
+  for(size_t i=0;i<nclients;++i){
+    producers.emplace_back([&,i](){
+      boost::system::error_code ec;
+      for(size_t j=0;j<nmsg;++j)if(!clients[i]->enq(to_string(i)+":"+to_string(j),ec))cerr<<"enq failed: "<<ec.message()<<endl;
+    });
+  }
+  vector<size_t>next(nclients,0);
+  for(size_t n=0;n<nclients*nmsg&&ok;++n){
+    boost::system::error_code ec;
+    pair<bool,string>msg{qserv.timed_deq(5000,ec)};
+    if(!check(msg.first,"server: deq after "+to_string(n)+" messages: "+ec.message())){ok=false;break;}
+    size_t pos{msg.second.find(':')};
+    size_t i{boost::lexical_cast<size_t>(msg.second.substr(0,pos))};
+    size_t j{boost::lexical_cast<size_t>(msg.second.substr(pos+1))};
+    ok=check(i<nclients&&j==next[i]++,"server: unexpected message: "+msg.second);
+  }
+  for(auto&t:producers)t.join();
+  return ok;
+}
+// test program
+int main(int argc,char*argv[]){
+  size_t nclients{argc>1?boost::lexical_cast<size_t>(argv[1]):300};
+  int port{argc>2?boost::lexical_cast<int>(argv[2]):7793};
+
+  // make sure fds created from now on are >= FD_SETSIZE
+  struct rlimit rl;
+  ::getrlimit(RLIMIT_NOFILE,&rl);
+  rl.rlim_cur=rl.rlim_max;
+  ::setrlimit(RLIMIT_NOFILE,&rl);
+  if(rl.rlim_cur<FD_SETSIZE+4*nclients+100){
+    cerr<<"FAILED: fd limit "<<rl.rlim_cur<<" is too low"<<endl;
+    return 1;
+  }
+  vector<int>fillers;
+  int fd;
+  while((fd=::open("/dev/null",O_RDONLY))>=0&&fd<FD_SETSIZE)fillers.push_back(fd);
+  if(fd>=0)::close(fd);
+
+  qtest::results res;
+  res+=testPipe();
+  res+=testServer(nclients,port);
+  for(int f:fillers)::close(f);
+  return res.report();
+}
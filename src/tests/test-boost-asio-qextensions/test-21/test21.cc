@@ -0,0 +1,112 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0. 
+
+/*
+test program for fd_relay
+for each framing the program enqueues messages on a pipe, relays them with an fd_relay to a second pipe and dequeues them
+the program checks that:
+- all messages (including messages larger than a pipe buffer) arrive intact, in order and are counted by the relay
+- the relay reports eof once the source is closed
+- relay() times out if no message arrives
+- a separator framed message which does not fit in the relay pipe fails with message_size
+*/
+
+#include <boost/fd_relay.hpp>
+#include <boost/fddeq_queue.hpp>
+#include <boost/fdenq_queue.hpp>
+#include <string>
+#include <vector>
+#include <thread>
+#include <iostream>
+#include <unistd.h>
+#include <signal.h>
+#include "../qtest-support.h"
+using namespace std;
+using qtest::check;
+
+namespace asio= boost::asio;
+
+// serialization functions
+// (messages handed to the de-serialiser include the separator with sep_framing)
+auto serialiser=[](string&out,string const&s){out.append(s);};
+auto deserialiser=[](char const*msg,size_t len){return string(msg,len);};
+auto sepDeserialiser=[](char const*msg,size_t len){return string(msg,len-1);};
+
+// get de-serialiser for a framing
+template<typename Framing>struct deser{using type=decltype(deserialiser);static type get(){return deserialiser;}};
+template<>struct deser<asio::sep_framing>{using type=decltype(sepDeserialiser);static type get(){return sepDeserialiser;}};
+
+// create a test message
+string makeMsg(size_t i){
+  size_t len{i%50==0?300000:i%7*10+1};
+  string ret(len,'x');
+  string const id{to_string(i)};
+  return ret.replace(0,min(len,id.size()),id,0,min(len,id.size()));
+}
+// relay messages with a framing
+template<typename Framing>
+bool testFraming(string const&name){
+  using deq_t=asio::fddeq_queue<string,typename deser<Framing>::type,asio::detail::base::queue_empty_base<string>,Framing>;
+  using enq_t=asio::fdenq_queue<string,decltype(serialiser),asio::detail::base::queue_empty_base<string>,Framing>;
+  bool ok{true};
+  size_t const nmsg{500};
+  int src[2],dst[2];
+  if(::pipe(src)!=0||::pipe(dst)!=0)return check(false,name+": pipe");
+  deq_t qdeq{dst[0],deser<Framing>::get(),true,Framing{}};
+
+  // nothing to relay yet
+  asio::fd_relay<Framing>relay{src[0],dst[1],Framing{},true};
+  boost::system::error_code ec;
+  ok=check(!relay.relay(50,ec)&&ec==asio::error::timed_out,name+": expected timeout, got: "+ec.message())&&ok;
+
+  // relay messages until source is closed
+  thread sender([&](){
+    enq_t qenq{src[1],serialiser,true,Framing{}};
+    boost::system::error_code ec;
+    for(size_t i=0;i<nmsg;++i)if(!qenq.enq(makeMsg(i),ec))cerr<<name<<": enq failed: "<<ec.message()<<endl;
+  });
+  size_t nrelayed{0};
+  boost::system::error_code ecrelay;
+  thread relayer([&](){nrelayed=relay.run(ecrelay);});
+  for(size_t i=0;i<nmsg&&ok;++i){
+    pair<bool,string>msg{qdeq.timed_deq(5000,ec)};
+    ok=check(msg.first&&msg.second==makeMsg(i),name+": message "+to_string(i)+": "+ec.message());
+  }
+  sender.join();
+  relayer.join();
+  ok=check(nrelayed==nmsg&&ecrelay==asio::error::eof,name+": relayed "+to_string(nrelayed)+" messages: "+ecrelay.message())&&ok;
+  return ok;
+}
+// separator framed message larger than relay pipe
+bool testOversized(){
+  int src[2],dst[2];
+  if(::pipe(src)!=0||::pipe(dst)!=0)return check(false,"oversized: pipe");
+  thread writer([&](){
+    string const msg(2*asio::fd_relay<>::PIPESIZE,'x');
+    for(size_t i=0;i<msg.size();){
+      ssize_t stat{::write(src[1],msg.data()+i,msg.size()-i)};
+      if(stat<=0)break;
+      i+=stat;
+    }
+    ::close(src[1]);
+  });
+  boost::system::error_code ec;
+  bool stat;
+  {
+    asio::fd_relay<>relay{src[0],dst[1],asio::sep_framing{},true};
+    stat=relay.relay(5000,ec);
+  }
+  writer.join();
+  ::close(dst[0]);
+  return check(!stat&&ec==asio::error::message_size,"oversized: expected message_size, got: "+ec.message());
+}
+// test program
+int main(){
+  ::signal(SIGPIPE,SIG_IGN);
+  qtest::results res;
+  res+=testFraming<asio::sep_framing>("sep_framing");
+  res+=testFraming<asio::varint_framing>("varint_framing");
+  res+=testFraming<asio::fixed_framing>("fixed_framing");
+  res+=testOversized();
+  return res.report();
+}
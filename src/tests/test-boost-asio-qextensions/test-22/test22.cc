@@ -0,0 +1,132 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0. 
+
+/*
+test program for stream and buffer based serialisers
+the program checks that:
+- the kind of a serialiser and de-serialiser is detected at compile time
+- messages round trip through a pipe with stream, buffer and mixed serialisers/de-serialisers
+- binary payloads (containing '\0' and '\n') round trip with buffer serialisers and length prefixed framing
+- messages round trip through a polldir_queue with stream and buffer serialisers
+
+usage: test22 [queue directory]
+*/
+
+#include <boost/fddeq_queue.hpp>
+#include <boost/fdenq_queue.hpp>
+#include <boost/polldir_queue.hpp>
+#include <string>
+#include <vector>
+#include <thread>
+#include <iostream>
+#include <cstring>
+#include <unistd.h>
+#include "../qtest-support.h"
+using namespace std;
+using qtest::check;
+
+namespace asio= boost::asio;
+namespace fs=boost::filesystem;
+namespace qs=boost::asio::detail::queue_support;
+
+// message type
+struct item{
+  unsigned id;
+  string payload;
+  bool operator==(item const&other)const{return id==other.id&&payload==other.payload;}
+};
+// text serialisers
+// (the separator is appended by the framing and is passed to a buffer de-serialiser as the last byte)
+auto streamSerialiser=[](ostream&os,item const&it){os<<it.id<<" "<<it.payload;};
+auto streamDeserialiser=[](istream&is){item ret;is>>ret.id;is.get();getline(is,ret.payload);return ret;};
+auto textSerialiser=[](string&out,item const&it){out.append(to_string(it.id)+" "+it.payload);};
+auto textDeserialiser=[](char const*msg,size_t len){
+  char const*sp{static_cast<char const*>(memchr(msg,' ',len))};
+  return item{static_cast<unsigned>(stoul(string(msg,sp))),string(sp+1,msg+len-1)};
+};
+// binary serialisers
+auto binSerialiser=[](string&out,item const&it){
+  out.append(reinterpret_cast<char const*>(&it.id),sizeof(it.id));
+  out.append(it.payload);
+};
+auto binDeserialiser=[](char const*msg,size_t len){
+  item ret;
+  memcpy(&ret.id,msg,sizeof(ret.id));
+  ret.payload.assign(msg+sizeof(ret.id),len-sizeof(ret.id));
+  return ret;
+};
+// serialiser kinds are detected at compile time
+static_assert(qs::is_stream_serial<decltype(streamSerialiser),item>::value,"stream serialiser not detected");
+static_assert(!qs::is_stream_serial<decltype(textSerialiser),item>::value,"buffer serialiser detected as stream serialiser");
+static_assert(qs::is_buffer_deser<decltype(textDeserialiser)>::value,"buffer de-serialiser not detected");
+static_assert(!qs::is_buffer_deser<decltype(streamDeserialiser)>::value,"stream de-serialiser detected as buffer de-serialiser");
+
+// create a test message
+// (binary messages contain '\0' and '\n')
+item makeMsg(unsigned i,bool binary){
+  string payload("payload-"+to_string(i));
+  if(binary)payload+=string("\0\n\0",3)+string(i%100,'\n');
+  else payload+=string(i%100,'y');
+  return item{i,payload};
+}
+// round trip messages through a pipe
+template<typename Framing,typename SERIAL,typename DESER>
+bool testPipe(string const&name,SERIAL serial,DESER deser,bool binary){
+  using deq_t=asio::fddeq_queue<item,DESER,asio::detail::base::queue_empty_base<item>,Framing>;
+  using enq_t=asio::fdenq_queue<item,SERIAL,asio::detail::base::queue_empty_base<item>,Framing>;
+  bool ok{true};
+  unsigned const nmsg{1000};
+  int fd[2];
+  if(::pipe(fd)!=0)return check(false,name+": pipe");
+  deq_t qdeq{fd[0],deser,true,Framing{}};
+  thread sender([&](){
+    enq_t qenq{fd[1],serial,true,Framing{}};
+    boost::system::error_code ec;
+    for(unsigned i=0;i<nmsg;++i)if(!qenq.enq(makeMsg(i,binary),ec))cerr<<name<<": enq failed: "<<ec.message()<<endl;
+  });
+  // (keep reading after a bad message so the sender is not blocked)
+  for(unsigned i=0;i<nmsg;++i){
+    boost::system::error_code ec;
+    pair<bool,item>msg{qdeq.timed_deq(5000,ec)};
+    ok=check(msg.first&&msg.second==makeMsg(i,binary),name+": message "+to_string(i)+": "+ec.message())&&ok;
+    if(!msg.first)break;
+  }
+  sender.join();
+  return ok;
+}
+// round trip messages through a polldir_queue
+template<typename SERIAL,typename DESER>
+bool testPolldir(string const&name,SERIAL serial,DESER deser,bool binary,fs::path const&qdir){
+  using queue_t=asio::polldir_queue<item,DESER,SERIAL>;
+  bool ok{true};
+  unsigned const nmsg{200};
+  string const qname{"q22"};
+  fs::remove_all(qdir);
+  fs::create_directory(qdir);
+  queue_t::removeLockVariables(qname);
+  queue_t q{qname,0,qdir,deser,serial,false};
+  for(unsigned i=0;i<nmsg;++i){
+    boost::system::error_code ec;
+    if(!q.enq(makeMsg(i,binary),ec))return check(false,name+": enq failed: "+ec.message());
+  }
+  for(unsigned i=0;i<nmsg&&ok;++i){
+    boost::system::error_code ec;
+    pair<bool,item>msg{q.timed_deq(1000,ec)};
+    ok=check(msg.first&&msg.second==makeMsg(i,binary),name+": message "+to_string(i)+": "+ec.message());
+  }
+  fs::remove_all(qdir);
+  return ok;
+}
+// test program
+int main(int argc,char*argv[]){
+  fs::path const qdir{argc>1?argv[1]:"./q22"};
+  qtest::results res;
+  res+=testPipe<asio::sep_framing>("pipe stream/stream",streamSerialiser,streamDeserialiser,false);
+  res+=testPipe<asio::sep_framing>("pipe buffer/buffer",textSerialiser,textDeserialiser,false);
+  res+=testPipe<asio::sep_framing>("pipe stream/buffer",streamSerialiser,textDeserialiser,false);
+  res+=testPipe<asio::sep_framing>("pipe buffer/stream",textSerialiser,streamDeserialiser,false);
+  res+=testPipe<asio::varint_framing>("pipe binary",binSerialiser,binDeserialiser,true);
+  res+=testPolldir("polldir stream",streamSerialiser,streamDeserialiser,false,qdir);
+  res+=testPolldir("polldir binary",binSerialiser,binDeserialiser,true,qdir);
+  return res.report();
+}
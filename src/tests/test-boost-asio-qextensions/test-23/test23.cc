@@ -0,0 +1,127 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0. 
+
+/*
+test program for sockmserv_queue
+the program connects several sockclient_queue clients to a sockmserv_queue and checks that:
+- messages from all clients are dequeued together with the id of the sending client
+- enq() with last_sender routing replies only to the client which sent the last dequeued message
+- enq_client() sends to one client and broadcast() sends to all clients (including messages larger than a socket buffer)
+- enq() with broadcast routing sends to all clients
+- a client which disconnects is dropped and sending to it fails with not_connected
+
+usage: test23 [port]
+*/
+
+#include <boost/sockmserv_queue.hpp>
+#include <boost/sockclient_queue.hpp>
+#include <boost/lexical_cast.hpp>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include "../qtest-support.h"
+using namespace std;
+using qtest::check;
+
+namespace asio= boost::asio;
+
+// serialization functions
+auto deserialiser=[](char const*msg,size_t len){return string(msg,len-1);};
+auto serialiser=[](string&out,string const&s){out.append(s);};
+using base_t=asio::detail::base::queue_empty_base<string>;
+using server_t=asio::sockmserv_queue<string,decltype(deserialiser),decltype(serialiser),base_t>;
+using client_t=asio::sockclient_queue<string,decltype(deserialiser),decltype(serialiser),base_t>;
+
+// check that a client receives a message
+bool expectMsg(client_t&q,string const&expected,string const&what){
+  boost::system::error_code ec;
+  pair<bool,string>msg{q.timed_deq(5000,ec)};
+  return check(msg.first&&msg.second==expected,what+": "+ec.message());
+}
+// check that a client does not receive a message
+bool expectNoMsg(client_t&q,string const&what){
+  boost::system::error_code ec;
+  pair<bool,string>msg{q.timed_deq(100,ec)};
+  return check(!msg.first&&ec==asio::error::timed_out,what+": got unexpected message: "+msg.second);
+}
+// connect clients and map each client to its id in the server
+bool connect(server_t&qserv,vector<unique_ptr<client_t>>&clients,map<size_t,server_t::client_id>&ids,int port,size_t nclients){
+  bool ok{true};
+  for(size_t i=0;i<nclients;++i){
+    clients.push_back(make_unique<client_t>("localhost",port,deserialiser,serialiser));
+    boost::system::error_code ec;
+    ok=check(clients.back()->enq(to_string(i),ec),"client "+to_string(i)+": enq: "+ec.message())&&ok;
+  }
+  for(size_t n=0;n<nclients&&ok;++n){
+    boost::system::error_code ec;
+    auto msg=qserv.timed_deq_client(5000,ec);
+    ok=check(msg.first,"server: deq_client: "+ec.message());
+    if(ok)ids[boost::lexical_cast<size_t>(msg.second.second)]=msg.second.first;
+  }
+  return check(ok&&ids.size()==nclients,"connect: clients not identified")&&ok;
+}
+// last_sender routing, enq_client, broadcast and disconnects
+bool testLastSender(int port){
+  bool ok{true};
+  size_t const nclients{3};
+  server_t qserv{port,deserialiser,serialiser,10};
+  vector<unique_ptr<client_t>>clients;
+  map<size_t,server_t::client_id>ids;
+  if(!connect(qserv,clients,ids,port,nclients))return false;
+  ok=check(qserv.nclients()==nclients,"nclients: "+to_string(qserv.nclients()))&&ok;
+
+  // reply goes to last sender only
+  boost::system::error_code ec;
+  clients[1]->enq("ping",ec);
+  pair<bool,string>msg{qserv.timed_deq(5000,ec)};
+  ok=check(msg.first&&msg.second=="ping","server: deq: "+ec.message())&&ok;
+  qserv.enq("pong",ec);
+  ok=expectMsg(*clients[1],"pong","last_sender: client 1")&&ok;
+  ok=expectNoMsg(*clients[0],"last_sender: client 0")&&ok;
+  ok=expectNoMsg(*clients[2],"last_sender: client 2")&&ok;
+
+  // send to a specific client
+  string const large(1000000,'x');
+  for(size_t i=0;i<nclients;++i)ok=check(qserv.enq_client(ids[i],"to-"+to_string(i),ec),"enq_client: "+ec.message())&&ok;
+  ok=check(qserv.enq_client(ids[2],large,ec),"enq_client large: "+ec.message())&&ok;
+  for(size_t i=0;i<nclients;++i)ok=expectMsg(*clients[i],"to-"+to_string(i),"enq_client: client "+to_string(i))&&ok;
+  ok=expectMsg(*clients[2],large,"enq_client large: client 2")&&ok;
+
+  // broadcast to all clients
+  ok=check(qserv.broadcast("all",ec),"broadcast: "+ec.message())&&ok;
+  for(size_t i=0;i<nclients;++i)ok=expectMsg(*clients[i],"all","broadcast: client "+to_string(i))&&ok;
+
+  // drop a client
+  clients[0].reset();
+  for(size_t i=0;i<100&&qserv.nclients()!=nclients-1;++i)this_thread::sleep_for(chrono::milliseconds(10));
+  ok=check(qserv.nclients()==nclients-1,"disconnect: nclients: "+to_string(qserv.nclients()))&&ok;
+  ok=check(!qserv.enq_client(ids[0],"gone",ec)&&ec==asio::error::not_connected,"disconnect: enq_client: "+ec.message())&&ok;
+  return ok;
+}
+// broadcast routing
+bool testBroadcast(int port){
+  bool ok{true};
+  size_t const nclients{4};
+  server_t qserv{port,deserialiser,serialiser,10,asio::sockmserv_route::broadcast};
+  vector<unique_ptr<client_t>>clients;
+  map<size_t,server_t::client_id>ids;
+  if(!connect(qserv,clients,ids,port,nclients))return false;
+  boost::system::error_code ec;
+  for(size_t j=0;j<100;++j)ok=check(qserv.enq(to_string(j),ec),"broadcast route: enq: "+ec.message())&&ok;
+  for(size_t i=0;i<nclients;++i){
+    for(size_t j=0;j<100&&ok;++j)ok=expectMsg(*clients[i],to_string(j),"broadcast route: client "+to_string(i))&&ok;
+  }
+  return ok;
+}
+// test program
+int main(int argc,char*argv[]){
+  int port{argc>1?boost::lexical_cast<int>(argv[1]):7794};
+  qtest::results res;
+  res+=testLastSender(port);
+  res+=testBroadcast(port+1);
+  return res.report();
+}
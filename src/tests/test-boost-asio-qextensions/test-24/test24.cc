@@ -0,0 +1,102 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0. 
+
+/*
+test program for sockclient_pool_queue
+the program checks that:
+- with each selection policy, messages from several producer threads sent over a pool of connections are all
+  dequeued exactly once by a sockdeq_serv_queue
+- a message too large for the framing fails with message_size and is not retried on other connections
+- a moved sockclient_queue keeps its connection
+
+usage: test24 [port]
+*/
+
+#include <boost/sockclient_pool_queue.hpp>
+#include <boost/sockclient_queue.hpp>
+#include <boost/sockdeq_serv_queue.hpp>
+#include <boost/lexical_cast.hpp>
+#include <string>
+#include <vector>
+#include <thread>
+#include <iostream>
+#include "../qtest-support.h"
+using namespace std;
+using qtest::check;
+
+namespace asio= boost::asio;
+
+// serialization functions
+auto deserialiser=[](char const*msg,size_t len){return string(msg,len);};
+auto serialiser=[](string&out,string const&s){out.append(s);};
+using base_t=asio::detail::base::queue_empty_base<string>;
+using server_t=asio::sockdeq_serv_queue<string,decltype(deserialiser),base_t,std::queue<string>,asio::varint_framing>;
+using pool_t=asio::sockclient_pool_queue<string,decltype(deserialiser),decltype(serialiser),base_t,asio::varint_framing>;
+using client_t=asio::sockclient_queue<string,decltype(deserialiser),decltype(serialiser),base_t,asio::varint_framing>;
+
+// send messages from several threads over a pool
+// (messages sent on different connections may arrive in any order so we only check that each message arrives once)
+bool testPool(asio::sockclient_pool_policy policy,string const&name,int port){
+  bool ok{true};
+  size_t const nprod{4};
+  size_t const nmsg{5000};
+  server_t qserv{port,deserialiser,8,50,asio::varint_framing{}};
+  pool_t qpool{"localhost",port,deserialiser,serialiser,4,policy,asio::varint_framing{}};
+  ok=check(qpool.size()==4,name+": size: "+to_string(qpool.size()))&&ok;
+  vector<thread>producers;
+  for(size_t i=0;i<nprod;++i){
+    producers.emplace_back([&,i](){
+      boost::system::error_code ec;
+      for(size_t j=0;j<nmsg;++j)if(!qpool.enq(to_string(i*nmsg+j),ec))cerr<<name<<": enq failed: "<<ec.message()<<endl;
+    });
+  }
+  vector<int>seen(nprod*nmsg,0);
+  for(size_t n=0;n<nprod*nmsg;++n){
+    boost::system::error_code ec;
+    pair<bool,string>msg{qserv.timed_deq(5000,ec)};
+    if(!check(msg.first,name+": deq after "+to_string(n)+" messages: "+ec.message())){ok=false;break;}
+    size_t id{boost::lexical_cast<size_t>(msg.second)};
+    ok=check(id<seen.size()&&seen[id]++==0,name+": unexpected message: "+msg.second)&&ok;
+  }
+  for(auto&t:producers)t.join();
+  return ok;
+}
+// oversized message is not retried
+bool testOversized(int port){
+  bool ok{true};
+  server_t qserv{port,deserialiser,8,50,asio::varint_framing{}};
+  pool_t qpool{"localhost",port,deserialiser,serialiser,3,asio::sockclient_pool_policy::round_robin,asio::varint_framing{16}};
+  boost::system::error_code ec;
+  ok=check(!qpool.enq(string(100,'x'),ec)&&ec==asio::error::message_size,"oversized: enq: "+ec.message())&&ok;
+  ok=check(qpool.enq("small",ec),"oversized: enq after oversized message: "+ec.message())&&ok;
+  pair<bool,string>msg{qserv.timed_deq(5000,ec)};
+  ok=check(msg.first&&msg.second=="small","oversized: deq: "+ec.message())&&ok;
+  msg=qserv.timed_deq(100,ec);
+  ok=check(!msg.first&&ec==asio::error::timed_out,"oversized: unexpected message: "+msg.second)&&ok;
+  return ok;
+}
+// moved client keeps its connection
+bool testMove(int port){
+  bool ok{true};
+  server_t qserv{port,deserialiser,8,50,asio::varint_framing{}};
+  client_t qclient1{"localhost",port,deserialiser,serialiser,asio::varint_framing{}};
+  boost::system::error_code ec;
+  ok=check(qclient1.enq("first",ec),"move: enq: "+ec.message())&&ok;
+  client_t qclient2{std::move(qclient1)};
+  ok=check(qclient2.enq("second",ec),"move: enq after move: "+ec.message())&&ok;
+  for(char const*expected:{"first","second"}){
+    pair<bool,string>msg{qserv.timed_deq(5000,ec)};
+    ok=check(msg.first&&msg.second==expected,"move: deq: "+ec.message())&&ok;
+  }
+  return ok;
+}
+// test program
+int main(int argc,char*argv[]){
+  int port{argc>1?boost::lexical_cast<int>(argv[1]):7796};
+  qtest::results res;
+  res+=testPool(asio::sockclient_pool_policy::round_robin,"round_robin",port);
+  res+=testPool(asio::sockclient_pool_policy::least_backlog,"least_backlog",port+1);
+  res+=testOversized(port+2);
+  res+=testMove(port+3);
+  return res.report();
+}
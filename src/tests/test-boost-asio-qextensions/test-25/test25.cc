@@ -0,0 +1,113 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0. 
+
+/*
+test program for connecting sockclient_queue to a server
+the program checks that:
+- server names are resolved through the resolver cache
+- a connect to a server which does not accept connections times out after the timeout of the timed_* call
+- a refused connect fails with the error from the connect and later calls fail immediately while backing off
+- the client connects once the backoff has expired
+
+usage: test25 [port]
+*/
+
+#include <boost/sockclient_queue.hpp>
+#include <boost/sockserv_queue.hpp>
+#include <boost/lexical_cast.hpp>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "../qtest-support.h"
+using namespace std;
+using qtest::check;
+
+namespace asio= boost::asio;
+
+// serialization functions
+auto deserialiser=[](char const*msg,size_t len){return string(msg,len-1);};
+auto serialiser=[](string&out,string const&s){out.append(s);};
+using base_t=asio::detail::base::queue_empty_base<string>;
+using server_t=asio::sockserv_queue<string,decltype(deserialiser),decltype(serialiser),base_t>;
+using client_t=asio::sockclient_queue<string,decltype(deserialiser),decltype(serialiser),base_t>;
+
+// get ms since a time point
+long long msSince(chrono::steady_clock::time_point start){
+  return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now()-start).count();
+}
+// resolver cache
+bool testResolve(int port){
+  auto&resolver(asio::detail::sockqueue_support::resolver_cache::instance());
+  boost::system::error_code ec;
+  auto addrs=resolver.resolve("localhost",port,ec);
+  bool ok{check(!addrs.empty()&&ec==boost::system::error_code(),"resolve: "+ec.message())};
+  resolver.invalidate("localhost",port);
+  addrs=resolver.resolve("localhost",port,ec);
+  return check(!addrs.empty()&&ec==boost::system::error_code(),"resolve after invalidate: "+ec.message())&&ok;
+}
+// connect to a server whose accept queue is full times out
+// (linux drops SYNs when the accept queue of a listening socket is full)
+bool testConnectTimeout(int port){
+  int lsock{::socket(AF_INET,SOCK_STREAM,0)};
+  int yes{1};
+  ::setsockopt(lsock,SOL_SOCKET,SO_REUSEADDR,&yes,sizeof(yes));
+  struct sockaddr_in addr{};
+  addr.sin_family=AF_INET;
+  addr.sin_port=htons(port);
+  addr.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+  if(::bind(lsock,reinterpret_cast<struct sockaddr*>(&addr),sizeof(addr))!=0||::listen(lsock,0)!=0){
+    ::close(lsock);
+    return check(false,"connect timeout: failed setting up listening socket");
+  }
+  vector<int>fillers;
+  for(int i=0;i<4;++i){
+    int fd{::socket(AF_INET,SOCK_STREAM|SOCK_NONBLOCK,0)};
+    ::connect(fd,reinterpret_cast<struct sockaddr*>(&addr),sizeof(addr));
+    fillers.push_back(fd);
+  }
+  client_t qclient{"127.0.0.1",port,deserialiser,serialiser};
+  boost::system::error_code ec;
+  auto start=chrono::steady_clock::now();
+  bool stat{qclient.timed_enq("hello",200,ec)};
+  long long ms{msSince(start)};
+  for(int fd:fillers)::close(fd);
+  ::close(lsock);
+  return check(!stat&&ec==asio::error::timed_out&&ms>=150&&ms<2000,"connect timeout after "+to_string(ms)+" ms: "+ec.message());
+}
+// refused connect, backoff and connect after backoff
+bool testBackoff(int port){
+  bool ok{true};
+  asio::reconnect_options const reconnect{5000,300,1000};
+  client_t qclient{"127.0.0.1",port,deserialiser,serialiser,'\n',asio::cork_options{},reconnect};
+  boost::system::error_code ec;
+  bool stat{qclient.enq("lost",ec)};
+  ok=check(!stat&&ec.value()==ECONNREFUSED,"backoff: first connect: "+ec.message())&&ok;
+
+  // server is now up but we are still backing off
+  server_t qserv{port,deserialiser,serialiser};
+  auto start=chrono::steady_clock::now();
+  stat=qclient.enq("lost",ec);
+  ok=check(!stat&&ec.value()==ECONNREFUSED&&msSince(start)<100,"backoff: connect while backing off: "+ec.message())&&ok;
+
+  // backoff has expired
+  this_thread::sleep_for(chrono::milliseconds(350));
+  ok=check(qclient.enq("hello",ec),"backoff: connect after backoff: "+ec.message())&&ok;
+  pair<bool,string>msg{qserv.timed_deq(5000,ec)};
+  ok=check(msg.first&&msg.second=="hello","backoff: deq: "+ec.message())&&ok;
+  return ok;
+}
+// test program
+int main(int argc,char*argv[]){
+  int port{argc>1?boost::lexical_cast<int>(argv[1]):7800};
+  qtest::results res;
+  res+=testResolve(port);
+  res+=testConnectTimeout(port+1);
+  res+=testBackoff(port+2);
+  return res.report();
+}
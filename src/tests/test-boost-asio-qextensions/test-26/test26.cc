@@ -0,0 +1,121 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0. 
+
+/*
+test program for socket_options
+the program checks that:
+- options are set on TCP sockets and on listening sockets
+- TCP level options are skipped for unix domain sockets
+- queues created with socket options exchange messages
+
+usage: test26 [port]
+*/
+
+#include <boost/sockserv_queue.hpp>
+#include <boost/sockclient_queue.hpp>
+#include <boost/lexical_cast.hpp>
+#include <string>
+#include <iostream>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "../qtest-support.h"
+using namespace std;
+using qtest::check;
+
+namespace asio= boost::asio;
+namespace ss=boost::asio::detail::sockqueue_support;
+
+// serialization functions
+auto deserialiser=[](char const*msg,size_t len){return string(msg,len-1);};
+auto serialiser=[](string&out,string const&s){out.append(s);};
+using base_t=asio::detail::base::queue_empty_base<string>;
+using server_t=asio::sockserv_queue<string,decltype(deserialiser),decltype(serialiser),base_t>;
+using client_t=asio::sockclient_queue<string,decltype(deserialiser),decltype(serialiser),base_t>;
+
+// get an int socket option
+int getopt(int fd,int level,int name){
+  int ret{-1};
+  socklen_t len{sizeof(ret)};
+  ::getsockopt(fd,level,name,&ret,&len);
+  return ret;
+}
+// options to test with
+asio::socket_options makeOptions(){
+  asio::socket_options ret;
+  ret.nodelay=true;
+  ret.sndbuf=64*1024;
+  ret.rcvbuf=64*1024;
+  ret.keepalive=true;
+  ret.keepidle_s=30;
+  ret.keepintvl_s=5;
+  ret.keepcnt=3;
+  return ret;
+}
+// options set on a TCP socket
+bool testTcp(){
+  bool ok{true};
+  int fd{::socket(AF_INET,SOCK_STREAM,0)};
+  boost::system::error_code ec;
+  ok=check(ss::applySocketOptions(fd,makeOptions(),ec),"tcp: apply: "+ec.message())&&ok;
+  ok=check(getopt(fd,IPPROTO_TCP,TCP_NODELAY)!=0,"tcp: TCP_NODELAY")&&ok;
+  ok=check(getopt(fd,SOL_SOCKET,SO_KEEPALIVE)!=0,"tcp: SO_KEEPALIVE")&&ok;
+  ok=check(getopt(fd,IPPROTO_TCP,TCP_KEEPIDLE)==30,"tcp: TCP_KEEPIDLE")&&ok;
+  ok=check(getopt(fd,IPPROTO_TCP,TCP_KEEPINTVL)==5,"tcp: TCP_KEEPINTVL")&&ok;
+  ok=check(getopt(fd,IPPROTO_TCP,TCP_KEEPCNT)==3,"tcp: TCP_KEEPCNT")&&ok;
+
+  // (linux doubles the requested buffer size)
+  ok=check(getopt(fd,SOL_SOCKET,SO_SNDBUF)>=64*1024,"tcp: SO_SNDBUF")&&ok;
+  ok=check(getopt(fd,SOL_SOCKET,SO_RCVBUF)>=64*1024,"tcp: SO_RCVBUF")&&ok;
+  ::close(fd);
+
+  // default options leave socket untouched
+  fd=::socket(AF_INET,SOCK_STREAM,0);
+  ok=check(ss::applySocketOptions(fd,asio::socket_options{},ec),"tcp: apply defaults: "+ec.message())&&ok;
+  ok=check(getopt(fd,IPPROTO_TCP,TCP_NODELAY)==0&&getopt(fd,SOL_SOCKET,SO_KEEPALIVE)==0,"tcp: defaults changed socket")&&ok;
+  ::close(fd);
+  return ok;
+}
+// TCP options are skipped on unix domain sockets
+bool testUnix(){
+  int fd{::socket(AF_UNIX,SOCK_STREAM,0)};
+  boost::system::error_code ec;
+  bool ok{check(ss::applySocketOptions(fd,makeOptions(),ec),"unix: apply: "+ec.message())};
+  ok=check(getopt(fd,SOL_SOCKET,SO_KEEPALIVE)!=0,"unix: SO_KEEPALIVE")&&ok;
+  ::close(fd);
+  return ok;
+}
+// options set on a listening socket
+bool testListen(int port){
+  struct sockaddr_in addr;
+  int fd{ss::createListenSocket(port,addr,10,makeOptions())};
+  bool ok{check(getopt(fd,SOL_SOCKET,SO_RCVBUF)>=64*1024,"listen: SO_RCVBUF")};
+  ok=check(getopt(fd,IPPROTO_TCP,TCP_NODELAY)!=0,"listen: TCP_NODELAY")&&ok;
+  ::close(fd);
+  return ok;
+}
+// queues with socket options
+bool testQueues(int port){
+  bool ok{true};
+  server_t qserv{port,deserialiser,serialiser,'\n',makeOptions()};
+  client_t qclient{"localhost",port,deserialiser,serialiser,'\n',asio::cork_options{},asio::reconnect_options{},makeOptions()};
+  boost::system::error_code ec;
+  ok=check(qclient.enq("hello",ec),"queues: client enq: "+ec.message())&&ok;
+  pair<bool,string>msg{qserv.timed_deq(5000,ec)};
+  ok=check(msg.first&&msg.second=="hello","queues: server deq: "+ec.message())&&ok;
+  ok=check(qserv.enq("world",ec),"queues: server enq: "+ec.message())&&ok;
+  msg=qclient.timed_deq(5000,ec);
+  ok=check(msg.first&&msg.second=="world","queues: client deq: "+ec.message())&&ok;
+  return ok;
+}
+// test program
+int main(int argc,char*argv[]){
+  int port{argc>1?boost::lexical_cast<int>(argv[1]):7803};
+  qtest::results res;
+  res+=testTcp();
+  res+=testUnix();
+  res+=testListen(port);
+  res+=testQueues(port+1);
+  return res.report();
+}
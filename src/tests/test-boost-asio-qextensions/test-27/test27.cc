@@ -0,0 +1,154 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0. 
+
+/*
+test program for socket queues on unix domain sockets
+for SOCK_STREAM and SOCK_SEQPACKET endpoints the program checks that:
+- a sockserv_queue and a sockclient_queue exchange messages in both directions, including messages larger than a record
+- a sockdeq_serv_queue dequeues messages from several clients
+- a sockmserv_queue replies to the client which sent a message
+- a stale socket file is removed when a server binds and the socket file is removed when the server is destroyed
+
+usage: test27 [socket directory]
+*/
+
+#include <boost/sockserv_queue.hpp>
+#include <boost/sockclient_queue.hpp>
+#include <boost/sockdeq_serv_queue.hpp>
+#include <boost/sockmserv_queue.hpp>
+#include <boost/filesystem.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <iostream>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../qtest-support.h"
+using namespace std;
+using qtest::check;
+
+namespace asio= boost::asio;
+namespace fs=boost::filesystem;
+
+// serialization functions
+auto deserialiser=[](char const*msg,size_t len){return string(msg,len);};
+auto serialiser=[](string&out,string const&s){out.append(s);};
+using base_t=asio::detail::base::queue_empty_base<string>;
+using server_t=asio::sockserv_queue<string,decltype(deserialiser),decltype(serialiser),base_t,asio::varint_framing>;
+using client_t=asio::sockclient_queue<string,decltype(deserialiser),decltype(serialiser),base_t,asio::varint_framing>;
+using deqserver_t=asio::sockdeq_serv_queue<string,decltype(deserialiser),base_t,std::queue<string>,asio::varint_framing>;
+using mserver_t=asio::sockmserv_queue<string,decltype(deserialiser),decltype(serialiser),base_t,asio::varint_framing>;
+
+// messages sent in tests (the last message spans several records)
+vector<string>makeMsgs(){
+  vector<string>ret;
+  for(size_t i=0;i<1000;++i)ret.push_back("msg-"+to_string(i));
+  ret.push_back(string(300000,'x'));
+  return ret;
+}
+// leave a stale socket file behind
+void makeStale(string const&path){
+  int fd{::socket(AF_UNIX,SOCK_STREAM,0)};
+  struct sockaddr_un addr{};
+  addr.sun_family=AF_UNIX;
+  strncpy(addr.sun_path,path.c_str(),sizeof(addr.sun_path)-1);
+  ::bind(fd,reinterpret_cast<struct sockaddr*>(&addr),sizeof(addr));
+  ::close(fd);
+}
+// server and client exchanging messages
+bool testServClient(asio::unix_endpoint const&ep,string const&name){
+  bool ok{true};
+  vector<string>msgs{makeMsgs()};
+  makeStale(ep.path);
+  {
+    server_t qserv{ep,deserialiser,serialiser,asio::varint_framing{}};
+    client_t qclient{ep,deserialiser,serialiser,asio::varint_framing{}};
+    thread sender([&](){
+      boost::system::error_code ec;
+      for(auto const&m:msgs)if(!qclient.enq(m,ec))cerr<<name<<": client enq failed: "<<ec.message()<<endl;
+    });
+    for(size_t i=0;i<msgs.size();++i){
+      boost::system::error_code ec;
+      pair<bool,string>msg{qserv.timed_deq(5000,ec)};
+      ok=check(msg.first&&msg.second==msgs[i],name+": client->server: message "+to_string(i)+": "+ec.message())&&ok;
+      if(!msg.first)break;
+    }
+    sender.join();
+    thread replier([&](){
+      boost::system::error_code ec;
+      for(auto const&m:msgs)if(!qserv.enq(m,ec))cerr<<name<<": server enq failed: "<<ec.message()<<endl;
+    });
+    for(size_t i=0;i<msgs.size();++i){
+      boost::system::error_code ec;
+      pair<bool,string>msg{qclient.timed_deq(5000,ec)};
+      ok=check(msg.first&&msg.second==msgs[i],name+": server->client: message "+to_string(i)+": "+ec.message())&&ok;
+      if(!msg.first)break;
+    }
+    replier.join();
+  }
+  return check(!fs::exists(ep.path),name+": socket file not removed")&&ok;
+}
+// several clients on a sockdeq_serv_queue
+bool testDeqServer(asio::unix_endpoint const&ep,string const&name){
+  bool ok{true};
+  size_t const nclients{5};
+  size_t const nmsg{1000};
+  deqserver_t qserv{ep,deserialiser,nclients,50,asio::varint_framing{}};
+  vector<unique_ptr<client_t>>clients;
+  for(size_t i=0;i<nclients;++i)clients.push_back(make_unique<client_t>(ep,deserialiser,serialiser,asio::varint_framing{}));
+  vector<thread>producers;
+  for(size_t i=0;i<nclients;++i){
+    producers.emplace_back([&,i](){
+      boost::system::error_code ec;
+      for(size_t j=0;j<nmsg;++j)clients[i]->enq(to_string(i)+":"+to_string(j),ec);
+    });
+  }
+  vector<size_t>next(nclients,0);
+  for(size_t n=0;n<nclients*nmsg;++n){
+    boost::system::error_code ec;
+    pair<bool,string>msg{qserv.timed_deq(5000,ec)};
+    if(!check(msg.first,name+": deq server: deq: "+ec.message())){ok=false;break;}
+    size_t pos{msg.second.find(':')};
+    size_t i{stoul(msg.second.substr(0,pos))};
+    ok=check(i<nclients&&stoul(msg.second.substr(pos+1))==next[i]++,name+": deq server: unexpected message: "+msg.second)&&ok;
+  }
+  for(auto&t:producers)t.join();
+  return ok;
+}
+// multi client server replying to last sender
+bool testMServer(asio::unix_endpoint const&ep,string const&name){
+  bool ok{true};
+  mserver_t qserv{ep,deserialiser,serialiser,10,asio::varint_framing{}};
+  client_t qclient1{ep,deserialiser,serialiser,asio::varint_framing{}};
+  client_t qclient2{ep,deserialiser,serialiser,asio::varint_framing{}};
+  boost::system::error_code ec;
+  qclient1.enq("one",ec);
+  qclient2.enq("two",ec);
+  for(size_t i=0;i<2;++i){
+    pair<bool,string>msg{qserv.timed_deq(5000,ec)};
+    ok=check(msg.first,name+": mserver: deq: "+ec.message())&&ok;
+    qserv.enq("re-"+msg.second,ec);
+  }
+  pair<bool,string>msg{qclient1.timed_deq(5000,ec)};
+  ok=check(msg.first&&msg.second=="re-one",name+": mserver: client 1: "+ec.message())&&ok;
+  msg=qclient2.timed_deq(5000,ec);
+  ok=check(msg.first&&msg.second=="re-two",name+": mserver: client 2: "+ec.message())&&ok;
+  return ok;
+}
+// test program
+int main(int argc,char*argv[]){
+  fs::path const dir{argc>1?argv[1]:"/tmp"};
+  qtest::results res;
+  for(bool seqpacket:{false,true}){
+    string const name{seqpacket?"seqpacket":"stream"};
+    asio::unix_endpoint const ep{(dir/("test27-"+to_string(::getpid())+"-"+name+".sock")).string(),seqpacket};
+    res+=testServClient(ep,name);
+    res+=testDeqServer(ep,name);
+    res+=testMServer(ep,name);
+    fs::remove(ep.path);
+  }
+  return res.report();
+}
@@ -0,0 +1,168 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0. 
+
+/*
+test program for rpc_client and rpc_serve
+the program checks that:
+- rpc_serial/rpc_deser round trip a message and a message without a valid id gets id 0
+- concurrent requests from several clients served by rpc_serve on a sockmserv_queue each get their own reply
+- replies arriving in a different order than the requests complete the right requests
+- outstanding requests fail when the connection is lost and with operation_aborted when the client is destroyed
+
+usage: test28 [port]
+*/
+
+#include <boost/rpc_client.hpp>
+#include <boost/sockmserv_queue.hpp>
+#include <boost/sockclient_queue.hpp>
+#include <boost/lexical_cast.hpp>
+#include <string>
+#include <vector>
+#include <future>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <iostream>
+#include "../qtest-support.h"
+using namespace std;
+using qtest::check;
+
+namespace asio= boost::asio;
+
+// serialization functions
+auto deserialiser=[](char const*msg,size_t len){return string(msg,len);};
+auto serialiser=[](string&out,string const&s){out.append(s);};
+using msg_t=asio::rpc_msg<string>;
+using rpc_deser_t=asio::rpc_deser<string,decltype(deserialiser)>;
+using rpc_serial_t=asio::rpc_serial<string,decltype(serialiser)>;
+using base_t=asio::detail::base::queue_empty_base<msg_t>;
+using server_t=asio::sockmserv_queue<msg_t,rpc_deser_t,rpc_serial_t,base_t,asio::varint_framing>;
+using client_t=asio::sockclient_queue<msg_t,rpc_deser_t,rpc_serial_t,base_t,asio::varint_framing>;
+using rpc_t=asio::rpc_client<string,client_t>;
+
+// create server/client queues
+unique_ptr<server_t>makeServer(int port){
+  return make_unique<server_t>(port,asio::make_rpc_deser<string>(deserialiser),asio::make_rpc_serial<string>(serialiser),10,asio::varint_framing{});
+}
+unique_ptr<client_t>makeClient(int port){
+  return make_unique<client_t>("localhost",port,asio::make_rpc_deser<string>(deserialiser),asio::make_rpc_serial<string>(serialiser),asio::varint_framing{});
+}
+// get error from a future which should fail
+boost::system::error_code futureError(future<string>&f){
+  if(f.wait_for(chrono::seconds(5))!=future_status::ready)return asio::error::timed_out;
+  try{
+    f.get();
+  }catch(boost::system::system_error const&e){
+    return e.code();
+  }
+  return boost::system::error_code();
+}
+// serialisers
+bool testSerial(){
+  rpc_serial_t serial{asio::make_rpc_serial<string>(serialiser)};
+  rpc_deser_t deser{asio::make_rpc_deser<string>(deserialiser)};
+  string buf;
+  serial(buf,msg_t{42,"hello world"});
+  msg_t msg{deser(buf.data(),buf.size())};
+  bool ok{check(buf=="42 hello world"&&msg.id==42&&msg.body=="hello world","serial: round trip: "+buf)};
+  for(string const&bad:{string("hello"),string("42"),string(" 42 x"),string("4x2 y")}){
+    ok=check(deser(bad.data(),bad.size()).id==0,"serial: invalid message got an id: "+bad)&&ok;
+  }
+  return ok;
+}
+// concurrent requests served by rpc_serve
+bool testServe(int port){
+  bool ok{true};
+  size_t const nclients{2};
+  size_t const ncalls{200};
+  auto qserv=makeServer(port);
+  thread server([&](){asio::rpc_serve<string>(*qserv,[](string const&req){return "re:"+req;});});
+  vector<unique_ptr<client_t>>queues;
+  vector<unique_ptr<rpc_t>>clients;
+  for(size_t i=0;i<nclients;++i){
+    queues.push_back(makeClient(port));
+    clients.push_back(make_unique<rpc_t>(*queues.back(),10));
+  }
+  // futures
+  vector<vector<future<string>>>futs(nclients);
+  for(size_t j=0;j<ncalls;++j){
+    for(size_t i=0;i<nclients;++i)futs[i].push_back(clients[i]->call(to_string(i)+":"+to_string(j)));
+  }
+  for(size_t i=0;i<nclients;++i){
+    for(size_t j=0;j<ncalls&&ok;++j){
+      ok=check(futs[i][j].wait_for(chrono::seconds(5))==future_status::ready,"serve: future timed out");
+      if(ok)ok=check(futs[i][j].get()=="re:"+to_string(i)+":"+to_string(j),"serve: wrong reply");
+    }
+  }
+  // handlers
+  atomic<size_t>nok{0};
+  for(size_t j=0;j<ncalls;++j){
+    boost::system::error_code ec;
+    string const req{to_string(j)};
+    clients[0]->async_call(req,[&nok,req](boost::system::error_code const&ec,string const&reply){
+        if(ec==boost::system::error_code()&&reply=="re:"+req)++nok;
+      },ec);
+  }
+  for(size_t k=0;k<500&&nok.load()<ncalls;++k)this_thread::sleep_for(chrono::milliseconds(10));
+  ok=check(nok.load()==ncalls,"serve: handlers: "+to_string(nok.load())+" correct replies")&&ok;
+  ok=check(clients[0]->pending()==0&&clients[1]->pending()==0,"serve: outstanding requests left")&&ok;
+
+  // stop server
+  qserv->disable_deq(true);
+  server.join();
+  return ok;
+}
+// replies in reverse order
+bool testReorder(int port){
+  bool ok{true};
+  auto qserv=makeServer(port);
+  auto qclient=makeClient(port);
+  rpc_t client{*qclient,10};
+  future<string>f1{client.call("one")};
+  future<string>f2{client.call("two")};
+  boost::system::error_code ec;
+  auto r1=qserv->timed_deq_client(5000,ec);
+  auto r2=qserv->timed_deq_client(5000,ec);
+  if(!check(r1.first&&r2.first,"reorder: deq: "+ec.message()))return false;
+  qserv->enq_client(r2.second.first,msg_t{r2.second.second.id,"re:"+r2.second.second.body},ec);
+  qserv->enq_client(r1.second.first,msg_t{r1.second.second.id,"re:"+r1.second.second.body},ec);
+  ok=check(f1.wait_for(chrono::seconds(5))==future_status::ready&&f1.get()=="re:one","reorder: first request")&&ok;
+  ok=check(f2.wait_for(chrono::seconds(5))==future_status::ready&&f2.get()=="re:two","reorder: second request")&&ok;
+  return ok;
+}
+// outstanding requests when connection is lost or client is destroyed
+bool testFailures(int port){
+  bool ok{true};
+  auto qserv=makeServer(port);
+  auto qclient=makeClient(port);
+  future<string>flost,fabort;
+  {
+    rpc_t client{*qclient,10};
+    flost=client.call("lost");
+    boost::system::error_code ec;
+    auto r=qserv->timed_deq(5000,ec);
+    ok=check(r.first,"failures: deq: "+ec.message())&&ok;
+    qserv.reset();
+    boost::system::error_code eclost{futureError(flost)};
+    ok=check(eclost!=boost::system::error_code()&&eclost!=asio::error::timed_out,"failures: connection lost: "+eclost.message())&&ok;
+
+    // reconnect to new server which never replies
+    qserv=makeServer(port);
+    fabort=client.call("abort");
+    r=qserv->timed_deq(5000,ec);
+    ok=check(r.first&&r.second.body=="abort","failures: deq after reconnect: "+ec.message())&&ok;
+  }
+  boost::system::error_code ecabort{futureError(fabort)};
+  ok=check(ecabort==asio::error::operation_aborted,"failures: client destroyed: "+ecabort.message())&&ok;
+  return ok;
+}
+// test program
+int main(int argc,char*argv[]){
+  int port{argc>1?boost::lexical_cast<int>(argv[1]):7805};
+  qtest::results res;
+  res+=testSerial();
+  res+=testServe(port);
+  res+=testReorder(port+1);
+  res+=testFailures(port+2);
+  return res.report();
+}
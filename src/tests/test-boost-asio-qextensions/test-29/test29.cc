@@ -0,0 +1,133 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0. 
+
+/*
+test program for udp_queue
+the program checks that:
+- messages sent one per datagram and messages packed into datagrams (max_delay_us) are received in order over loopback
+- a datagram larger than max_datagram and a datagram without valid frames are dropped and counted
+- a message larger than max_datagram is received by a queue accepting larger datagrams
+- messages sent to a multicast group are received by all members of the group (skipped if multicast is not available)
+
+usage: test29 [port]
+*/
+
+#include <boost/udp_queue.hpp>
+#include <boost/lexical_cast.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <stdexcept>
+#include <iostream>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "../qtest-support.h"
+using namespace std;
+using qtest::check;
+
+namespace asio= boost::asio;
+
+// serialization functions
+auto deserialiser=[](char const*msg,size_t len){return string(msg,len);};
+auto serialiser=[](string&out,string const&s){out.append(s);};
+using base_t=asio::detail::base::queue_empty_base<string>;
+using queue_t=asio::udp_queue<string,decltype(deserialiser),decltype(serialiser),base_t>;
+
+// receive messages '0', '1', ... and check them
+bool recvMsgs(queue_t&q,size_t n,string const&what){
+  for(size_t i=0;i<n;++i){
+    boost::system::error_code ec;
+    pair<bool,string>msg{q.timed_deq(2000,ec)};
+    if(!check(msg.first&&msg.second==to_string(i),what+": message "+to_string(i)+": "+ec.message()))return false;
+  }
+  return true;
+}
+// messages sent one per datagram and packed into datagrams
+bool testUnicast(int port){
+  bool ok{true};
+  size_t const nmsg{500};
+  queue_t qrecv{port,"",0,deserialiser,serialiser};
+  for(size_t delay:{0,1000}){
+    asio::udp_options opts;
+    opts.max_delay_us=delay;
+    string const what{delay==0?"unicast":"packed"};
+    queue_t qsend{0,"127.0.0.1",port,deserialiser,serialiser,opts};
+    thread sender([&](){
+      boost::system::error_code ec;
+      for(size_t i=0;i<nmsg;++i){
+        if(!qsend.enq(to_string(i),ec))cerr<<what<<": enq failed: "<<ec.message()<<endl;
+        if(i%50==0)this_thread::sleep_for(chrono::milliseconds(1));
+      }
+      qsend.flush(ec);
+    });
+    ok=recvMsgs(qrecv,nmsg,what)&&ok;
+    sender.join();
+  }
+  return check(qrecv.dropped()==0,"unicast: dropped "+to_string(qrecv.dropped())+" datagrams")&&ok;
+}
+// oversized and invalid datagrams
+bool testDropped(int port){
+  bool ok{true};
+  queue_t qrecv{port,"",0,deserialiser,serialiser};
+  asio::udp_options large;
+  large.max_datagram=8000;
+  queue_t qlarge{port+1,"",0,deserialiser,serialiser,large};
+  boost::system::error_code ec;
+  string const big(3000,'x');
+  {
+    queue_t qsend{0,"127.0.0.1",port,deserialiser,serialiser};
+    queue_t qsendlarge{0,"127.0.0.1",port+1,deserialiser,serialiser};
+    qsend.enq(big,ec);
+    qsend.enq("0",ec);
+    qsendlarge.enq(big,ec);
+  }
+  // datagram without a valid frame (length header is larger than the datagram)
+  int fd{::socket(AF_INET,SOCK_DGRAM,0)};
+  struct sockaddr_in addr{};
+  addr.sin_family=AF_INET;
+  addr.sin_port=htons(port);
+  addr.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+  char const garbage[]{static_cast<char>(100),'a','b'};
+  ::sendto(fd,garbage,sizeof(garbage),0,reinterpret_cast<struct sockaddr*>(&addr),sizeof(addr));
+  ::close(fd);
+
+  ok=recvMsgs(qrecv,1,"dropped")&&ok;
+  pair<bool,string>msg{qrecv.timed_deq(200,ec)};
+  ok=check(!msg.first&&ec==asio::error::timed_out,"dropped: unexpected message of size "+to_string(msg.second.size()))&&ok;
+  ok=check(qrecv.dropped()==2,"dropped: "+to_string(qrecv.dropped())+" datagrams dropped, expected 2")&&ok;
+  msg=qlarge.timed_deq(2000,ec);
+  ok=check(msg.first&&msg.second==big,"dropped: large datagram: "+ec.message())&&ok;
+  return ok;
+}
+// multicast fan-out
+bool testMulticast(int port){
+  asio::udp_options opts;
+  opts.group="239.255.42.99";
+  vector<unique_ptr<queue_t>>receivers;
+  unique_ptr<queue_t>qsend;
+  try{
+    for(size_t i=0;i<2;++i)receivers.push_back(make_unique<queue_t>(port,"",0,deserialiser,serialiser,opts));
+    qsend=make_unique<queue_t>(0,opts.group,port,deserialiser,serialiser);
+  }catch(std::exception const&e){
+    cout<<"multicast not available - skipped: "<<e.what()<<endl;
+    return true;
+  }
+  size_t const nmsg{100};
+  boost::system::error_code ec;
+  for(size_t i=0;i<nmsg;++i)if(!qsend->enq(to_string(i),ec))return check(false,"multicast: enq: "+ec.message());
+  bool ok{true};
+  for(size_t i=0;i<receivers.size();++i)ok=recvMsgs(*receivers[i],nmsg,"multicast: receiver "+to_string(i))&&ok;
+  return ok;
+}
+// test program
+int main(int argc,char*argv[]){
+  int port{argc>1?boost::lexical_cast<int>(argv[1]):7810};
+  qtest::results res;
+  res+=testUnicast(port);
+  res+=testDropped(port+1);
+  res+=testMulticast(port+3);
+  return res.report();
+}
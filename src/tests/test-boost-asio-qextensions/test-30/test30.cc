@@ -0,0 +1,118 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0. 
+
+/*
+test program for a bounded sockdeq_serv_queue
+a producer sends messages to a queue with a max size and nobody dequeues until the producer is blocked
+the program checks that:
+- the queue never holds more than max size messages
+- the producer is pushed back through TCP flow control (stops making progress) while the queue is full
+- once messages are dequeued the producer resumes and all messages are dequeued in order
+- removing the max size releases a reactor waiting for space
+
+usage: test30 [port]
+*/
+
+#include <boost/sockdeq_serv_queue.hpp>
+#include <boost/sockclient_queue.hpp>
+#include <boost/lexical_cast.hpp>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include "../qtest-support.h"
+using namespace std;
+using qtest::check;
+
+namespace asio= boost::asio;
+
+// serialization functions
+auto deserialiser=[](char const*msg,size_t len){return string(msg,len-1);};
+auto serialiser=[](string&out,string const&s){out.append(s);};
+using base_t=asio::detail::base::queue_empty_base<string>;
+using server_t=asio::sockdeq_serv_queue<string,decltype(deserialiser),base_t>;
+using client_t=asio::sockclient_queue<string,decltype(deserialiser),decltype(serialiser),base_t>;
+
+// message with sequence number
+string makeMsg(size_t i){
+  return to_string(i)+":"+string(60,'x');
+}
+// small socket buffers so that pushback is seen early
+asio::socket_options makeOptions(){
+  asio::socket_options ret;
+  ret.sndbuf=16*1024;
+  ret.rcvbuf=16*1024;
+  return ret;
+}
+// producer blocked by a full queue resumes when messages are dequeued
+bool testBackpressure(int port){
+  bool ok{true};
+  size_t const maxsize{100};
+  size_t const nmsg{200000};
+  server_t qserv{port,deserialiser,4,50,'\n',1,makeOptions()};
+  qserv.set_maxsize(maxsize);
+  client_t qclient{"localhost",port,deserialiser,serialiser,'\n',asio::cork_options{},asio::reconnect_options{},makeOptions()};
+
+  atomic<size_t>nsent{0};
+  thread producer([&](){
+    for(size_t i=0;i<nmsg;++i){
+      boost::system::error_code ec;
+      if(!qclient.enq(makeMsg(i),ec)){
+        cerr<<"producer: enq failed: "<<ec.message()<<endl;
+        break;
+      }
+      nsent.store(i+1);
+    }
+  });
+  // wait until producer is blocked (no progress during 200 ms)
+  size_t last{nsent.load()};
+  for(size_t i=0;i<50;++i){
+    this_thread::sleep_for(chrono::milliseconds(200));
+    size_t curr{nsent.load()};
+    if(curr==last)break;
+    last=curr;
+  }
+  ok=check(nsent.load()==last&&last<nmsg,"producer was never pushed back - sent "+to_string(nsent.load())+" messages")&&ok;
+  ok=check(qserv.size()==maxsize,"queue size while producer is blocked: "+to_string(qserv.size()))&&ok;
+
+  // drain queue - producer resumes
+  size_t maxseen{0};
+  for(size_t i=0;i<nmsg;++i){
+    maxseen=max(maxseen,qserv.size());
+    boost::system::error_code ec;
+    pair<bool,string>msg{qserv.timed_deq(5000,ec)};
+    if(!check(msg.first&&msg.second==makeMsg(i),"message "+to_string(i)+": "+ec.message())){ok=false;break;}
+  }
+  producer.join();
+  ok=check(maxseen<=maxsize,"queue grew to "+to_string(maxseen)+" messages")&&ok;
+  ok=check(nsent.load()==nmsg,"producer sent "+to_string(nsent.load())+" messages")&&ok;
+  return ok;
+}
+// removing max size releases a waiting reactor
+bool testUnbound(int port){
+  bool ok{true};
+  size_t const nmsg{1000};
+  server_t qserv{port,deserialiser,4,50};
+  qserv.set_maxsize(10);
+  client_t qclient{"localhost",port,deserialiser,serialiser};
+  thread producer([&](){
+    boost::system::error_code ec;
+    for(size_t i=0;i<nmsg;++i)qclient.enq(makeMsg(i),ec);
+  });
+  for(size_t i=0;i<500&&qserv.size()<10;++i)this_thread::sleep_for(chrono::milliseconds(10));
+  ok=check(qserv.size()==10,"unbound: queue size with max size 10: "+to_string(qserv.size()))&&ok;
+  qserv.set_maxsize(0);
+  for(size_t i=0;i<500&&qserv.size()<nmsg;++i)this_thread::sleep_for(chrono::milliseconds(10));
+  ok=check(qserv.size()==nmsg,"unbound: queue size without max size: "+to_string(qserv.size()))&&ok;
+  producer.join();
+  return ok;
+}
+// test program
+int main(int argc,char*argv[]){
+  int port{argc>1?boost::lexical_cast<int>(argv[1]):7815};
+  qtest::results res;
+  res+=testBackpressure(port);
+  res+=testUnbound(port+1);
+  return res.report();
+}
@@ -0,0 +1,140 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0. 
+
+/*
+test program for the io_uring engine of sockdeq_serv_queue
+the program checks that:
+- a sockdeq_serv_queue with io_engine::uring dequeues all messages from several clients exactly once and in order per
+  client, also when the kernel runs out of ring buffers while the queue is full (uses io_uring if the kernel supports it)
+- uring::sqe() submits queued entries when the submission queue is full
+- in a process where io_uring_setup() fails (blocked with seccomp) uringSupported() is false and a queue with
+  io_engine::uring falls back to epoll
+
+usage: test31 [port]
+*/
+
+#include <boost/sockdeq_serv_queue.hpp>
+#include <boost/sockclient_queue.hpp>
+#include <boost/lexical_cast.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <iostream>
+#include <cstddef>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include "../qtest-support.h"
+using namespace std;
+using qtest::check;
+
+namespace asio= boost::asio;
+namespace qs=boost::asio::detail::queue_support;
+
+// serialization functions
+auto deserialiser=[](char const*msg,size_t len){return string(msg,len);};
+auto serialiser=[](string&out,string const&s){out.append(s);};
+using base_t=asio::detail::base::queue_empty_base<string>;
+using server_t=asio::sockdeq_serv_queue<string,decltype(deserialiser),base_t,std::queue<string>,asio::varint_framing>;
+using client_t=asio::sockclient_queue<string,decltype(deserialiser),decltype(serialiser),base_t,asio::varint_framing>;
+
+// message from a client (every 100th message is larger than a ring buffer)
+string makeMsg(size_t i,size_t j){
+  return to_string(i)+":"+to_string(j)+":"+string(j%100==0?50000:100,'x');
+}
+// clients sending to a server using the uring engine
+// (the queue is bounded and the consumer starts late so the reactor blocks and the kernel runs out of ring buffers)
+bool testServer(int port,string const&name){
+  bool ok{true};
+  size_t const nclients{20};
+  size_t const nmsg{1000};
+  asio::socket_options opts;
+  opts.engine=asio::io_engine::uring;
+  server_t qserv{port,deserialiser,nclients,50,asio::varint_framing{},1,opts};
+  qserv.set_maxsize(100);
+  vector<unique_ptr<client_t>>clients;
+  for(size_t i=0;i<nclients;++i)clients.push_back(make_unique<client_t>("localhost",port,deserialiser,serialiser,asio::varint_framing{}));
+  vector<thread>producers;
+  for(size_t i=0;i<nclients;++i){
+    producers.emplace_back([&,i](){
+      boost::system::error_code ec;
+      for(size_t j=0;j<nmsg;++j)if(!clients[i]->enq(makeMsg(i,j),ec))cerr<<name<<": enq failed: "<<ec.message()<<endl;
+    });
+  }
+  this_thread::sleep_for(chrono::milliseconds(200));
+  vector<size_t>next(nclients,0);
+  for(size_t n=0;n<nclients*nmsg;++n){
+    boost::system::error_code ec;
+    pair<bool,string>msg{qserv.timed_deq(5000,ec)};
+    if(!check(msg.first,name+": deq after "+to_string(n)+" messages: "+ec.message())){ok=false;break;}
+    size_t pos{msg.second.find(':')};
+    size_t i{stoul(msg.second.substr(0,pos))};
+    if(!check(i<nclients&&msg.second==makeMsg(i,next[i]++),name+": unexpected message from client "+to_string(i))){ok=false;break;}
+  }
+  for(auto&t:producers)t.join();
+  return ok;
+}
+#if defined(IORING_RECV_MULTISHOT)&&defined(__NR_io_uring_setup)
+// sqe() submits queued entries when the submission queue is full
+bool testSqe(){
+  qs::uring ring(4);
+  size_t const nnops{6};
+  boost::system::error_code ec;
+  bool ok{true};
+  for(size_t i=0;i<nnops;++i){
+    struct io_uring_sqe*sqe{ring.sqe(ec)};
+    if(!check(sqe!=nullptr,"sqe: "+ec.message()))return false;
+    sqe->opcode=IORING_OP_NOP;
+    sqe->user_data=i;
+  }
+  ok=check(ring.enter(nnops,1000,ec),"sqe: enter: "+ec.message())&&ok;
+  size_t ncomplete{0};
+  ring.completions([&](struct io_uring_cqe const&cqe){if(cqe.res==0&&cqe.user_data==ncomplete)++ncomplete;});
+  return check(ncomplete==nnops,"sqe: "+to_string(ncomplete)+" completions")&&ok;
+}
+#else
+bool testSqe(){return true;}
+#endif
+// block io_uring_setup() in this process
+bool blockUring(){
+  struct sock_filter filter[]{
+    BPF_STMT(BPF_LD|BPF_W|BPF_ABS,offsetof(struct seccomp_data,arch)),
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K,AUDIT_ARCH_X86_64,1,0),
+    BPF_STMT(BPF_RET|BPF_K,SECCOMP_RET_ALLOW),
+    BPF_STMT(BPF_LD|BPF_W|BPF_ABS,offsetof(struct seccomp_data,nr)),
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K,__NR_io_uring_setup,0,1),
+    BPF_STMT(BPF_RET|BPF_K,SECCOMP_RET_ERRNO|ENOSYS),
+    BPF_STMT(BPF_RET|BPF_K,SECCOMP_RET_ALLOW),
+  };
+  struct sock_fprog prog{static_cast<unsigned short>(sizeof(filter)/sizeof(filter[0])),filter};
+  return ::prctl(PR_SET_NO_NEW_PRIVS,1,0,0,0)==0&&::prctl(PR_SET_SECCOMP,SECCOMP_MODE_FILTER,&prog)==0;
+}
+// epoll fallback in a child process where io_uring is blocked
+// (must run before io_uring support has been probed in this process since the probe result is cached)
+bool testFallback(int port){
+  pid_t pid{::fork()};
+  if(pid<0)return check(false,"fallback: fork failed");
+  if(pid==0){
+    bool ok{check(blockUring(),"fallback: failed blocking io_uring")};
+    ok=ok&&check(!qs::uringSupported(),"fallback: io_uring reported as supported")&&testServer(port,"fallback");
+    ::_exit(ok?0:1);
+  }
+  int status{0};
+  ::waitpid(pid,&status,0);
+  return check(WIFEXITED(status)&&WEXITSTATUS(status)==0,"fallback: child failed");
+}
+// test program
+int main(int argc,char*argv[]){
+  int port{argc>1?boost::lexical_cast<int>(argv[1]):7820};
+  qtest::results res;
+  res+=testFallback(port);
+  bool const uring{qs::uringSupported()};
+  cout<<"io_uring "<<(uring?"supported":"not supported - testing epoll fallback only")<<endl;
+  if(uring)res+=testSqe();
+  res+=testServer(port+1,uring?"uring":"epoll");
+  return res.report();
+}
@@ -2,7 +2,10 @@
 // Distributed under the Boost Software License, Version 1.0. 
 
 #include "type-utils/tpool.h"
+#include "type-utils/tpool_algo.h"
+#include "type-utils/tpool_future.h"
 #include <functional>
+#include <chrono>
 #include <iostream>
 
 using namespace std;
@@ -19,12 +22,19 @@ struct Foo{
 };
 ostream&operator<<(ostream&os,Foo const&foo){return cout<<"foo ";}
 
+// report result of a check
+bool check(bool stat,string const&what){
+  if(!stat)cerr<<"FAILED: "<<what<<endl;
+  return stat;
+}
+
 // main test program
 int main(){
   // create function returning another function
   auto f=[]()->Foo{return Foo("Hello");};
   auto g=[]()->void{cout<<"world"<<endl;};
   function<Foo()>ff=f;
+  bool ok{true};
 
   // create and submit tasks
   {
@@ -40,4 +50,78 @@ int main(){
     cout<<transform_tuple(type2string_helper(),res)<<endl;
     cout<<"res: "<<res<<endl;
   }
+  // tasks submitting tasks (queued on the deque of the submitting worker and stolen by idle workers)
+  {
+    atomic<int>cnt{0};
+    tpool tp(4);
+    tp.submit([&](){for(int i=0;i<1000;++i)tp.submit([&](){++cnt;});}).get();
+    auto tmo=chrono::steady_clock::now()+chrono::seconds(5);
+    while(cnt<1000&&chrono::steady_clock::now()<tmo)this_thread::yield();
+    ok=check(cnt==1000,"nested tasks: "+to_string(cnt))&&ok;
+  }
+  // fire and forget tasks
+  {
+    atomic<int>cnt{0};
+    tpool tp(2);
+    for(int i=0;i<1000;++i)tp.submit_detached([&](){++cnt;});
+    auto tmo=chrono::steady_clock::now()+chrono::seconds(5);
+    while(cnt<1000&&chrono::steady_clock::now()<tmo)this_thread::yield();
+    ok=check(cnt==1000,"detached tasks: "+to_string(cnt))&&ok;
+  }
+  // parallel algorithms
+  {
+    tpool tp(4);
+    vector<int>v(100000);
+    parallel_for(tp,size_t{0},v.size(),[&](size_t i){v[i]=static_cast<int>(v.size()-i);});
+    vector<long>w(v.size());
+    parallel_transform(tp,v.begin(),v.end(),w.begin(),[](int x){return 2L*x;});
+    bool transformed{true};
+    for(size_t i=0;i<w.size();++i)transformed=transformed&&w[i]==2L*static_cast<long>(v.size()-i);
+    ok=check(transformed,"parallel_for/parallel_transform")&&ok;
+    long const n{static_cast<long>(v.size())};
+    long sum{parallel_reduce(tp,w.begin(),w.end(),0L,plus<long>())};
+    ok=check(sum==n*(n+1),"parallel_reduce: "+to_string(sum))&&ok;
+    parallel_sort(tp,v.begin(),v.end());
+    bool sorted{true};
+    for(size_t i=0;i<v.size();++i)sorted=sorted&&v[i]==static_cast<int>(i+1);
+    ok=check(sorted,"parallel_sort")&&ok;
+  }
+  // continuations and task graphs
+  {
+    tpool tp(4);
+    auto fa=spawn(tp,[](){return 20;}).then([](int x){return x+1;});
+    auto fb=spawn(tp,[](){return string("answer");});
+    auto fab=when_all(fa,fb).then([](tuple<int,string>const&t){return std::get<1>(t)+": "+to_string(2*std::get<0>(t));});
+    ok=check(fab.get()=="answer: 42","when_all/then: "+fab.get())&&ok;
+    vector<tpool_future<int>>fs;
+    for(int i=0;i<10;++i)fs.push_back(spawn(tp,[i](){return i*i;}));
+    auto any=when_any(fs).get();
+    ok=check(any.first<fs.size()&&any.second==static_cast<int>(any.first*any.first),"when_any: "+to_string(any.first))&&ok;
+    auto all=when_all(fs).get();
+    bool squares{all.size()==fs.size()};
+    for(size_t i=0;squares&&i<all.size();++i)squares=all[i]==static_cast<int>(i*i);
+    ok=check(squares,"when_all on vector")&&ok;
+
+    // two failed futures - the first failed future in argument order propagates even if it fails last
+    auto fail1=spawn(tp,[]()->int{this_thread::sleep_for(chrono::milliseconds(50));throw runtime_error("first");});
+    auto fail2=spawn(tp,[]()->string{throw runtime_error("second");});
+    string what;
+    try{when_all(fail1,fb,fail2).get();}
+    catch(runtime_error const&e){what=e.what();}
+    ok=check(what=="first","when_all with two failed futures: '"+what+"'")&&ok;
+    what.clear();
+    try{when_all(vector<tpool_future<int>>{fs[0],fail1,spawn(tp,[]()->int{throw runtime_error("second");})}).get();}
+    catch(runtime_error const&e){what=e.what();}
+    ok=check(what=="first","when_all on vector with two failed futures: '"+what+"'")&&ok;
+    task_graph g(tp);
+    vector<int>res(4);
+    auto n0=g.add([&](){res[0]=1;});
+    auto n1=g.add([&](){res[1]=res[0]+1;},{n0});
+    auto n2=g.add([&](){res[2]=res[0]+2;},{n0});
+    g.add([&](){res[3]=res[1]+res[2];},{n1,n2});
+    g.run().get();
+    ok=check(res[3]==5,"task graph: "+to_string(res[3]))&&ok;
+  }
+  cout<<(ok?"ok":"FAILED")<<endl;
+  return ok?0:1;
 }
@@ -0,0 +1,49 @@
+// Copyright (c) 2003-2015 Hans Ewetz (hansewetz at hotmail dot com)
+// Distributed under the Boost Software License, Version 1.0.
+
+/*
+benchmark for idle workers in a tpool
+the program measures the cpu used by an idle pool and the latency from submitting a task to an idle pool until
+the task starts running
+
+usage: test2-tpool [#threads] [#wakeups]
+*/
+
+#include "type-utils/tpool.h"
+#include <boost/lexical_cast.hpp>
+#include <ctime>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+using namespace std;
+using namespace utils;
+
+// test program
+int main(int argc,char*argv[]){
+  size_t nthreads{argc>1?boost::lexical_cast<size_t>(argv[1]):16};
+  size_t nwakeups{argc>2?boost::lexical_cast<size_t>(argv[2]):200};
+
+  tpool tp(nthreads);
+
+  // cpu used by idle pool (give workers time to park first)
+  this_thread::sleep_for(chrono::milliseconds(100));
+  clock_t c0{clock()};
+  auto t0=chrono::steady_clock::now();
+  this_thread::sleep_for(chrono::seconds(1));
+  double cpu{static_cast<double>(clock()-c0)/CLOCKS_PER_SEC};
+  double wall{chrono::duration<double>(chrono::steady_clock::now()-t0).count()};
+  cout<<"idle pool ("<<nthreads<<" threads): "<<100*cpu/wall<<"% of one core"<<endl;
+
+  // latency from submit until task runs when the pool is idle
+  vector<double>lat;
+  for(size_t i=0;i<nwakeups;++i){
+    this_thread::sleep_for(chrono::milliseconds(2));
+    auto tsubmit=chrono::steady_clock::now();
+    auto tstart=tp.submit([](){return chrono::steady_clock::now();}).get();
+    lat.push_back(chrono::duration<double,micro>(tstart-tsubmit).count());
+  }
+  sort(lat.begin(),lat.end());
+  cout<<"wakeup latency (us): median: "<<lat[lat.size()/2]<<", p99: "<<lat[lat.size()*99/100]<<", max: "<<lat.back()<<endl;
+}